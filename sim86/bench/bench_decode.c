@@ -0,0 +1,49 @@
+bool do_bench_decode(const char *asm_path) {
+    bool ret = true;
+
+    NomCmd cmd = {0};
+
+    if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", "bench_decode.out")) nom_return_defer(false);
+
+    printf("%s\n", asm_path);
+    if(!nom_cmd_run(&cmd, "./sim86", "bench-decode", "bench_decode.out")) nom_return_defer(false);
+
+defer:
+    if(!ret) {
+        printf("File `%s` could not be benchmarked\n", asm_path);
+    }
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+int bench_decode(int argc, const char **argv) {
+    static const char *defaultFiles[] = {
+        "test/run/draw_rectangle.asm",
+        "test/run/challenge_rectangle.asm",
+    };
+
+    printf("\n");
+    bool success = true;
+
+    if(argc > 0) {
+        for(int i = 0; i < argc; i++) {
+            success = do_bench_decode(argv[i]) && success;
+        }
+    } else {
+        for(size_t i = 0; i < sizeof(defaultFiles) / sizeof(*defaultFiles); i++) {
+            success = do_bench_decode(defaultFiles[i]) && success;
+        }
+    }
+
+    nom_delete("bench_decode.out");
+
+    // Bulk decompile throughput on a synthetic 64 KB code segment
+    NomCmd cmd = {0};
+    printf("synthetic 64 KB\n");
+    success = nom_cmd_run(&cmd, "./sim86", "bench-decompile") && success;
+    nom_cmd_free(&cmd);
+
+    printf("\n");
+
+    return success ? 0 : 1;
+}
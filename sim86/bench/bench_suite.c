@@ -0,0 +1,62 @@
+#define BENCH_SUITE_TRIALS "--trials=10"
+#define BENCH_SUITE_CSV "--csv=bench_results.csv"
+#define BENCH_SUITE_JSON "--json=bench_results.jsonl"
+
+bool do_bench_suite(const char *asm_path, const char *engine) {
+    bool ret = true;
+
+    NomCmd cmd = {0};
+
+    // Program name in the results is the file name up to the first dot
+    const char *base = strrchr(asm_path, '/');
+    base = base ? base + 1 : asm_path;
+    char out_path[256];
+    snprintf(out_path, sizeof(out_path), "%.*s.bench.out", (int) strcspn(base, "."), base);
+
+    if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", out_path)) nom_return_defer(false);
+
+    if(!nom_cmd_run(&cmd, "./sim86", "bench", engine, BENCH_SUITE_TRIALS, BENCH_SUITE_CSV, BENCH_SUITE_JSON,
+                    out_path)) nom_return_defer(false);
+
+defer:
+    if(!ret) {
+        printf("File `%s` could not be benchmarked\n", asm_path);
+    }
+    nom_delete(out_path);
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+// Results are appended to bench_results.csv and bench_results.jsonl, to track them across builds
+int bench_suite(int argc, const char **argv) {
+    static const char *defaultFiles[] = {
+        "test/run/draw_rectangle.asm",
+        "test/run/challenge_rectangle.asm",
+        "bench/memcpy_loop.asm",
+        "bench/nested_cmp.asm",
+        "bench/flag_heavy.asm",
+    };
+    static const char *engines[] = {
+        "--engine=opcodes",
+        "--engine=blocks",
+        "--engine=jit",
+    };
+
+    printf("\n");
+    bool success = true;
+
+    for(size_t e = 0; e < sizeof(engines) / sizeof(*engines); e++) {
+        if(argc > 0) {
+            for(int i = 0; i < argc; i++) {
+                success = do_bench_suite(argv[i], engines[e]) && success;
+            }
+        } else {
+            for(size_t i = 0; i < sizeof(defaultFiles) / sizeof(*defaultFiles); i++) {
+                success = do_bench_suite(defaultFiles[i], engines[e]) && success;
+            }
+        }
+        printf("\n");
+    }
+
+    return success ? 0 : 1;
+}
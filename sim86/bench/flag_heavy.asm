@@ -0,0 +1,30 @@
+bits 16
+
+; Arithmetic whose every result is branched on, counting overflows,
+; borrows, even parities and negative compares
+mov ax, 0
+mov dx, 0x7ff0
+mov cx, 0
+flag_loop:
+	add dx, 0x1235
+	jno no_overflow
+	add bx, 1
+no_overflow:
+
+	sub ax, dx
+	jnb no_borrow
+	add si, 1
+no_borrow:
+
+	xor ax, cx
+	jnp odd_parity
+	add di, 1
+odd_parity:
+
+	cmp ax, dx
+	jns not_negative
+	add bp, 1
+not_negative:
+
+	add cx, 1
+	jnz flag_loop
@@ -0,0 +1,25 @@
+bits 16
+
+; Fill a 4KB source block with its own addresses
+mov si, 0x4000
+mov cx, 2048
+fill_word:
+	mov word [si], si
+	add si, 2
+	loop fill_word
+
+; Copy it word by word, 64 times
+mov bp, 64
+copy_pass:
+	mov si, 0x4000
+	mov di, 0x8000
+	mov cx, 2048
+	copy_word:
+		mov ax, [si]
+		mov [di], ax
+		add si, 2
+		add di, 2
+		loop copy_word
+
+	sub bp, 1
+	jnz copy_pass
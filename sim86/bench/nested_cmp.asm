@@ -0,0 +1,27 @@
+bits 16
+
+; Count the (x, y) pairs in a 256x256 grid with x < y and with x <= 128
+mov bx, 0
+mov si, 0
+mov dx, 0
+y_loop:
+
+	mov cx, 0
+	x_loop:
+		cmp cx, dx
+		jnl x_not_below
+		add bx, 1
+	x_not_below:
+
+		cmp cx, 128
+		jnbe x_above_half
+		add si, 1
+	x_above_half:
+
+		add cx, 1
+		cmp cx, 256
+		jnz x_loop
+
+	add dx, 1
+	cmp dx, 256
+	jnz y_loop
@@ -10,8 +10,19 @@
 #define NOM_IMPLEMENTATION
 #include "nom/nom.h"
 
+#include "test/sim86_status.c"
 #include "test/decompile/test_decompile.c"
 #include "test/run/test_run.c"
+#include "test/jit/test_jit.c"
+#include "test/cycles/test_cycles.c"
+#include "test/lib/test_lib.c"
+#include "test/serve/test_serve.c"
+#include "test/limits/test_limits.c"
+#include "test/state/test_state.c"
+#include "test/dirty/test_dirty.c"
+#include "test/load/test_load.c"
+#include "bench/bench_decode.c"
+#include "bench/bench_suite.c"
 
 #include <string.h>
 
@@ -28,6 +39,7 @@ void set_flags(NomCompileConfig *compile_config) {
         , "-pedantic"
         , "-Wshadow"
         , "-Wformat=2"
+        , "-pthread"
     );
     nom_cmd_flags_append(&flags // OFF_WARNINGS
         , "-Wno-unused-parameter"
@@ -49,6 +61,56 @@ void set_flags(NomCompileConfig *compile_config) {
     compile_config->flags = flags;
 }
 
+#define LIB_OBJ_DIR "obj_lib"
+#define LIB_STATIC "libsim86.a"
+#define LIB_SHARED "libsim86.so"
+
+// Compiles a library translation unit optimized and position independent, then adds it to the archive
+bool walkable_compile_lib(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    if(!(type == NOM_FILE_REG && ftw->path_len >= 2 && strcmp(path + ftw->path_len - 2, ".c") == 0)) {
+        return true;
+    }
+    if(strcmp(path, "src/sim86.c") == 0) {
+        return true; // The command line, not the library
+    }
+
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    char obj[256];
+    snprintf(obj, sizeof(obj), LIB_OBJ_DIR "/%.*s.o", (int) strlen(name) - 2, name);
+
+    bool ret = true;
+    NomCmd cmd = {0};
+    if(!nom_cmd_run(&cmd, "clang", "-iquote", "src", "-Wall", "-Wextra", "-pedantic", "-Wshadow",
+                    "-Wno-unused-parameter", "-Wno-unused-function", "-Wno-implicit-fallthrough",
+                    "-Wno-missing-field-initializers", "-O2", "-fPIC", "-pthread", "-c", path, "-o", obj)) {
+        nom_return_defer(false);
+    }
+    if(!nom_cmd_run(&cmd, "ar", "rcs", LIB_STATIC, obj)) nom_return_defer(false);
+
+defer:
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+// libsim86.a and libsim86.so, everything in src but the command line
+bool build_lib(void) {
+    bool ret = true;
+    NomCmd cmd = {0};
+
+    nom_delete(LIB_STATIC); // ar only adds, drop objects of removed files
+    if(!nom_cmd_run(&cmd, "mkdir", "-p", LIB_OBJ_DIR)) nom_return_defer(false);
+    if(!nom_files_read_dir("src", walkable_compile_lib)) nom_return_defer(false);
+    if(!nom_cmd_run(&cmd, "clang", "-shared", "-o", LIB_SHARED,
+                    "-Wl,--whole-archive", LIB_STATIC, "-Wl,--no-whole-archive", "-pthread")) {
+        nom_return_defer(false);
+    }
+
+defer:
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
 int test(int argc, const char **argv) {
     // Skip executable name and test commando
     argc -= 2;
@@ -61,6 +123,30 @@ int test(int argc, const char **argv) {
 
         } else if(strcmp(maybe_cmd, "run") == 0) {
             return test_run(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "jit") == 0) {
+            return test_jit(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "cycles") == 0) {
+            return test_cycles(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "lib") == 0) {
+            return test_lib(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "serve") == 0) {
+            return test_serve(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "limits") == 0) {
+            return test_limits(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "state") == 0) {
+            return test_state(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "dirty") == 0) {
+            return test_dirty(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "load") == 0) {
+            return test_load(argc - 1, argv + 1);
         }
     }
 
@@ -68,6 +154,36 @@ int test(int argc, const char **argv) {
     int ret;
     if((ret = test_decompile(argc, argv))) return ret;
     if((ret = test_run(argc, argv))) return ret;
+    if((ret = test_jit(argc, argv))) return ret;
+    if((ret = test_cycles(argc, argv))) return ret;
+    if((ret = test_lib(argc, argv))) return ret;
+    if((ret = test_serve(argc, argv))) return ret;
+    if((ret = test_limits(argc, argv))) return ret;
+    if((ret = test_state(argc, argv))) return ret;
+    if((ret = test_dirty(argc, argv))) return ret;
+    if((ret = test_load(argc, argv))) return ret;
+    return 0;
+}
+
+int bench(int argc, const char **argv) {
+    // Skip executable name and bench commando
+    argc -= 2;
+    argv += 2;
+
+    if(argc > 0) {
+        const char *maybe_cmd = argv[0];
+        if(strcmp(maybe_cmd, "decode") == 0) {
+            return bench_decode(argc - 1, argv + 1);
+
+        } else if(strcmp(maybe_cmd, "suite") == 0) {
+            return bench_suite(argc - 1, argv + 1);
+        }
+    }
+
+    // Run all
+    int ret;
+    if((ret = bench_decode(argc, argv))) return ret;
+    if((ret = bench_suite(argc, argv))) return ret;
     return 0;
 }
 
@@ -93,18 +209,31 @@ int main(int argc, const char **argv) {
     if(strcmp(cmd, "compile") == 0) {
         if(!nom_compile(&compile_config)) ret = 1;
 
+    } else if(strcmp(cmd, "lib") == 0) {
+        if(!build_lib()) ret = 1;
+
     } else if(strcmp(cmd, "test") == 0) {
-        if(!nom_compile(&compile_config)) ret = 1;
+        if(!nom_compile(&compile_config) || !build_lib()) ret = 1;
         if(!ret) {
             ret = test(argc, argv);
         }
 
+    } else if(strcmp(cmd, "bench") == 0) {
+        if(!nom_compile(&compile_config)) ret = 1;
+        if(!ret) {
+            ret = bench(argc, argv);
+        }
+
     } else if(strcmp(cmd, "db") == 0) {
         if(!nom_build_compilation_database(&compile_config)) ret = 1;
 
     } else if(strcmp(cmd, "clean") == 0) {
         if(!nom_clean(&compile_config)) ret = 1;
 
+        NomCmd rm_cmd = {0};
+        if(!nom_cmd_run(&rm_cmd, "rm", "-rf", LIB_OBJ_DIR, LIB_STATIC, LIB_SHARED)) ret = 1;
+        nom_cmd_free(&rm_cmd);
+
     } else {
         nom_log(NOM_ERROR, "command `%s` not recognized", cmd);
         ret = 1;
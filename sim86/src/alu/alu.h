@@ -0,0 +1,438 @@
+/*
+ * Arithmetic and jump condition semantics shared by every execution engine.
+ * Header only (static inline) so engines can inline them in their hot paths.
+ */
+#ifndef SIM86_ALU_H
+#define SIM86_ALU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "opcode/opcode.h"
+#include "memory/memory.h"
+
+/* ------------------------- FLAGS ---------------------- */
+
+static inline uint32_t size_mask(const RegSize size) {
+    return size == RegSize_BYTE ? UINT8_MAX : UINT16_MAX;
+}
+
+static inline uint32_t size_sign_bit(const RegSize size) {
+    return size == RegSize_BYTE ? 0x80 : 0x8000;
+}
+
+// Results are computed 32 bits wide, so the carry (or borrow) out is the bit right above the operand size
+static inline bool set_carry(const RegSize size, const uint32_t result) {
+    return (result >> (size * 8)) & 1;
+}
+
+// Both operands have the same sign, and the result a different one
+static inline bool set_add_overflow(const RegSize size, const uint32_t l, const uint32_t r, const uint32_t result) {
+    return (l ^ result) & (r ^ result) & size_sign_bit(size);
+}
+
+// Operands have different signs, and the result the sign of r
+static inline bool set_sub_overflow(const RegSize size, const uint32_t l, const uint32_t r, const uint32_t result) {
+    return (l ^ r) & (l ^ result) & size_sign_bit(size);
+}
+
+// Carry into bit 4, same for additions and subtractions
+static inline bool set_aux_carry(const uint32_t l, const uint32_t r, const uint32_t result) {
+    return (l ^ r ^ result) & 0x10;
+}
+
+static inline bool set_sign(const RegSize size, const uint32_t result) {
+    return result & size_sign_bit(size);
+}
+
+static inline bool set_zero(const RegSize size, const uint32_t result) {
+    return !(result & size_mask(size));
+}
+
+// Even number of bits set in the low byte
+#define PARITY_2(n) n, n ^ 1, n ^ 1, n
+#define PARITY_4(n) PARITY_2(n), PARITY_2(n ^ 1), PARITY_2(n ^ 1), PARITY_2(n)
+#define PARITY_6(n) PARITY_4(n), PARITY_4(n ^ 1), PARITY_4(n ^ 1), PARITY_4(n)
+static const bool parityTable[UINT8_MAX + 1] = {
+    PARITY_6(1), PARITY_6(0), PARITY_6(0), PARITY_6(1),
+};
+#undef PARITY_2
+#undef PARITY_4
+#undef PARITY_6
+
+static inline bool set_parity(const uint32_t result) {
+    return parityTable[result & UINT8_MAX];
+}
+
+/* --------------------- LAZY FLAGS ----------------------- */
+
+static inline void Flags_record(Memory *memory, const LazyFlagsOp op, const RegSize size,
+                                const uint16_t l, const uint16_t r, const uint32_t result) {
+    LazyFlags *lazy = &memory->lazyFlags;
+    lazy->op = op;
+    lazy->size = size;
+    lazy->l = l;
+    lazy->r = r;
+    lazy->result = result;
+}
+
+static inline bool Flag_overflow(const Memory *memory) {
+    const LazyFlags *lazy = &memory->lazyFlags;
+    switch(lazy->op) {
+        case LazyFlagsOp_NONE:  return memory->flags.overflow;
+        case LazyFlagsOp_ADD:
+        case LazyFlagsOp_INC:   return set_add_overflow(lazy->size, lazy->l, lazy->r, lazy->result);
+        case LazyFlagsOp_SUB:
+        case LazyFlagsOp_DEC:   return set_sub_overflow(lazy->size, lazy->l, lazy->r, lazy->result);
+        case LazyFlagsOp_LOGIC: return false;
+        case LazyFlagsOp_SHIFT: return lazy->r;
+    }
+    return false;
+}
+
+static inline bool Flag_carry(const Memory *memory) {
+    const LazyFlags *lazy = &memory->lazyFlags;
+    switch(lazy->op) {
+        case LazyFlagsOp_NONE:
+        case LazyFlagsOp_INC:
+        case LazyFlagsOp_DEC:   return memory->flags.carry;
+        case LazyFlagsOp_ADD:
+        case LazyFlagsOp_SUB:   return set_carry(lazy->size, lazy->result);
+        case LazyFlagsOp_LOGIC: return false;
+        case LazyFlagsOp_SHIFT: return lazy->l;
+    }
+    return false;
+}
+
+static inline bool Flag_aux_carry(const Memory *memory) {
+    const LazyFlags *lazy = &memory->lazyFlags;
+    switch(lazy->op) {
+        case LazyFlagsOp_ADD:
+        case LazyFlagsOp_SUB:
+        case LazyFlagsOp_INC:
+        case LazyFlagsOp_DEC: return set_aux_carry(lazy->l, lazy->r, lazy->result);
+        default:              return memory->flags.auxCarry;
+    }
+}
+
+static inline bool Flag_sign(const Memory *memory) {
+    const LazyFlags *lazy = &memory->lazyFlags;
+    return lazy->op ? set_sign(lazy->size, lazy->result) : memory->flags.sign;
+}
+
+static inline bool Flag_zero(const Memory *memory) {
+    const LazyFlags *lazy = &memory->lazyFlags;
+    return lazy->op ? set_zero(lazy->size, lazy->result) : memory->flags.zero;
+}
+
+static inline bool Flag_parity(const Memory *memory) {
+    const LazyFlags *lazy = &memory->lazyFlags;
+    return lazy->op ? set_parity(lazy->result) : memory->flags.parity;
+}
+
+// Materializes every flag from the last recorded operation
+static inline void Flags_sync(Memory *memory) {
+    if(memory->lazyFlags.op == LazyFlagsOp_NONE) {
+        return;
+    }
+
+    Flags *flags = &memory->flags;
+    flags->overflow = Flag_overflow(memory);
+    flags->sign = Flag_sign(memory);
+    flags->zero = Flag_zero(memory);
+    flags->auxCarry = Flag_aux_carry(memory);
+    flags->parity = Flag_parity(memory);
+    flags->carry = Flag_carry(memory);
+    memory->lazyFlags.op = LazyFlagsOp_NONE;
+}
+
+/* -------------------- ARITHMETIC ------------------------ */
+
+// Operands are truncated to the opcode size first: byte immediates come sign extended to 16 bits
+static inline uint16_t Alu_add_carry(Memory *memory, const RegSize size, uint16_t l, uint16_t r, const bool carry) {
+    l &= size_mask(size);
+    r &= size_mask(size);
+    const uint32_t result = (uint32_t) l + r + carry;
+    Flags_record(memory, LazyFlagsOp_ADD, size, l, r, result);
+    return result;
+}
+
+static inline uint16_t Alu_sub_borrow(Memory *memory, const RegSize size, uint16_t l, uint16_t r, const bool borrow) {
+    l &= size_mask(size);
+    r &= size_mask(size);
+    const uint32_t result = (uint32_t) l - r - borrow;
+    Flags_record(memory, LazyFlagsOp_SUB, size, l, r, result);
+    return result;
+}
+
+static inline uint16_t Alu_add(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_add_carry(memory, size, l, r, false);
+}
+
+static inline uint16_t Alu_adc(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_add_carry(memory, size, l, r, Flag_carry(memory));
+}
+
+static inline uint16_t Alu_sub(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_sub_borrow(memory, size, l, r, false);
+}
+
+static inline uint16_t Alu_sbb(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_sub_borrow(memory, size, l, r, Flag_carry(memory));
+}
+
+static inline uint16_t Alu_neg(Memory *memory, const RegSize size, const uint16_t value) {
+    return Alu_sub(memory, size, 0, value);
+}
+
+static inline uint16_t Alu_inc(Memory *memory, const RegSize size, uint16_t value) {
+    // carry is kept, so it has to be taken from the operation being replaced
+    memory->flags.carry = Flag_carry(memory);
+    value &= size_mask(size);
+    const uint32_t result = (uint32_t) value + 1;
+    Flags_record(memory, LazyFlagsOp_INC, size, value, 1, result);
+    return result;
+}
+
+static inline uint16_t Alu_dec(Memory *memory, const RegSize size, uint16_t value) {
+    memory->flags.carry = Flag_carry(memory);
+    value &= size_mask(size);
+    const uint32_t result = (uint32_t) value - 1;
+    Flags_record(memory, LazyFlagsOp_DEC, size, value, 1, result);
+    return result;
+}
+
+static inline uint16_t Alu_logic_flags(Memory *memory, const RegSize size, const uint16_t result) {
+    // auxCarry is kept, so it has to be taken from the operation being replaced
+    memory->flags.auxCarry = Flag_aux_carry(memory);
+    Flags_record(memory, LazyFlagsOp_LOGIC, size, 0, 0, result);
+    return result;
+}
+
+static inline uint16_t Alu_and(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_logic_flags(memory, size, l & r);
+}
+
+static inline uint16_t Alu_or(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_logic_flags(memory, size, l | r);
+}
+
+static inline uint16_t Alu_xor(Memory *memory, const RegSize size, const uint16_t l, const uint16_t r) {
+    return Alu_logic_flags(memory, size, l ^ r);
+}
+
+/* ----------------- SHIFTS AND ROTATES ------------------- */
+
+/*
+ * The 8086 doesn't mask the count: every count past the operand size shifts everything out.
+ * A zero count changes nothing, flags included. Overflow is only defined for a count of 1,
+ * larger counts get the same formula.
+ */
+
+static inline uint16_t Alu_shift_flags(Memory *memory, const RegSize size, const uint32_t result,
+                                       const bool carry, const bool overflow) {
+    memory->flags.auxCarry = Flag_aux_carry(memory);
+    Flags_record(memory, LazyFlagsOp_SHIFT, size, carry, overflow, result & size_mask(size));
+    return result;
+}
+
+// Rotates only write carry and overflow
+static inline uint16_t Alu_rotate_flags(Memory *memory, const uint32_t result, const bool carry, const bool overflow) {
+    Flags_sync(memory);
+    memory->flags.carry = carry;
+    memory->flags.overflow = overflow;
+    return result;
+}
+
+// Xor of the two top bits, overflow of right rotates
+static inline bool set_rotate_right_overflow(const RegSize size, const uint32_t result) {
+    return set_sign(size, result) ^ set_sign(size, result << 1);
+}
+
+static inline uint16_t Alu_shl(Memory *memory, const RegSize size, uint16_t value, uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    count = count > bits + 1 ? bits + 1 : count;
+    value &= size_mask(size);
+
+    const uint32_t wide = (uint32_t) value << count;
+    const bool carry = set_carry(size, wide);
+    return Alu_shift_flags(memory, size, wide, carry, carry ^ set_sign(size, wide));
+}
+
+static inline uint16_t Alu_shr(Memory *memory, const RegSize size, uint16_t value, uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    count = count > bits + 1 ? bits + 1 : count;
+    value &= size_mask(size);
+
+    const bool carry = ((uint32_t) value >> (count - 1)) & 1;
+    return Alu_shift_flags(memory, size, (uint32_t) value >> count, carry, set_sign(size, value));
+}
+
+static inline uint16_t Alu_sar(Memory *memory, const RegSize size, const uint16_t value, uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    count = count > bits ? bits : count;
+
+    const int32_t signedValue = size == RegSize_BYTE ? (int8_t) value : (int16_t) value;
+    const bool carry = (signedValue >> (count - 1)) & 1;
+    return Alu_shift_flags(memory, size, (uint32_t) (signedValue >> count), carry, false);
+}
+
+static inline uint16_t Alu_rol(Memory *memory, const RegSize size, uint16_t value, const uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    const uint8_t n = count % bits;
+    value &= size_mask(size);
+
+    const uint32_t result = (((uint32_t) value << n) | (value >> (bits - n))) & size_mask(size);
+    return Alu_rotate_flags(memory, result, result & 1, (result & 1) ^ set_sign(size, result));
+}
+
+static inline uint16_t Alu_ror(Memory *memory, const RegSize size, uint16_t value, const uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    const uint8_t n = count % bits;
+    value &= size_mask(size);
+
+    const uint32_t result = ((value >> n) | ((uint32_t) value << (bits - n))) & size_mask(size);
+    return Alu_rotate_flags(memory, result, set_sign(size, result), set_rotate_right_overflow(size, result));
+}
+
+// Rotates through carry go around bits + 1 positions
+static inline uint16_t Alu_rcl(Memory *memory, const RegSize size, const uint16_t value, const uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    const uint8_t n = count % (bits + 1);
+    const uint32_t wideMask = (size_mask(size) << 1) | 1;
+    const uint32_t wide = ((uint32_t) Flag_carry(memory) << bits) | (value & size_mask(size));
+
+    const uint32_t result = ((wide << n) | (wide >> (bits + 1 - n))) & wideMask;
+    const bool carry = set_carry(size, result);
+    return Alu_rotate_flags(memory, result & size_mask(size), carry, carry ^ set_sign(size, result));
+}
+
+static inline uint16_t Alu_rcr(Memory *memory, const RegSize size, const uint16_t value, const uint8_t count) {
+    if(count == 0) return value;
+    const uint8_t bits = size * 8;
+    const uint8_t n = count % (bits + 1);
+    const uint32_t wideMask = (size_mask(size) << 1) | 1;
+    const uint32_t wide = ((uint32_t) Flag_carry(memory) << bits) | (value & size_mask(size));
+
+    const uint32_t result = ((wide >> n) | (wide << (bits + 1 - n))) & wideMask;
+    return Alu_rotate_flags(memory, result & size_mask(size), set_carry(size, result), set_rotate_right_overflow(size, result));
+}
+
+/* ----------------- MULTIPLY AND DIVIDE ------------------ */
+
+/*
+ * Operate on AL/AX and AX/DX:AX. Only carry and overflow are defined after a multiplication,
+ * the rest of the flags (and every flag after a division) are left as they were.
+ */
+
+static inline void Alu_mul_flags(Memory *memory, const bool high) {
+    Flags_sync(memory);
+    memory->flags.carry = high;
+    memory->flags.overflow = high;
+}
+
+// Carry and overflow tell whether the high half is significant
+static inline void Alu_mul(Memory *memory, const RegSize size, const uint16_t value) {
+    uint16_t *regs = memory->registers;
+    if(size == RegSize_BYTE) {
+        const uint16_t result = (regs[Register_AX] & UINT8_MAX) * (value & UINT8_MAX);
+        regs[Register_AX] = result;
+        Alu_mul_flags(memory, result >> 8);
+    } else {
+        const uint32_t result = (uint32_t) regs[Register_AX] * value;
+        regs[Register_AX] = result;
+        regs[Register_DX] = result >> 16;
+        Alu_mul_flags(memory, result >> 16);
+    }
+}
+
+// Carry and overflow tell whether the high half is more than the sign extension of the low one
+static inline void Alu_imul(Memory *memory, const RegSize size, const uint16_t value) {
+    uint16_t *regs = memory->registers;
+    if(size == RegSize_BYTE) {
+        const int16_t result = (int8_t) regs[Register_AX] * (int8_t) value;
+        regs[Register_AX] = result;
+        Alu_mul_flags(memory, result != (int8_t) result);
+    } else {
+        const int32_t result = (int32_t) (int16_t) regs[Register_AX] * (int16_t) value;
+        regs[Register_AX] = result;
+        regs[Register_DX] = (uint32_t) result >> 16;
+        Alu_mul_flags(memory, result != (int16_t) result);
+    }
+}
+
+// Quotient to AL/AX, remainder to AH/DX. Returns false on a divide error (zero divisor or quotient too big)
+static inline bool Alu_div(Memory *memory, const RegSize size, const uint16_t value) {
+    uint16_t *regs = memory->registers;
+    if(size == RegSize_BYTE) {
+        const uint16_t dividend = regs[Register_AX];
+        const uint8_t divisor = value;
+        if(divisor == 0 || dividend / divisor > UINT8_MAX) {
+            return false;
+        }
+        regs[Register_AX] = ((dividend % divisor) << 8) | (dividend / divisor);
+    } else {
+        const uint32_t dividend = ((uint32_t) regs[Register_DX] << 16) | regs[Register_AX];
+        if(value == 0 || dividend / value > UINT16_MAX) {
+            return false;
+        }
+        regs[Register_AX] = dividend / value;
+        regs[Register_DX] = dividend % value;
+    }
+    return true;
+}
+
+// Rounds toward zero, remainder takes the sign of the dividend. The 8086 faults on the most negative quotient too
+static inline bool Alu_idiv(Memory *memory, const RegSize size, const uint16_t value) {
+    uint16_t *regs = memory->registers;
+    if(size == RegSize_BYTE) {
+        const int32_t dividend = (int16_t) regs[Register_AX];
+        const int32_t divisor = (int8_t) value;
+        if(divisor == 0 || dividend / divisor > INT8_MAX || dividend / divisor < -INT8_MAX) {
+            return false;
+        }
+        regs[Register_AX] = ((uint8_t) (dividend % divisor) << 8) | (uint8_t) (dividend / divisor);
+    } else {
+        const int64_t dividend = (int32_t) (((uint32_t) regs[Register_DX] << 16) | regs[Register_AX]);
+        const int64_t divisor = (int16_t) value;
+        if(divisor == 0 || dividend / divisor > INT16_MAX || dividend / divisor < -INT16_MAX) {
+            return false;
+        }
+        regs[Register_AX] = (uint16_t) (dividend / divisor);
+        regs[Register_DX] = (uint16_t) (dividend % divisor);
+    }
+    return true;
+}
+
+/* ------------------ JUMP CONDITIONS --------------------- */
+
+static inline bool Cond_JE(Memory *memory)     { return Flag_zero(memory); }
+static inline bool Cond_JL(Memory *memory)     { return Flag_sign(memory) ^ Flag_overflow(memory); }
+static inline bool Cond_JLE(Memory *memory)    { return (Flag_sign(memory) ^ Flag_overflow(memory)) || Flag_zero(memory); }
+static inline bool Cond_JB(Memory *memory)     { return Flag_carry(memory); }
+static inline bool Cond_JBE(Memory *memory)    { return Flag_carry(memory) || Flag_zero(memory); }
+static inline bool Cond_JP(Memory *memory)     { return Flag_parity(memory); }
+static inline bool Cond_JO(Memory *memory)     { return Flag_overflow(memory); }
+static inline bool Cond_JS(Memory *memory)     { return Flag_sign(memory); }
+static inline bool Cond_JNE(Memory *memory)    { return !Cond_JE(memory); }
+static inline bool Cond_JNL(Memory *memory)    { return !Cond_JL(memory); }
+static inline bool Cond_JNLE(Memory *memory)   { return !Cond_JLE(memory); }
+static inline bool Cond_JNB(Memory *memory)    { return !Cond_JB(memory); }
+static inline bool Cond_JNBE(Memory *memory)   { return !Cond_JBE(memory); }
+static inline bool Cond_JNP(Memory *memory)    { return !Cond_JP(memory); }
+static inline bool Cond_JNO(Memory *memory)    { return !Cond_JO(memory); }
+static inline bool Cond_JNS(Memory *memory)    { return !Cond_JS(memory); }
+
+// Loop conditions decrement CX
+static inline bool Cond_LOOP(Memory *memory)   { return --memory->registers[Register_CX]; }
+static inline bool Cond_LOOPZ(Memory *memory)  { return --memory->registers[Register_CX] && Flag_zero(memory); }
+static inline bool Cond_LOOPNZ(Memory *memory) { return --memory->registers[Register_CX] && !Flag_zero(memory); }
+static inline bool Cond_JCXZ(Memory *memory)   { return !memory->registers[Register_CX]; }
+
+#endif //SIM86_ALU_H
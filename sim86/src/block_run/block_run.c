@@ -0,0 +1,570 @@
+#include "block_run.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alu/alu.h"
+#include "opcode_fetch/opcode_fetch.h"
+#include "opcode_run/opcode_run.h"
+#include "opcode_decompile/opcode_decompile.h"
+#include "jit/jit.h"
+
+#define TABLE_MASK (BLOCK_TABLE_SIZE - 1)
+
+static const uint16_t zeroTerm = 0;
+
+/* -------------------- HANDLERS --------------------------- */
+
+static inline uint16_t mem_addr(const BlockMemOperand *mem) {
+    return *mem->terms[0] + *mem->terms[1] + mem->displacement;
+}
+
+#define LOAD_R8(operand)  (*(operand)->reg8)
+#define LOAD_R16(operand) (*(operand)->reg16)
+#define LOAD_M8(operand)  Memory_read(memory, (operand)->mem.segment, mem_addr(&(operand)->mem), RegSize_BYTE)
+#define LOAD_M16(operand) Memory_read(memory, (operand)->mem.segment, mem_addr(&(operand)->mem), RegSize_WORD)
+#define LOAD_I(operand)   ((operand)->imm)
+
+#define STORE_R8(operand, data)  (*(operand)->reg8 = (uint8_t) (data))
+#define STORE_R16(operand, data) (*(operand)->reg16 = (data))
+#define STORE_M8(operand, data)  Memory_write(memory, (operand)->mem.segment, mem_addr(&(operand)->mem), RegSize_BYTE, data)
+#define STORE_M16(operand, data) Memory_write(memory, (operand)->mem.segment, mem_addr(&(operand)->mem), RegSize_WORD, data)
+
+// X(form, dstKind, srcKind, size)
+#define BLOCK_FORMS(X) \
+    X(R8_R8,   R8,  R8,  RegSize_BYTE) \
+    X(R8_M8,   R8,  M8,  RegSize_BYTE) \
+    X(M8_R8,   M8,  R8,  RegSize_BYTE) \
+    X(R8_I,    R8,  I,   RegSize_BYTE) \
+    X(M8_I,    M8,  I,   RegSize_BYTE) \
+    X(R16_R16, R16, R16, RegSize_WORD) \
+    X(R16_M16, R16, M16, RegSize_WORD) \
+    X(M16_R16, M16, R16, RegSize_WORD) \
+    X(R16_I,   R16, I,   RegSize_WORD) \
+    X(M16_I,   M16, I,   RegSize_WORD)
+
+typedef enum {
+    #define FORM_ENUM(form, ...) BlockForm_##form,
+    BLOCK_FORMS(FORM_ENUM)
+    #undef FORM_ENUM
+    BlockForm_COUNT,
+} BlockForm;
+
+#define MOV_HANDLER(form, dstKind, srcKind, size) \
+static void MOV_##form(const BlockInsn *insn, Memory *memory) { \
+    STORE_##dstKind(&insn->dst, LOAD_##srcKind(&insn->src)); \
+}
+
+#define ALU_HANDLER(name, alu, form, dstKind, srcKind, size) \
+static void name##_##form(const BlockInsn *insn, Memory *memory) { \
+    const uint16_t l = LOAD_##dstKind(&insn->dst); \
+    const uint16_t r = LOAD_##srcKind(&insn->src); \
+    STORE_##dstKind(&insn->dst, alu(memory, size, l, r)); \
+}
+
+#define CMP_HANDLER(form, dstKind, srcKind, size) \
+static void CMP_##form(const BlockInsn *insn, Memory *memory) { \
+    Alu_sub(memory, size, LOAD_##dstKind(&insn->dst), LOAD_##srcKind(&insn->src)); \
+}
+
+#define ADD_HANDLER(...) ALU_HANDLER(ADD, Alu_add, __VA_ARGS__)
+#define SUB_HANDLER(...) ALU_HANDLER(SUB, Alu_sub, __VA_ARGS__)
+#define AND_HANDLER(...) ALU_HANDLER(AND, Alu_and, __VA_ARGS__)
+#define OR_HANDLER(...)  ALU_HANDLER(OR,  Alu_or,  __VA_ARGS__)
+#define XOR_HANDLER(...) ALU_HANDLER(XOR, Alu_xor, __VA_ARGS__)
+#define ADC_HANDLER(...) ALU_HANDLER(ADC, Alu_adc, __VA_ARGS__)
+#define SBB_HANDLER(...) ALU_HANDLER(SBB, Alu_sbb, __VA_ARGS__)
+
+BLOCK_FORMS(MOV_HANDLER)
+BLOCK_FORMS(ADD_HANDLER)
+BLOCK_FORMS(SUB_HANDLER)
+BLOCK_FORMS(CMP_HANDLER)
+BLOCK_FORMS(AND_HANDLER)
+BLOCK_FORMS(OR_HANDLER)
+BLOCK_FORMS(XOR_HANDLER)
+BLOCK_FORMS(ADC_HANDLER)
+BLOCK_FORMS(SBB_HANDLER)
+
+#define JUMP_HANDLER(name) \
+static void JUMP_##name(const BlockInsn *insn, Memory *memory) { \
+    if(Cond_##name(memory)) memory->registers[Register_IP] = insn->jumpIp; \
+}
+
+JUMP_HANDLER(JE)
+JUMP_HANDLER(JL)
+JUMP_HANDLER(JLE)
+JUMP_HANDLER(JB)
+JUMP_HANDLER(JBE)
+JUMP_HANDLER(JP)
+JUMP_HANDLER(JO)
+JUMP_HANDLER(JS)
+JUMP_HANDLER(JNE)
+JUMP_HANDLER(JNL)
+JUMP_HANDLER(JNLE)
+JUMP_HANDLER(JNB)
+JUMP_HANDLER(JNBE)
+JUMP_HANDLER(JNP)
+JUMP_HANDLER(JNO)
+JUMP_HANDLER(JNS)
+JUMP_HANDLER(LOOP)
+JUMP_HANDLER(LOOPZ)
+JUMP_HANDLER(LOOPNZ)
+JUMP_HANDLER(JCXZ)
+
+static void JUMP_JMP(const BlockInsn *insn, Memory *memory) {
+    memory->registers[Register_IP] = insn->jumpIp;
+}
+
+// Opcodes without a specialized handler go through the interpreter
+static void GENERIC(const BlockInsn *insn, Memory *memory) {
+    Opcode_exec(insn->opcode, memory);
+}
+
+#define FORM_ENTRY(name, form) [BlockForm_##form] = name##_##form,
+#define MOV_ENTRY(form, ...) FORM_ENTRY(MOV, form)
+#define ADD_ENTRY(form, ...) FORM_ENTRY(ADD, form)
+#define SUB_ENTRY(form, ...) FORM_ENTRY(SUB, form)
+#define CMP_ENTRY(form, ...) FORM_ENTRY(CMP, form)
+#define AND_ENTRY(form, ...) FORM_ENTRY(AND, form)
+#define OR_ENTRY(form, ...)  FORM_ENTRY(OR,  form)
+#define XOR_ENTRY(form, ...) FORM_ENTRY(XOR, form)
+#define ADC_ENTRY(form, ...) FORM_ENTRY(ADC, form)
+#define SBB_ENTRY(form, ...) FORM_ENTRY(SBB, form)
+
+static const BlockHandler formHandlers[OpcodeType_COUNT][BlockForm_COUNT] = {
+    [OpcodeType_MOV] = {BLOCK_FORMS(MOV_ENTRY)},
+    [OpcodeType_ADD] = {BLOCK_FORMS(ADD_ENTRY)},
+    [OpcodeType_SUB] = {BLOCK_FORMS(SUB_ENTRY)},
+    [OpcodeType_CMP] = {BLOCK_FORMS(CMP_ENTRY)},
+    [OpcodeType_AND] = {BLOCK_FORMS(AND_ENTRY)},
+    [OpcodeType_OR]  = {BLOCK_FORMS(OR_ENTRY)},
+    [OpcodeType_XOR] = {BLOCK_FORMS(XOR_ENTRY)},
+    [OpcodeType_ADC] = {BLOCK_FORMS(ADC_ENTRY)},
+    [OpcodeType_SBB] = {BLOCK_FORMS(SBB_ENTRY)},
+};
+
+static const BlockHandler jumpHandlers[OpcodeType_COUNT] = {
+    #define JUMP_ENTRY(name) [OpcodeType_##name] = JUMP_##name,
+    JUMP_ENTRY(JE)
+    JUMP_ENTRY(JL)
+    JUMP_ENTRY(JLE)
+    JUMP_ENTRY(JB)
+    JUMP_ENTRY(JBE)
+    JUMP_ENTRY(JP)
+    JUMP_ENTRY(JO)
+    JUMP_ENTRY(JS)
+    JUMP_ENTRY(JNE)
+    JUMP_ENTRY(JNL)
+    JUMP_ENTRY(JNLE)
+    JUMP_ENTRY(JNB)
+    JUMP_ENTRY(JNBE)
+    JUMP_ENTRY(JNP)
+    JUMP_ENTRY(JNO)
+    JUMP_ENTRY(JNS)
+    JUMP_ENTRY(LOOP)
+    JUMP_ENTRY(LOOPZ)
+    JUMP_ENTRY(LOOPNZ)
+    JUMP_ENTRY(JCXZ)
+    JUMP_ENTRY(JMP)
+    #undef JUMP_ENTRY
+};
+
+/* -------------------- TRANSLATION ------------------------ */
+
+static bool resolve_operand(BlockOperand *operand, BlockOperandKind *kind, const OpcodeArg *arg, Memory *memory) {
+    switch(arg->type) {
+        case OpcodeArgType_REGISTER: {
+            const OpcodeRegAccess *reg = &arg->reg;
+            if(reg->size == RegSize_WORD) {
+                operand->reg16 = &memory->registers[reg->reg];
+            } else {
+                operand->reg8 = ((uint8_t *) &memory->registers[reg->reg]) + (reg->offset - 1);
+            }
+            *kind = BlockOperandKind_REGISTER;
+        } return true;
+        case OpcodeArgType_MEMORY: {
+            const OpcodeMemAccess *mem = &arg->mem;
+            for(int i = 0; i < 2; ++i) {
+                operand->mem.terms[i] = mem->terms[i].present ? &memory->registers[mem->terms[i].reg.reg] : &zeroTerm;
+            }
+            operand->mem.displacement = mem->displacement;
+            operand->mem.segment = mem->segment;
+            *kind = BlockOperandKind_MEMORY;
+        } return true;
+        case OpcodeArgType_IMMEDIATE: {
+            operand->imm = arg->imm.value;
+            *kind = BlockOperandKind_IMMEDIATE;
+        } return true;
+        case OpcodeArgType_NONE:
+        case OpcodeArgType_IPINC: return false;
+    }
+    return false;
+}
+
+static BlockForm resolve_form(const BlockOperandKind dstKind, const BlockOperandKind srcKind, const RegSize size) {
+    #define KINDS(dst, src) ((BlockOperandKind_##dst << 4) | BlockOperandKind_##src)
+
+    const bool word = size == RegSize_WORD;
+    switch((dstKind << 4) | srcKind) {
+        case KINDS(REGISTER, REGISTER):  return word ? BlockForm_R16_R16 : BlockForm_R8_R8;
+        case KINDS(REGISTER, MEMORY):    return word ? BlockForm_R16_M16 : BlockForm_R8_M8;
+        case KINDS(MEMORY, REGISTER):    return word ? BlockForm_M16_R16 : BlockForm_M8_R8;
+        case KINDS(REGISTER, IMMEDIATE): return word ? BlockForm_R16_I : BlockForm_R8_I;
+        case KINDS(MEMORY, IMMEDIATE):   return word ? BlockForm_M16_I : BlockForm_M8_I;
+        default: return BlockForm_COUNT;
+    }
+
+    #undef KINDS
+}
+
+static void translate_opcode(BlockInsn *insn, const Opcode *opcode, const uint16_t ip, Memory *memory) {
+    memset(insn, 0, sizeof(*insn));
+    insn->opcode = opcode;
+    insn->nextIp = ip + opcode->len;
+    insn->run = GENERIC;
+    insn->writesMemory = true;
+
+    if(opcode->dst.type == OpcodeArgType_IPINC) {
+        insn->jumpIp = insn->nextIp + opcode->dst.ipinc.value;
+        insn->writesMemory = false;
+        if(jumpHandlers[opcode->type]) {
+            insn->run = jumpHandlers[opcode->type];
+        }
+        return;
+    }
+
+    BlockInsn resolved = *insn;
+    if(!resolve_operand(&resolved.dst, &resolved.dstKind, &opcode->dst, memory)) return;
+    if(!resolve_operand(&resolved.src, &resolved.srcKind, &opcode->src, memory)) return;
+    resolved.size = OpcodeArg_size(&opcode->dst);
+
+    const BlockForm form = resolve_form(resolved.dstKind, resolved.srcKind, resolved.size);
+    if(form == BlockForm_COUNT || formHandlers[opcode->type][form] == NULL) {
+        return;
+    }
+
+    *insn = resolved;
+    insn->run = formHandlers[opcode->type][form];
+    insn->writesMemory = insn->dstKind == BlockOperandKind_MEMORY;
+}
+
+// Returns NULL if out of memory
+static Block *translate_block(BlockEngine *engine, const uint16_t ip) {
+    Memory *memory = engine->memory;
+
+    Opcode opcodes[BLOCK_MAX_LEN];
+    uint16_t len = 0;
+    uint16_t curr = ip;
+
+    const CfgBlock *cfgBlock = engine->cfg && memory->registers[Register_CS] == engine->cfgCs
+            ? Cfg_block_at(engine->cfg, ip)
+            : NULL;
+    if(cfgBlock) {
+        // Already decoded, and split at every branch target so jumps never land mid block
+        const Disasm *disasm = engine->cfg->disasm;
+        len = cfgBlock->count < BLOCK_MAX_LEN ? cfgBlock->count : BLOCK_MAX_LEN;
+        memcpy(opcodes, &disasm->opcodes[cfgBlock->first], len * sizeof(*opcodes));
+        for(uint16_t i = 0; i < len; ++i) {
+            curr = disasm->ips[cfgBlock->first + i];
+            OpcodeCache_put(memory->opcodeCache, (uint32_t) (Memory_addr_ptr(memory, Register_CS, curr) - memory->ram), &opcodes[i]);
+        }
+    }
+
+    while(!cfgBlock && len < BLOCK_MAX_LEN) {
+        if(len && Memory_addr_ptr(memory, Register_CS, curr) == memory->codeEnd) {
+            break; // The run ends here, don't decode what follows the program
+        }
+
+        Opcode *opcode = &opcodes[len];
+        if(Opcode_decode_at(opcode, memory, curr) != OpcodeDecodeErr_OK) {
+            break; // Code ended or invalid opcode, reported when (if) it is actually run
+        }
+
+        // Register it so writes to this code are detected
+        OpcodeCache_put(memory->opcodeCache, (uint32_t) (Memory_addr_ptr(memory, Register_CS, curr) - memory->ram), opcode);
+
+        curr += opcode->len;
+        len++;
+        if(Opcode_transfers_control(opcode)) {
+            break;
+        }
+    }
+
+    Block *block = malloc(sizeof(*block) + len * sizeof(*block->insns));
+    Opcode *blockOpcodes = malloc((len ? len : 1) * sizeof(*blockOpcodes));
+    if(block == NULL || blockOpcodes == NULL) {
+        free(block);
+        free(blockOpcodes);
+        return NULL;
+    }
+
+    block->addr = (uint32_t) (Memory_addr_ptr(memory, Register_CS, ip) - memory->ram);
+    block->ip = ip;
+    block->len = len;
+    block->opcodes = blockOpcodes;
+    block->next[0] = block->next[1] = NULL;
+    block->collision = NULL;
+    memset(block->targets, 0, sizeof(block->targets));
+    block->nextTarget = 0;
+    block->entries = 0;
+    block->native = NULL;
+    block->nativeFailed = false;
+
+    memcpy(blockOpcodes, opcodes, len * sizeof(*blockOpcodes));
+    uint16_t insnIp = ip;
+    for(uint16_t i = 0; i < len; ++i) {
+        translate_opcode(&block->insns[i], &blockOpcodes[i], insnIp, memory);
+        insnIp = block->insns[i].nextIp;
+    }
+
+    block->exitIp[0] = insnIp;
+    block->exitIp[1] = len ? block->insns[len - 1].jumpIp : insnIp;
+
+    // Track it
+    if(engine->blockCount == engine->blockCap) {
+        const size_t cap = engine->blockCap ? 2 * engine->blockCap : 64;
+        Block **blocks = realloc(engine->blocks, cap * sizeof(*blocks));
+        if(blocks == NULL) {
+            free(blockOpcodes);
+            free(block);
+            return NULL;
+        }
+        engine->blocks = blocks;
+        engine->blockCap = cap;
+    }
+    engine->blocks[engine->blockCount++] = block;
+    block->collision = engine->table[block->addr & TABLE_MASK];
+    engine->table[block->addr & TABLE_MASK] = block;
+    engine->blocksTranslated++;
+
+    return block;
+}
+
+static void flush_blocks(BlockEngine *engine) {
+    for(size_t i = 0; i < engine->blockCount; ++i) {
+        free(engine->blocks[i]->opcodes);
+        free(engine->blocks[i]);
+    }
+    engine->blockCount = 0;
+    memset(engine->table, 0, sizeof(engine->table));
+
+    if(engine->jit) {
+        Jit_reset(engine->jit);
+    }
+}
+
+void BlockEngine_use_cfg(BlockEngine *engine, const Cfg *cfg) {
+    Memory *memory = engine->memory;
+    engine->cfg = cfg;
+    engine->cfgCs = memory->registers[Register_CS];
+
+    // Any write to the swept code, translated or not yet, makes the graph stale
+    if(cfg->count) {
+        const uint32_t addr = (uint32_t) (Memory_addr_ptr(memory, Register_CS, cfg->blocks[0].ip) - memory->ram);
+        OpcodeCache_watch(memory->opcodeCache, addr, cfg->span);
+    }
+}
+
+/* ---------------------- ENGINE --------------------------- */
+
+BlockEngine *BlockEngine_create(Memory *memory) {
+    if(memory->opcodeCache == NULL) {
+        return NULL;
+    }
+
+    BlockEngine *engine = calloc(1, sizeof(*engine));
+    if(engine == NULL) {
+        return NULL;
+    }
+
+    engine->memory = memory;
+    engine->generation = memory->opcodeCache->generation;
+    return engine;
+}
+
+void BlockEngine_destroy(BlockEngine *engine) {
+    if(engine == NULL) {
+        return;
+    }
+
+    flush_blocks(engine);
+    Jit_destroy(engine->jit);
+    free(engine->blocks);
+    free(engine);
+}
+
+bool BlockEngine_enable_jit(BlockEngine *engine, const uint32_t threshold) {
+    if(engine->jit == NULL) {
+        engine->jit = Jit_create(JIT_DEFAULT_SIZE);
+    }
+    engine->jitThreshold = threshold ? threshold : 1;
+    return engine->jit != NULL;
+}
+
+static Block *find_block(BlockEngine *engine, const uint16_t ip) {
+    Memory *memory = engine->memory;
+    const uint32_t addr = Memory_code_addr(memory);
+
+    // Colliding blocks stay chained, code alternating between them must not translate them again
+    for(Block *block = engine->table[addr & TABLE_MASK]; block; block = block->collision) {
+        if(block->addr == addr && block->ip == ip) {
+            return block;
+        }
+    }
+
+    return translate_block(engine, ip);
+}
+
+/*
+ * Successor of a block left through neither of its static exits: returns, jumps through registers or
+ * memory (switch tables) and far jumps. The last few targets of each block are remembered, so they skip
+ * the lookup table and the walk of its collisions.
+ */
+static Block *predict_target(BlockEngine *engine, Block *from) {
+    Memory *memory = engine->memory;
+    const uint32_t addr = Memory_code_addr(memory);
+    const uint16_t ip = memory->registers[Register_IP];
+
+    for(uint8_t i = 0; i < BLOCK_TARGET_WAYS; ++i) {
+        Block *target = from->targets[i];
+        if(target && target->addr == addr && target->ip == ip) {
+            engine->targetHits++;
+            return target;
+        }
+    }
+
+    engine->targetMisses++;
+    if(Memory_code_ended(memory)) {
+        return NULL;
+    }
+    Block *target = find_block(engine, ip);
+    from->targets[from->nextTarget++ % BLOCK_TARGET_WAYS] = target; // Replaces the oldest
+    return target;
+}
+
+// Runs the block opcodes back to back. Returns the number of opcodes run
+static uint16_t run_block(BlockEngine *engine, const Block *block, FILE *trace) {
+    Memory *memory = engine->memory;
+    const OpcodeCache *cache = memory->opcodeCache;
+
+    for(uint16_t i = 0; i < block->len; ++i) {
+        const BlockInsn *insn = &block->insns[i];
+
+        if(trace) {
+            Opcode_decompile_to_file(insn->opcode, trace);
+            fputs(" ;", trace);
+
+            OpcodeTraceState traceState;
+            OpcodeTrace_begin(&traceState, memory);
+            memory->registers[Register_IP] = insn->nextIp;
+            insn->run(insn, memory);
+            OpcodeTrace_end(&traceState, memory, trace);
+
+            fputc('\n', trace);
+        } else {
+            memory->registers[Register_IP] = insn->nextIp;
+            insn->run(insn, memory);
+        }
+
+        if(insn->writesMemory && (cache->generation != engine->generation || memory->halted)) {
+            return i + 1; // Translated code may be stale, or a generic opcode faulted
+        }
+    }
+
+    return block->len;
+}
+
+// Code was written: drops every translation, and the graph which may no longer match
+static void flush_written(BlockEngine *engine) {
+    flush_blocks(engine);
+    engine->cfg = NULL;
+    engine->generation = engine->memory->opcodeCache->generation;
+    engine->flushes++;
+}
+
+// Whether a limit could be reached inside the block, which must then run one opcode at a time
+static bool crosses_limit(const Block *block, const RunLimits *limits, const uint64_t opcodes) {
+    const uint16_t span = block->exitIp[0] - block->ip;
+    return limits->maxInstructions - opcodes < block->len
+           || (limits->untilIp != RUN_NO_IP && (uint16_t) (limits->untilIp - block->ip) < span);
+}
+
+uint64_t BlockEngine_run(BlockEngine *engine, const RunLimits *limits, FILE *trace, RunStop *stop) {
+    Memory *memory = engine->memory;
+    const OpcodeCache *cache = memory->opcodeCache;
+    uint64_t opcodes = 0;
+
+    // Written between runs (ex: restored from a snapshot or reloaded)
+    if(cache->generation != engine->generation) {
+        flush_written(engine);
+    }
+
+    Block *block = NULL;
+    while(!(*stop = RunLimits_check(limits, memory, opcodes, 0))) {
+        const uint16_t ip = memory->registers[Register_IP];
+        if(block == NULL && (block = find_block(engine, ip)) == NULL) {
+            Memory_fault(memory, ip, "Out of memory for blocks");
+            continue;
+        }
+
+        if(block->len == 0 || crosses_limit(block, limits, opcodes)) {
+            // Not decodable here, let the interpreter report it. Or close to a limit, single step up to it
+            Opcode scratch;
+            const Opcode *opcode = Opcode_fetch(&scratch, memory);
+            if(opcode == NULL) continue; // Not decodable, it halted
+            if(trace) {
+                Opcode_decompile_to_file(opcode, trace);
+                fputs(" ;", trace);
+            }
+            Opcode_run(opcode, memory, trace);
+            if(trace) {
+                fputc('\n', trace);
+            }
+            opcodes++;
+            block = NULL;
+            continue;
+        }
+
+        engine->blocksEntered++;
+        const uint16_t cs = memory->registers[Register_CS];
+
+        // Native code does not trace, so tracing always stays interpreted
+        if(engine->jit && !trace && !block->native && !block->nativeFailed
+           && ++block->entries >= engine->jitThreshold) {
+            block->native = Jit_compile(engine->jit, block, memory, &engine->generation);
+            block->nativeFailed = block->native == NULL;
+        }
+
+        if(block->native && !trace) {
+            Flags_sync(memory);
+            opcodes += block->native(memory);
+            engine->nativeRuns++;
+        } else {
+            opcodes += run_block(engine, block, trace);
+        }
+
+        if(cache->generation != engine->generation) {
+            flush_written(engine);
+            block = NULL;
+            continue;
+        }
+
+        // Chain into the successor block. Exits are IPs in the same code segment
+        const uint16_t nextIp = memory->registers[Register_IP];
+        const int exit = memory->registers[Register_CS] != cs ? -1
+                : nextIp == block->exitIp[0] ? 0 : nextIp == block->exitIp[1] ? 1 : -1;
+        if(exit < 0) {
+            block = predict_target(engine, block);
+        } else if(block->next[exit]) {
+            block = block->next[exit];
+        } else if(!Memory_code_ended(memory)) {
+            Block *next = find_block(engine, nextIp);
+            block->next[exit] = next;
+            block = next;
+        }
+    }
+
+    return opcodes;
+}
+
+#undef TABLE_MASK
@@ -0,0 +1,106 @@
+#ifndef SIM86_BLOCK_RUN_H
+#define SIM86_BLOCK_RUN_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memory/memory.h"
+#include "cfg/cfg.h"
+#include "opcode_run/opcode_run.h"
+
+#define BLOCK_MAX_LEN 64        // Opcodes per block
+#define BLOCK_TABLE_SIZE 4096   // Block lookup entries, must be a power of 2
+#define BLOCK_TARGET_WAYS 4     // Indirect targets remembered per block
+
+typedef struct BlockInsn BlockInsn;
+typedef void (*BlockHandler)(const BlockInsn *insn, Memory *memory);
+
+typedef struct {
+    const uint16_t *terms[2]; // Point to a zero word when the term is not present
+    int16_t displacement;
+    Register segment;
+} BlockMemOperand;
+
+typedef union {
+    uint16_t *reg16;
+    uint8_t *reg8;
+    BlockMemOperand mem;
+    uint16_t imm;
+} BlockOperand;
+
+typedef enum {
+    BlockOperandKind_NONE = 0,
+    BlockOperandKind_REGISTER,
+    BlockOperandKind_MEMORY,
+    BlockOperandKind_IMMEDIATE,
+} BlockOperandKind;
+
+struct BlockInsn {
+    BlockHandler run;
+    BlockOperand dst, src;
+    BlockOperandKind dstKind, srcKind;
+    RegSize size;
+    uint16_t nextIp;        // IP after the opcode
+    uint16_t jumpIp;        // IP if the branch is taken
+    bool writesMemory;      // Code may have been modified after running it
+    const Opcode *opcode;   // Source opcode, for tracing and generic execution
+};
+
+// Native translation of a block. Returns the number of opcodes run
+typedef uint16_t (*BlockNativeFn)(Memory *memory);
+
+typedef struct Block Block;
+struct Block {
+    uint32_t addr;          // Linear address of the first opcode
+    uint16_t ip;
+    uint16_t len;           // Number of opcodes
+    uint16_t exitIp[2];     // Fallthrough and branch taken IPs
+    Block *next[2];         // Chained successor for each exit, once known
+    Block *collision;       // Next block in the same lookup table entry
+    Block *targets[BLOCK_TARGET_WAYS]; // Last successors reached any other way (indirect and far jumps, returns)
+    uint8_t nextTarget;     // Next way to replace
+    uint32_t entries;       // Times entered while interpreted
+    BlockNativeFn native;   // JIT compiled version, if hot
+    bool nativeFailed;      // JIT could not compile it, don't retry
+    Opcode *opcodes;
+    BlockInsn insns[];
+};
+
+typedef struct Jit Jit;
+
+/*
+ * Basic block execution engine. Code is split into blocks ending at control transfers,
+ * and each block is translated once into an array of specialized handlers with their
+ * operands already resolved. Blocks are bound to the memory they were created for,
+ * which must have an opcode cache so writes to translated code can be detected.
+ */
+typedef struct {
+    Memory *memory;
+    Block *table[BLOCK_TABLE_SIZE]; // Indexed by linear address of the block first opcode, collisions chained
+    Block **blocks;                 // Every live block, owned by the engine
+    size_t blockCount, blockCap;
+    uint64_t generation;            // Opcode cache generation the blocks were translated at
+    Jit *jit;                       // Optional native tier
+    uint32_t jitThreshold;          // Entries before a block is compiled
+    const Cfg *cfg;                 // Precomputed block boundaries, dropped once code is written
+    uint16_t cfgCs;                 // Code segment the graph was built for
+    uint64_t blocksEntered, blocksTranslated, flushes, nativeRuns;
+    uint64_t targetHits, targetMisses; // Indirect exits found in, or added to, the block target ways
+} BlockEngine;
+
+BlockEngine *BlockEngine_create(Memory *memory);
+
+void BlockEngine_destroy(BlockEngine *engine);
+
+// Compiles blocks to native code once entered threshold times. Returns false if not supported
+bool BlockEngine_enable_jit(BlockEngine *engine, uint32_t threshold);
+
+// Splits blocks on the graph boundaries and takes their opcodes from its disassembly instead of
+// decoding them. The graph must outlive the engine
+void BlockEngine_use_cfg(BlockEngine *engine, const Cfg *cfg);
+
+// Runs until code ends or a limit is reached, tracing every opcode if trace is set. Limits are checked
+// between blocks, blocks they could stop in run one opcode at a time. Returns the number of opcodes run
+uint64_t BlockEngine_run(BlockEngine *engine, const RunLimits *limits, FILE *trace, RunStop *stop);
+
+#endif //SIM86_BLOCK_RUN_H
@@ -0,0 +1,195 @@
+#include "cfg.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool Opcode_is_branch(const Opcode *opcode) {
+    return opcode->dst.type == OpcodeArgType_IPINC;
+}
+
+static uint16_t branch_target(const Opcode *opcode, const uint16_t ip) {
+    return ip + opcode->len + opcode->dst.ipinc.value;
+}
+
+// Index into blockAt, or span if ip is outside the swept code
+static uint32_t span_offset(const Cfg *cfg, const uint16_t ip) {
+    const uint32_t offset = (uint16_t) (ip - cfg->disasm->ips[0]);
+    return offset < cfg->span ? offset : cfg->span;
+}
+
+bool Cfg_build(Cfg *cfg, const Disasm *disasm) {
+    *cfg = (Cfg) {.disasm = disasm};
+    const size_t count = disasm->count;
+    if(count == 0) {
+        return true;
+    }
+
+    const uint16_t startIp = disasm->ips[0];
+    cfg->span = (uint32_t) disasm->ips[count - 1] + disasm->opcodes[count - 1].len - startIp;
+
+    // Opcode starting at each IP, then the block starting there once they are known
+    cfg->blockAt = malloc(cfg->span * sizeof(*cfg->blockAt));
+    uint8_t *leader = calloc(count, sizeof(*leader)); // Bit 0: starts a block, bit 1: branch target
+    if(cfg->blockAt == NULL || leader == NULL) {
+        free(leader);
+        Cfg_destroy(cfg);
+        return false;
+    }
+    memset(cfg->blockAt, 0xFF, cfg->span * sizeof(*cfg->blockAt));
+    for(size_t i = 0; i < count; ++i) {
+        cfg->blockAt[disasm->ips[i] - startIp] = i;
+    }
+
+    size_t blockCount = 1;
+    leader[0] = 1;
+    for(size_t i = 0; i < count; ++i) {
+        const Opcode *opcode = &disasm->opcodes[i];
+        if(!Opcode_transfers_control(opcode)) {
+            continue;
+        }
+
+        const uint32_t offset = Opcode_is_branch(opcode)
+                ? span_offset(cfg, branch_target(opcode, disasm->ips[i]))
+                : cfg->span;
+        if(offset < cfg->span && cfg->blockAt[offset] != CFG_NO_BLOCK) {
+            uint8_t *mark = &leader[cfg->blockAt[offset]];
+            blockCount += !(*mark & 1);
+            *mark |= 3;
+        }
+        if(i + 1 < count) {
+            blockCount += !(leader[i + 1] & 1);
+            leader[i + 1] |= 1;
+        }
+    }
+
+    cfg->blocks = malloc(blockCount * sizeof(*cfg->blocks));
+    if(cfg->blocks == NULL) {
+        free(leader);
+        Cfg_destroy(cfg);
+        return false;
+    }
+
+    // Split, replacing opcode indices with block indices
+    CfgBlock *block = NULL;
+    for(size_t i = 0; i < count; ++i) {
+        const uint32_t offset = disasm->ips[i] - startIp;
+        if(leader[i] & 1) {
+            block = &cfg->blocks[cfg->count];
+            *block = (CfgBlock) {
+                .ip = disasm->ips[i],
+                .first = i,
+                .next = {CFG_NO_BLOCK, CFG_NO_BLOCK},
+                .target = leader[i] & 2,
+            };
+            cfg->blockAt[offset] = cfg->count++;
+        } else {
+            cfg->blockAt[offset] = CFG_NO_BLOCK;
+        }
+        block->count++;
+        block->endIp = disasm->ips[i] + disasm->opcodes[i].len;
+    }
+    free(leader);
+
+    // Link successors. Calls come back after the callee returns, jumps and returns don't fall through
+    for(size_t b = 0; b < cfg->count; ++b) {
+        block = &cfg->blocks[b];
+        const uint32_t last = block->first + block->count - 1;
+        const Opcode *opcode = &disasm->opcodes[last];
+        if(b + 1 < cfg->count && Opcode_falls_through(opcode)) {
+            block->next[0] = b + 1;
+        }
+
+        if(Opcode_is_branch(opcode)) {
+            const uint32_t offset = span_offset(cfg, branch_target(opcode, disasm->ips[last]));
+            block->next[1] = offset < cfg->span ? cfg->blockAt[offset] : CFG_NO_BLOCK;
+        }
+    }
+
+    return true;
+}
+
+const CfgBlock *Cfg_block_at(const Cfg *cfg, const uint16_t ip) {
+    if(cfg->count == 0) {
+        return NULL;
+    }
+
+    const uint32_t offset = span_offset(cfg, ip);
+    if(offset == cfg->span || cfg->blockAt[offset] == CFG_NO_BLOCK) {
+        return NULL;
+    }
+    return &cfg->blocks[cfg->blockAt[offset]];
+}
+
+size_t Cfg_format_bound(const Cfg *cfg) {
+    return cfg->count * (CFG_LABEL_LEN + 1) + Disasm_format_bound(cfg->disasm->count);
+}
+
+static char *append_label(char *dst, const uint16_t ip) {
+    static const char hex[] = "0123456789abcdef";
+
+    memcpy(dst, "label_", 6);
+    dst += 6;
+    for(int shift = 12; shift >= 0; shift -= 4) {
+        *dst++ = hex[(ip >> shift) & 0xF];
+    }
+    return dst;
+}
+
+size_t Cfg_format(const Cfg *cfg, char *dst) {
+    const Disasm *disasm = cfg->disasm;
+    char *start = dst;
+
+    for(size_t b = 0; b < cfg->count; ++b) {
+        const CfgBlock *block = &cfg->blocks[b];
+        if(block->target) {
+            dst = append_label(dst, block->ip);
+            *dst++ = ':';
+            *dst++ = '\n';
+        }
+
+        // Only the last opcode may be a branch
+        const size_t last = block->first + block->count - 1;
+        dst += Disasm_format(disasm, block->first, last, dst);
+
+        const Opcode *opcode = &disasm->opcodes[last];
+        const CfgBlock *target = Opcode_is_branch(opcode) && block->next[1] != CFG_NO_BLOCK
+                ? &cfg->blocks[block->next[1]]
+                : NULL;
+        if(target) {
+            dst += OpcodeType_decompile(opcode->type, dst);
+            if(opcode->type == OpcodeType_JMP && opcode->dst.ipinc.size == RegSize_WORD) {
+                memcpy(dst, " near", 5); // Keeps its length when the label is in short range
+                dst += 5;
+            }
+            *dst++ = ' ';
+            dst = append_label(dst, target->ip);
+            *dst++ = '\n';
+            *dst = 0;
+        } else {
+            dst += Disasm_format(disasm, last, last + 1, dst);
+        }
+    }
+
+    return dst - start;
+}
+
+bool Cfg_write(const Cfg *cfg, FILE *out) {
+    const size_t headerLen = sizeof(DISASM_HEADER) - 1;
+    char *buf = malloc(headerLen + Cfg_format_bound(cfg));
+    if(buf == NULL) {
+        return false;
+    }
+
+    memcpy(buf, DISASM_HEADER, headerLen);
+    const size_t len = headerLen + Cfg_format(cfg, buf + headerLen);
+
+    const bool ok = fwrite(buf, 1, len, out) == len;
+    free(buf);
+    return ok;
+}
+
+void Cfg_destroy(Cfg *cfg) {
+    free(cfg->blocks);
+    free(cfg->blockAt);
+    *cfg = (Cfg) {0};
+}
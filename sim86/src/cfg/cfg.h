@@ -0,0 +1,55 @@
+#ifndef SIM86_CFG_H
+#define SIM86_CFG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "disasm/disasm.h"
+
+#define CFG_NO_BLOCK UINT32_MAX
+#define CFG_LABEL_LEN 11 // `label_XXXX:`
+
+typedef struct {
+    uint16_t ip;            // First opcode
+    uint16_t endIp;         // IP after the last opcode
+    uint32_t first;         // Index of the first opcode in the disassembly
+    uint32_t count;         // Number of opcodes
+    uint32_t next[2];       // Fallthrough (return point of calls) and branch taken blocks, CFG_NO_BLOCK if none or outside the code
+    bool target;            // Some branch jumps to it, so it gets a label
+} CfgBlock;
+
+/*
+ * Control flow graph of a linear sweep disassembly. Blocks start at the first opcode, at every
+ * relative branch, jump or call target that lands on an opcode boundary and after every transfer
+ * of control. Built in linear time.
+ * Branches to the middle of an opcode or outside the code don't start a block. Indirect and far
+ * targets are only known when run.
+ */
+typedef struct {
+    const Disasm *disasm;   // Not owned, must outlive the graph
+    CfgBlock *blocks;       // In IP order
+    size_t count;
+    uint32_t *blockAt;      // Block starting at each IP of the swept range, CFG_NO_BLOCK if none
+    uint32_t span;          // Bytes of code swept
+} Cfg;
+
+// Returns false if out of memory
+bool Cfg_build(Cfg *cfg, const Disasm *disasm);
+
+// Block starting at ip, or NULL
+const CfgBlock *Cfg_block_at(const Cfg *cfg, uint16_t ip);
+
+// Upper bound of the bytes Cfg_format writes
+size_t Cfg_format_bound(const Cfg *cfg);
+
+// Formats the listing with a `label_XXXX:` line before every branch target, which branches then refer to.
+// Returns bytes written
+size_t Cfg_format(const Cfg *cfg, char *dst);
+
+// Writes the labeled listing, header included, with a single write. Returns false on error
+bool Cfg_write(const Cfg *cfg, FILE *out);
+
+void Cfg_destroy(Cfg *cfg);
+
+#endif //SIM86_CFG_H
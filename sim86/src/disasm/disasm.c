@@ -0,0 +1,243 @@
+#include "disasm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "opcode_fetch/opcode_fetch.h"
+#include "opcode_encoding_table/opcode_encoding_table.h"
+
+#define DISASM_INIT_CAP 1024
+
+static bool reserve(Disasm *disasm, const size_t cap) {
+    if(cap <= disasm->cap) {
+        return true;
+    }
+
+    Opcode *opcodes = realloc(disasm->opcodes, cap * sizeof(*opcodes));
+    if(opcodes == NULL) {
+        return false;
+    }
+    disasm->opcodes = opcodes;
+
+    uint16_t *ips = realloc(disasm->ips, cap * sizeof(*ips));
+    if(ips == NULL) {
+        return false;
+    }
+    disasm->ips = ips;
+
+    disasm->cap = cap;
+    return true;
+}
+
+// Sweeps from startIp while the IP is below stopIp, so the last opcode may end past it
+static bool decode_range(Disasm *disasm, const Memory *memory, const uint16_t startIp, const uint32_t stopIp) {
+    disasm->count = 0;
+    disasm->err = OpcodeDecodeErr_OK;
+
+    // Every opcode is at least a byte long
+    const uint8_t *start = Memory_addr_ptr(memory, Register_CS, startIp);
+    const size_t codeLen = start < memory->codeEnd ? (size_t) (memory->codeEnd - start) : 0;
+    const size_t maxCount = stopIp - startIp < codeLen ? stopIp - startIp : codeLen;
+    if(!reserve(disasm, maxCount < DISASM_INIT_CAP ? DISASM_INIT_CAP : maxCount)) {
+        return false;
+    }
+
+    uint32_t ip = startIp;
+    while(ip < stopIp && ip <= UINT16_MAX && Memory_addr_ptr(memory, Register_CS, ip) < memory->codeEnd) {
+        Opcode *opcode = &disasm->opcodes[disasm->count];
+        const OpcodeDecodeErr err = Opcode_decode_at(opcode, memory, ip);
+        if(err) {
+            disasm->err = err;
+            break;
+        }
+
+        disasm->ips[disasm->count++] = ip;
+        ip += opcode->len;
+    }
+
+    disasm->endIp = ip;
+    return true;
+}
+
+bool Disasm_decode(Disasm *disasm, const Memory *memory, const uint16_t startIp) {
+    return decode_range(disasm, memory, startIp, UINT16_MAX + 1);
+}
+
+size_t Disasm_format_bound(const size_t count) {
+    return count * DISASM_MAX_LINE_LEN + 1;
+}
+
+size_t Disasm_format(const Disasm *disasm, const size_t from, const size_t to, char *dst) {
+    char *start = dst;
+    for(size_t i = from; i < to; ++i) {
+        dst += Opcode_decompile(&disasm->opcodes[i], dst);
+        *dst++ = '\n';
+    }
+    *dst = 0;
+    return dst - start;
+}
+
+bool Disasm_write(const Disasm *disasm, FILE *out) {
+    const size_t headerLen = sizeof(DISASM_HEADER) - 1;
+    char *buf = malloc(headerLen + Disasm_format_bound(disasm->count));
+    if(buf == NULL) {
+        return false;
+    }
+
+    memcpy(buf, DISASM_HEADER, headerLen);
+    const size_t len = headerLen + Disasm_format(disasm, 0, disasm->count, buf + headerLen);
+
+    const bool ok = fwrite(buf, 1, len, out) == len;
+    free(buf);
+    return ok;
+}
+
+typedef struct {
+    const Memory *memory;
+    Disasm disasm;
+    uint16_t startIp;
+    uint32_t stopIp;
+    size_t first;       // First opcode on the real sweep, once resynchronized
+    char *buf;          // Formatted lines
+    size_t len;
+    bool ok;
+} DisasmChunk;
+
+static void *decode_chunk(void *arg) {
+    DisasmChunk *chunk = arg;
+    chunk->ok = decode_range(&chunk->disasm, chunk->memory, chunk->startIp, chunk->stopIp);
+    return NULL;
+}
+
+static void *format_chunk(void *arg) {
+    DisasmChunk *chunk = arg;
+    const size_t count = chunk->disasm.count - chunk->first;
+    chunk->buf = malloc(Disasm_format_bound(count));
+    chunk->ok = chunk->buf != NULL;
+    if(chunk->ok) {
+        chunk->len = Disasm_format(&chunk->disasm, chunk->first, chunk->disasm.count, chunk->buf);
+    }
+    return NULL;
+}
+
+// Runs fn on every chunk, one thread each (the first one on the calling thread)
+static void run_chunks(DisasmChunk *chunks, const uint32_t count, void *(*fn)(void *)) {
+    pthread_t threads[DISASM_MAX_THREADS];
+    bool started[DISASM_MAX_THREADS] = {0};
+
+    for(uint32_t i = 1; i < count; ++i) {
+        started[i] = pthread_create(&threads[i], NULL, fn, &chunks[i]) == 0;
+    }
+    fn(&chunks[0]);
+    for(uint32_t i = 1; i < count; ++i) {
+        if(started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            fn(&chunks[i]);
+        }
+    }
+}
+
+// Index of ip in the sorted ips, or count if not there
+static size_t find_ip(const uint16_t *ips, const size_t count, const uint16_t ip) {
+    size_t lo = 0, hi = count;
+    while(lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if(ips[mid] < ip) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && ips[lo] == ip ? lo : count;
+}
+
+bool Disasm_write_parallel(const Memory *memory, const uint16_t startIp, uint32_t threads, FILE *out, DisasmStatus *status) {
+    const uint8_t *start = Memory_addr_ptr(memory, Register_CS, startIp);
+    const uint32_t codeLen = start < memory->codeEnd ? (uint32_t) (memory->codeEnd - start) : 0;
+    const uint32_t codeEndIp = startIp + codeLen > UINT16_MAX + 1 ? UINT16_MAX + 1 : startIp + codeLen;
+
+    if(threads > DISASM_MAX_THREADS) {
+        threads = DISASM_MAX_THREADS;
+    }
+    if(threads > codeLen / DISASM_MIN_CHUNK) {
+        threads = codeLen / DISASM_MIN_CHUNK;
+    }
+    if(threads == 0) {
+        threads = 1;
+    }
+
+    // Every chunk decodes speculatively from its own start. The table is filled lazily, not thread safe
+    OpcodeEncodingTable_init();
+    DisasmChunk chunks[DISASM_MAX_THREADS] = {0};
+    const uint32_t chunkLen = (codeEndIp - startIp) / threads;
+    for(uint32_t i = 0; i < threads; ++i) {
+        chunks[i].memory = memory;
+        chunks[i].startIp = startIp + i * chunkLen;
+        chunks[i].stopIp = i + 1 < threads ? startIp + (i + 1) * chunkLen : codeEndIp;
+    }
+    run_chunks(chunks, threads, decode_chunk);
+
+    /*
+     * Resynchronize in order. The real sweep enters a chunk where the previous one left off,
+     * usually an opcode boundary the speculative sweep already found, since 8086 code realigns
+     * within a few opcodes. If it didn't, the chunk is decoded again from the real entry.
+     */
+    bool ok = true;
+    uint32_t used = 0;
+    *status = (DisasmStatus) {.count = 0, .err = OpcodeDecodeErr_OK, .endIp = startIp};
+    for(uint32_t i = 0; ok && i < threads; ++i) {
+        DisasmChunk *chunk = &chunks[i];
+        ok = chunk->ok;
+        if(!ok) {
+            break;
+        }
+
+        if(i > 0) {
+            const uint16_t entry = status->endIp;
+            chunk->first = find_ip(chunk->disasm.ips, chunk->disasm.count, entry);
+            if(chunk->first == chunk->disasm.count && (chunk->disasm.endIp != entry || chunk->disasm.err)) {
+                // Not on a boundary it found, or it stopped at an error the real sweep may not reach
+                // (an empty range if the previous chunk's last opcode covered this one entirely)
+                chunk->first = 0;
+                chunk->startIp = entry;
+                ok = decode_range(&chunk->disasm, memory, entry, chunk->stopIp);
+            }
+        }
+
+        used++;
+        status->count += chunk->disasm.count - chunk->first;
+        status->endIp = chunk->disasm.endIp;
+        if(chunk->disasm.err) {
+            status->err = chunk->disasm.err;
+            break; // The real sweep stops here
+        }
+    }
+
+    if(ok) {
+        run_chunks(chunks, used, format_chunk);
+        for(uint32_t i = 0; i < used; ++i) {
+            ok = ok && chunks[i].ok;
+        }
+    }
+
+    if(ok) {
+        ok = fwrite(DISASM_HEADER, 1, sizeof(DISASM_HEADER) - 1, out) == sizeof(DISASM_HEADER) - 1;
+        for(uint32_t i = 0; ok && i < used; ++i) {
+            ok = fwrite(chunks[i].buf, 1, chunks[i].len, out) == chunks[i].len;
+        }
+    }
+
+    for(uint32_t i = 0; i < threads; ++i) {
+        free(chunks[i].buf);
+        Disasm_destroy(&chunks[i].disasm);
+    }
+    return ok;
+}
+
+void Disasm_destroy(Disasm *disasm) {
+    free(disasm->opcodes);
+    free(disasm->ips);
+    *disasm = (Disasm) {0};
+}
@@ -0,0 +1,55 @@
+#ifndef SIM86_DISASM_H
+#define SIM86_DISASM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "opcode/opcode.h"
+#include "memory/memory.h"
+#include "opcode_encoding/opcode_encoding.h"
+#include "opcode_decompile/opcode_decompile.h"
+
+#define DISASM_HEADER "bits 16\n\n"
+#define DISASM_MAX_LINE_LEN (MAX_OP_LEN + 1) // Opcode plus newline
+#define DISASM_MAX_THREADS 64
+#define DISASM_MIN_CHUNK 16                 // Bytes of code per thread
+
+/*
+ * Linear sweep disassembly of a whole code segment. Every opcode is decoded up front,
+ * and then formatted in bulk into a single buffer.
+ */
+typedef struct {
+    Opcode *opcodes;
+    uint16_t *ips;          // IP of every opcode
+    size_t count, cap;
+    OpcodeDecodeErr err;    // Why the sweep stopped before code end, if it did
+    uint16_t endIp;         // IP the sweep stopped at
+} Disasm;
+
+// Decodes from startIp until code ends or an opcode can't be decoded. Returns false if out of memory
+bool Disasm_decode(Disasm *disasm, const Memory *memory, uint16_t startIp);
+
+// Upper bound of the bytes Disasm_format writes for count opcodes
+size_t Disasm_format_bound(size_t count);
+
+// Formats opcodes [from, to) as lines. dst must hold Disasm_format_bound(to - from) bytes. Returns bytes written
+size_t Disasm_format(const Disasm *disasm, size_t from, size_t to, char *dst);
+
+// Writes the whole listing, header included, with a single write. Returns false on error
+bool Disasm_write(const Disasm *disasm, FILE *out);
+
+// Outcome of a parallel listing, same meaning as the Disasm fields
+typedef struct {
+    size_t count;
+    OpcodeDecodeErr err;
+    uint16_t endIp;
+} DisasmStatus;
+
+// Same listing as Disasm_decode and Disasm_write, splitting the code in chunks that are decoded and
+// formatted on up to threads threads. Returns false if out of memory or on write error
+bool Disasm_write_parallel(const Memory *memory, uint16_t startIp, uint32_t threads, FILE *out, DisasmStatus *status);
+
+void Disasm_destroy(Disasm *disasm);
+
+#endif //SIM86_DISASM_H
@@ -0,0 +1,540 @@
+#include "jit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alu/alu.h"
+#include "opcode_run/opcode_run.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+#define FUNC_ALIGN 16
+#define MAX_BLOCK_CODE (BLOCK_MAX_LEN * 128 + 64) // Generous upper bound of native bytes per block
+
+#define REG_OFF(reg) ((int32_t) (offsetof(Memory, registers) + 2 * (reg)))
+#define FLAG_OFF(flag) ((int32_t) (offsetof(Memory, flags) + offsetof(Flags, flag)))
+
+// Host registers
+enum {
+    EAX = 0, ECX = 1, EDX = 2, EBX = 3,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12,
+};
+
+/*
+ * Register usage of the generated code:
+ *  rbx: Memory *
+ *  r12: memory->ram
+ *  eax, edx: operands
+ *  r8d: effective address, r9d: linear address, r10d, r11d: scratch
+ */
+
+typedef struct {
+    uint8_t *start, *curr, *end;
+    bool full;
+} Emitter;
+
+static void emit_bytes(Emitter *e, const uint8_t *bytes, const size_t n) {
+    if(e->curr + n > e->end) {
+        e->full = true;
+        return;
+    }
+    memcpy(e->curr, bytes, n);
+    e->curr += n;
+}
+
+#define EMIT(e, ...) do { \
+    const uint8_t bytes_[] = {__VA_ARGS__}; \
+    emit_bytes(e, bytes_, sizeof(bytes_)); \
+} while(0)
+
+static void emit16(Emitter *e, const uint16_t v) {
+    EMIT(e, v, v >> 8);
+}
+
+static void emit32(Emitter *e, const uint32_t v) {
+    EMIT(e, v, v >> 8, v >> 16, v >> 24);
+}
+
+static void emit64(Emitter *e, const uint64_t v) {
+    emit32(e, v);
+    emit32(e, v >> 32);
+}
+
+// Emits `<op> reg, [rbx + disp32]` (or `<op> [rbx + disp32], reg`)
+static void emit_rbx_modrm(Emitter *e, const int reg, const int32_t disp) {
+    EMIT(e, 0x80 | ((reg & 7) << 3) | EBX);
+    emit32(e, disp);
+}
+
+static void emit_prologue(Emitter *e) {
+    EMIT(e, 0x53);                          // push rbx
+    EMIT(e, 0x41, 0x54);                    // push r12
+    EMIT(e, 0x48, 0x83, 0xEC, 0x08);        // sub rsp, 8 (keep calls 16 byte aligned)
+    EMIT(e, 0x48, 0x89, 0xFB);              // mov rbx, rdi
+    EMIT(e, 0x4C, 0x8B);                    // mov r12, [rbx + ram]
+    emit_rbx_modrm(e, R12, offsetof(Memory, ram));
+}
+
+// Sets IP and returns the number of opcodes run
+static void emit_exit(Emitter *e, const uint16_t ip, const uint16_t count) {
+    EMIT(e, 0x66, 0xC7);                    // mov word [rbx + ip], imm16
+    emit_rbx_modrm(e, 0, REG_OFF(Register_IP));
+    emit16(e, ip);
+    EMIT(e, 0xB8);                          // mov eax, imm32
+    emit32(e, count);
+    EMIT(e, 0x48, 0x83, 0xC4, 0x08);        // add rsp, 8
+    EMIT(e, 0x41, 0x5C);                    // pop r12
+    EMIT(e, 0x5B);                          // pop rbx
+    EMIT(e, 0xC3);                          // ret
+}
+
+static void emit_set_ip(Emitter *e, const uint16_t ip) {
+    EMIT(e, 0x66, 0xC7);                    // mov word [rbx + ip], imm16
+    emit_rbx_modrm(e, 0, REG_OFF(Register_IP));
+    emit16(e, ip);
+}
+
+static int32_t reg_operand_off(const BlockOperand *operand, const RegSize size, const Memory *memory) {
+    const uint8_t *ptr = size == RegSize_WORD ? (const uint8_t *) operand->reg16 : operand->reg8;
+    return (int32_t) (ptr - (const uint8_t *) memory);
+}
+
+// movzx reg, word/byte [rbx + guest register]
+static void emit_load_reg(Emitter *e, const int reg, const BlockOperand *operand, const RegSize size, const Memory *memory) {
+    if(reg >= R8) EMIT(e, 0x44);
+    EMIT(e, 0x0F, size == RegSize_WORD ? 0xB7 : 0xB6);
+    emit_rbx_modrm(e, reg, reg_operand_off(operand, size, memory));
+}
+
+// mov word/byte [rbx + guest register], ax/al
+static void emit_store_reg(Emitter *e, const BlockOperand *operand, const RegSize size, const Memory *memory) {
+    if(size == RegSize_WORD) {
+        EMIT(e, 0x66, 0x89);
+    } else {
+        EMIT(e, 0x88);
+    }
+    emit_rbx_modrm(e, EAX, reg_operand_off(operand, size, memory));
+}
+
+// mov reg, imm32
+static void emit_load_imm(Emitter *e, const int reg, const uint16_t imm) {
+    if(reg >= R8) EMIT(e, 0x41);
+    EMIT(e, 0xB8 + (reg & 7));
+    emit32(e, imm);
+}
+
+// Leaves the effective address in r8d and the linear address in r9d
+static void emit_effective_addr(Emitter *e, const BlockMemOperand *mem, const Memory *memory) {
+    EMIT(e, 0x45, 0x31, 0xC0);              // xor r8d, r8d
+
+    for(int i = 0; i < 2; ++i) {
+        const uint8_t *term = (const uint8_t *) mem->terms[i];
+        const uint8_t *regs = (const uint8_t *) memory->registers;
+        if(term < regs || term >= regs + sizeof(memory->registers)) {
+            continue; // Not present
+        }
+        EMIT(e, 0x44, 0x0F, 0xB7);          // movzx r10d, word [rbx + term]
+        emit_rbx_modrm(e, R10, (int32_t) (term - (const uint8_t *) memory));
+        EMIT(e, 0x45, 0x01, 0xD0);          // add r8d, r10d
+    }
+
+    if(mem->displacement) {
+        EMIT(e, 0x41, 0x81, 0xC0);          // add r8d, imm32
+        emit32(e, (uint32_t) (int32_t) mem->displacement);
+    }
+
+    EMIT(e, 0x45, 0x0F, 0xB7, 0xC0);        // movzx r8d, r8w
+    EMIT(e, 0x44, 0x0F, 0xB7);              // movzx r9d, word [rbx + segment]
+    emit_rbx_modrm(e, R9, REG_OFF(mem->segment));
+    EMIT(e, 0x41, 0xC1, 0xE1, 0x04);        // shl r9d, 4
+    EMIT(e, 0x45, 0x01, 0xC1);              // add r9d, r8d
+    EMIT(e, 0x41, 0x81, 0xE1);              // and r9d, MEM_MASK
+    emit32(e, 0xFFFFF);
+}
+
+// movzx reg, word/byte [r12 + r9]. Words at offset 0xFFFF or at the end of RAM take their high byte
+// from the start of the segment, like Memory_read
+static void emit_load_mem(Emitter *e, const int reg, const BlockMemOperand *mem, const RegSize size) {
+    if(size == RegSize_BYTE) {
+        EMIT(e, 0x43, 0x0F, 0xB6, 0x04 | ((reg & 7) << 3), 0x0C);
+        return;
+    }
+
+    EMIT(e, 0x41, 0x81, 0xF8);              // cmp r8d, 0xFFFF
+    emit32(e, UINT16_MAX);
+    EMIT(e, 0x74, 0x00);                    // je slow
+    uint8_t *segmentEnd = e->curr;
+    EMIT(e, 0x41, 0x81, 0xF9);              // cmp r9d, MEM_MASK
+    emit32(e, 0xFFFFF);
+    EMIT(e, 0x74, 0x00);                    // je slow
+    uint8_t *ramEnd = e->curr;
+    EMIT(e, 0x43, 0x0F, 0xB7, 0x04 | ((reg & 7) << 3), 0x0C);
+    EMIT(e, 0xEB, 0x00);                    // jmp done
+    uint8_t *done = e->curr;
+
+    if(!e->full) {
+        segmentEnd[-1] = (uint8_t) (e->curr - segmentEnd);
+        ramEnd[-1] = (uint8_t) (e->curr - ramEnd);
+    }
+    EMIT(e, 0x43, 0x0F, 0xB6, 0x04 | ((reg & 7) << 3), 0x0C);
+    EMIT(e, 0x45, 0x8D, 0x50, 0x01);        // lea r10d, [r8 + 1]
+    EMIT(e, 0x45, 0x0F, 0xB7, 0xD2);        // movzx r10d, r10w
+    EMIT(e, 0x44, 0x0F, 0xB7);              // movzx r11d, word [rbx + segment]
+    emit_rbx_modrm(e, R11, REG_OFF(mem->segment));
+    EMIT(e, 0x41, 0xC1, 0xE3, 0x04);        // shl r11d, 4
+    EMIT(e, 0x45, 0x01, 0xDA);              // add r10d, r11d
+    EMIT(e, 0x41, 0x81, 0xE2);              // and r10d, MEM_MASK
+    emit32(e, 0xFFFFF);
+    EMIT(e, 0x47, 0x0F, 0xB6, 0x14, 0x14);  // movzx r10d, byte [r12 + r10]
+    EMIT(e, 0x41, 0xC1, 0xE2, 0x08);        // shl r10d, 8
+    EMIT(e, 0x44, 0x09, 0xD0 | (reg & 7));  // or reg, r10d
+    if(!e->full) done[-1] = (uint8_t) (e->curr - done);
+}
+
+// Memory_write(memory, segment, r8d, size, eax)
+static void emit_store_mem(Emitter *e, const BlockMemOperand *mem, const RegSize size) {
+    EMIT(e, 0x48, 0x89, 0xDF);              // mov rdi, rbx
+    EMIT(e, 0xBE);                          // mov esi, segment
+    emit32(e, mem->segment);
+    EMIT(e, 0x44, 0x89, 0xC2);              // mov edx, r8d
+    EMIT(e, 0xB9);                          // mov ecx, size
+    emit32(e, size);
+    EMIT(e, 0x41, 0x89, 0xC0);              // mov r8d, eax
+    EMIT(e, 0x48, 0xB8);                    // mov rax, Memory_write
+    emit64(e, (uint64_t) (uintptr_t) Memory_write);
+    EMIT(e, 0xFF, 0xD0);                    // call rax
+}
+
+// Leaves the block if code was written since it was compiled
+static void emit_smc_check(Emitter *e, const uint64_t *generation, const uint16_t ip, const uint16_t count) {
+    EMIT(e, 0x48, 0x8B);                    // mov rax, [rbx + opcodeCache]
+    emit_rbx_modrm(e, EAX, offsetof(Memory, opcodeCache));
+    EMIT(e, 0x48, 0x8B, 0x80);              // mov rax, [rax + generation]
+    emit32(e, offsetof(OpcodeCache, generation));
+    EMIT(e, 0x48, 0xBA);                    // mov rdx, generation
+    emit64(e, (uint64_t) (uintptr_t) generation);
+    EMIT(e, 0x48, 0x3B, 0x02);              // cmp rax, [rdx]
+    EMIT(e, 0x74, 0x00);                    // je skip
+    uint8_t *skip = e->curr;
+    emit_exit(e, ip, count);
+    if(!e->full) skip[-1] = (uint8_t) (e->curr - skip);
+}
+
+// Leaves the block if the opcode just run halted the machine
+static void emit_halt_check(Emitter *e, const uint16_t ip, const uint16_t count) {
+    EMIT(e, 0x80);                          // cmp byte [rbx + halted], 0
+    emit_rbx_modrm(e, 7, offsetof(Memory, halted));
+    EMIT(e, 0x00);
+    EMIT(e, 0x74, 0x00);                    // je skip
+    uint8_t *skip = e->curr;
+    emit_exit(e, ip, count);
+    if(!e->full) skip[-1] = (uint8_t) (e->curr - skip);
+}
+
+static void sync_flags(Memory *memory) {
+    Flags_sync(memory);
+}
+
+// Native code works on materialized flags, handlers may have left them lazy
+static void emit_sync_flags(Emitter *e) {
+    EMIT(e, 0x48, 0x89, 0xDF);              // mov rdi, rbx
+    EMIT(e, 0x48, 0xB8);                    // mov rax, sync_flags
+    emit64(e, (uint64_t) (uintptr_t) sync_flags);
+    EMIT(e, 0xFF, 0xD0);                    // call rax
+}
+
+// handler(insn, memory)
+static void emit_call_handler(Emitter *e, const BlockInsn *insn) {
+    EMIT(e, 0x48, 0xBF);                    // mov rdi, insn
+    emit64(e, (uint64_t) (uintptr_t) insn);
+    EMIT(e, 0x48, 0x89, 0xDE);              // mov rsi, rbx
+    EMIT(e, 0x48, 0xB8);                    // mov rax, handler
+    emit64(e, (uint64_t) (uintptr_t) insn->run);
+    EMIT(e, 0xFF, 0xD0);                    // call rax
+}
+
+static void emit_load_operand(Emitter *e, const int reg, const BlockOperand *operand, const BlockOperandKind kind,
+                              const RegSize size, const Memory *memory) {
+    switch(kind) {
+        case BlockOperandKind_REGISTER: emit_load_reg(e, reg, operand, size, memory); break;
+        case BlockOperandKind_IMMEDIATE: emit_load_imm(e, reg, operand->imm); break;
+        case BlockOperandKind_MEMORY: {
+            emit_effective_addr(e, &operand->mem, memory);
+            emit_load_mem(e, reg, &operand->mem, size);
+        } break;
+        case BlockOperandKind_NONE: break;
+    }
+}
+
+// Flags after a 16 bit host ALU opcode, same as the interpreter for word sized opcodes
+static void emit_store_flags(Emitter *e, const bool arithmetic) {
+    EMIT(e, 0x0F, 0x90); emit_rbx_modrm(e, 0, FLAG_OFF(overflow)); // seto
+    EMIT(e, 0x0F, 0x98); emit_rbx_modrm(e, 0, FLAG_OFF(sign));     // sets
+    EMIT(e, 0x0F, 0x94); emit_rbx_modrm(e, 0, FLAG_OFF(zero));     // setz
+    EMIT(e, 0x0F, 0x9A); emit_rbx_modrm(e, 0, FLAG_OFF(parity));   // setp
+    EMIT(e, 0x0F, 0x92); emit_rbx_modrm(e, 0, FLAG_OFF(carry));    // setc
+
+    if(arithmetic) {
+        // Logic opcodes leave auxCarry untouched
+        EMIT(e, 0x9C);                      // pushfq
+        EMIT(e, 0x59);                      // pop rcx
+        EMIT(e, 0xC1, 0xE9, 0x04);          // shr ecx, 4
+        EMIT(e, 0x83, 0xE1, 0x01);          // and ecx, 1
+        EMIT(e, 0x88);                      // mov [rbx + auxCarry], cl
+        emit_rbx_modrm(e, ECX, FLAG_OFF(auxCarry));
+    }
+}
+
+static bool emit_native_opcode(Emitter *e, const BlockInsn *insn, const Memory *memory, bool *lazyFlags) {
+    const OpcodeType type = insn->opcode->type;
+    if(insn->dstKind == BlockOperandKind_NONE) {
+        return false;
+    }
+
+    uint8_t aluOp;
+    bool arithmetic = true;
+    bool store = true;
+    switch(type) {
+        case OpcodeType_MOV: aluOp = 0; break;
+        case OpcodeType_ADD: aluOp = 0x01; break;
+        case OpcodeType_SUB: aluOp = 0x29; break;
+        case OpcodeType_CMP: aluOp = 0x39; store = false; break;
+        case OpcodeType_AND: aluOp = 0x21; arithmetic = false; break;
+        case OpcodeType_OR:  aluOp = 0x09; arithmetic = false; break;
+        case OpcodeType_XOR: aluOp = 0x31; arithmetic = false; break;
+        default: return false;
+    }
+    if(aluOp && insn->size != RegSize_WORD) {
+        return false; // Byte sized flags go through the interpreter semantics
+    }
+    if(aluOp && *lazyFlags) {
+        emit_sync_flags(e); // Native flags would be overridden by the lazy record
+        *lazyFlags = false;
+    }
+
+    // Source first, so r8d keeps the destination address
+    emit_load_operand(e, aluOp ? EDX : EAX, &insn->src, insn->srcKind, insn->size, memory);
+
+    if(aluOp) {
+        emit_load_operand(e, EAX, &insn->dst, insn->dstKind, insn->size, memory);
+        EMIT(e, 0x66, aluOp, 0xD0);         // <op> ax, dx
+        emit_store_flags(e, arithmetic);
+    } else if(insn->dstKind == BlockOperandKind_MEMORY) {
+        emit_effective_addr(e, &insn->dst.mem, memory);
+    }
+
+    if(store) {
+        if(insn->dstKind == BlockOperandKind_MEMORY) {
+            emit_store_mem(e, &insn->dst.mem, insn->size);
+        } else {
+            emit_store_reg(e, &insn->dst, insn->size, memory);
+        }
+    }
+
+    return true;
+}
+
+// Leaves the jump condition in al
+static bool emit_jump_cond(Emitter *e, const OpcodeType type) {
+    #define LOAD_FLAG(flag) do { EMIT(e, 0x8A); emit_rbx_modrm(e, EAX, FLAG_OFF(flag)); } while(0) // mov al, [flag]
+    #define XOR_FLAG(flag)  do { EMIT(e, 0x32); emit_rbx_modrm(e, EAX, FLAG_OFF(flag)); } while(0) // xor al, [flag]
+    #define OR_FLAG(flag)   do { EMIT(e, 0x0A); emit_rbx_modrm(e, EAX, FLAG_OFF(flag)); } while(0) // or al, [flag]
+    #define NOT()           EMIT(e, 0x34, 0x01)                                                        // xor al, 1
+    #define DEC_CX()        do { EMIT(e, 0x66, 0xFF); emit_rbx_modrm(e, 1, REG_OFF(Register_CX)); } while(0)
+
+    switch(type) {
+        case OpcodeType_JE:   LOAD_FLAG(zero); break;
+        case OpcodeType_JNE:  LOAD_FLAG(zero); NOT(); break;
+        case OpcodeType_JL:   LOAD_FLAG(sign); XOR_FLAG(overflow); break;
+        case OpcodeType_JNL:  LOAD_FLAG(sign); XOR_FLAG(overflow); NOT(); break;
+        case OpcodeType_JLE:  LOAD_FLAG(sign); XOR_FLAG(overflow); OR_FLAG(zero); break;
+        case OpcodeType_JNLE: LOAD_FLAG(sign); XOR_FLAG(overflow); OR_FLAG(zero); NOT(); break;
+        case OpcodeType_JB:   LOAD_FLAG(carry); break;
+        case OpcodeType_JNB:  LOAD_FLAG(carry); NOT(); break;
+        case OpcodeType_JBE:  LOAD_FLAG(carry); OR_FLAG(zero); break;
+        case OpcodeType_JNBE: LOAD_FLAG(carry); OR_FLAG(zero); NOT(); break;
+        case OpcodeType_JP:   LOAD_FLAG(parity); break;
+        case OpcodeType_JNP:  LOAD_FLAG(parity); NOT(); break;
+        case OpcodeType_JO:   LOAD_FLAG(overflow); break;
+        case OpcodeType_JNO:  LOAD_FLAG(overflow); NOT(); break;
+        case OpcodeType_JS:   LOAD_FLAG(sign); break;
+        case OpcodeType_JNS:  LOAD_FLAG(sign); NOT(); break;
+        case OpcodeType_LOOP: {
+            DEC_CX();
+            EMIT(e, 0x0F, 0x95, 0xC0);      // setnz al
+        } break;
+        case OpcodeType_LOOPZ: {
+            DEC_CX();
+            EMIT(e, 0x0F, 0x95, 0xC0);      // setnz al
+            EMIT(e, 0x22);                  // and al, [zero]
+            emit_rbx_modrm(e, EAX, FLAG_OFF(zero));
+        } break;
+        case OpcodeType_LOOPNZ: {
+            DEC_CX();
+            EMIT(e, 0x0F, 0x95, 0xC0);      // setnz al
+            EMIT(e, 0x8A);                  // mov cl, [zero]
+            emit_rbx_modrm(e, ECX, FLAG_OFF(zero));
+            EMIT(e, 0x80, 0xF1, 0x01);      // xor cl, 1
+            EMIT(e, 0x20, 0xC8);            // and al, cl
+        } break;
+        case OpcodeType_JCXZ: {
+            EMIT(e, 0x66, 0x83);            // cmp word [rbx + cx], 0
+            emit_rbx_modrm(e, 7, REG_OFF(Register_CX));
+            EMIT(e, 0x00);
+            EMIT(e, 0x0F, 0x94, 0xC0);      // setz al
+        } break;
+        default: return false;
+    }
+    return true;
+
+    #undef LOAD_FLAG
+    #undef XOR_FLAG
+    #undef OR_FLAG
+    #undef NOT
+    #undef DEC_CX
+}
+
+// Flags must be materialized (Flags_sync) when the block is entered
+static void emit_block(Emitter *e, const Block *block, const Memory *memory, const uint64_t *generation) {
+    emit_prologue(e);
+    bool lazyFlags = false; // A handler may have recorded lazy flags
+
+    for(uint16_t i = 0; i < block->len; ++i) {
+        const BlockInsn *insn = &block->insns[i];
+        const uint16_t count = i + 1;
+        const bool last = count == block->len;
+
+        if(last && insn->opcode->dst.type == OpcodeArgType_IPINC) {
+            if(insn->opcode->type == OpcodeType_JMP) {
+                emit_exit(e, insn->jumpIp, count);
+                return;
+            }
+
+            uint8_t *start = e->curr;
+            if(lazyFlags) emit_sync_flags(e);
+            if(emit_jump_cond(e, insn->opcode->type)) {
+                EMIT(e, 0x84, 0xC0);        // test al, al
+                EMIT(e, 0x74, 0x00);        // jz not_taken
+                uint8_t *notTaken = e->curr;
+                emit_exit(e, insn->jumpIp, count);
+                if(!e->full) notTaken[-1] = (uint8_t) (e->curr - notTaken);
+                emit_exit(e, insn->nextIp, count);
+                return;
+            }
+            e->curr = start;
+        }
+
+        if(emit_native_opcode(e, insn, memory, &lazyFlags)) {
+            if(insn->writesMemory && !last) {
+                emit_smc_check(e, generation, insn->nextIp, count);
+            }
+            continue;
+        }
+
+        // Unsupported natively: run its block handler
+        emit_set_ip(e, insn->nextIp);
+        emit_call_handler(e, insn);
+        lazyFlags = true;
+        if(Opcode_can_fault(insn->opcode) && !last) {
+            emit_halt_check(e, insn->nextIp, count);
+        }
+        if(insn->writesMemory && !last) {
+            emit_smc_check(e, generation, insn->nextIp, count);
+        }
+        if(Opcode_transfers_control(insn->opcode)) {
+            // The handler already decided where to go
+            EMIT(e, 0xB8);                  // mov eax, count
+            emit32(e, count);
+            EMIT(e, 0x48, 0x83, 0xC4, 0x08, 0x41, 0x5C, 0x5B, 0xC3); // epilogue
+            return;
+        }
+    }
+
+    emit_exit(e, block->exitIp[0], block->len);
+}
+
+Jit *Jit_create(const size_t size) {
+    Jit *jit = calloc(1, sizeof(*jit));
+    if(jit == NULL) {
+        return NULL;
+    }
+
+    void *code = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(code == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+
+    jit->code = code;
+    jit->size = size;
+    return jit;
+}
+
+void Jit_destroy(Jit *jit) {
+    if(jit == NULL) {
+        return;
+    }
+
+    munmap(jit->code, jit->size);
+    free(jit);
+}
+
+void Jit_reset(Jit *jit) {
+    jit->used = 0;
+}
+
+BlockNativeFn Jit_compile(Jit *jit, const Block *block, const Memory *memory, const uint64_t *generation) {
+    const size_t start = (jit->used + FUNC_ALIGN - 1) & ~(size_t) (FUNC_ALIGN - 1);
+    if(start + MAX_BLOCK_CODE > jit->size || block->len == 0) {
+        jit->failed++;
+        return NULL;
+    }
+
+    // W^X: only writable while emitting
+    if(mprotect(jit->code, jit->size, PROT_READ | PROT_WRITE)) {
+        jit->failed++;
+        return NULL;
+    }
+
+    Emitter e = {
+        .start = jit->code + start,
+        .curr = jit->code + start,
+        .end = jit->code + start + MAX_BLOCK_CODE,
+        .full = false,
+    };
+    emit_block(&e, block, memory, generation);
+
+    if(mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC) || e.full) {
+        jit->failed++;
+        return NULL;
+    }
+
+    jit->used = e.curr - jit->code;
+    jit->compiled++;
+    return (BlockNativeFn) (uintptr_t) e.start;
+}
+
+#undef FUNC_ALIGN
+#undef MAX_BLOCK_CODE
+#undef REG_OFF
+#undef FLAG_OFF
+
+#else // Not x86-64: no native tier
+
+Jit *Jit_create(const size_t size) {
+    return NULL;
+}
+
+void Jit_destroy(Jit *jit) {
+}
+
+void Jit_reset(Jit *jit) {
+}
+
+BlockNativeFn Jit_compile(Jit *jit, const Block *block, const Memory *memory, const uint64_t *generation) {
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SIM86_JIT_H
+#define SIM86_JIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "memory/memory.h"
+#include "block_run/block_run.h"
+
+#define JIT_DEFAULT_SIZE (4 << 20) // 4 MB of native code
+#define JIT_DEFAULT_THRESHOLD 16   // Block entries before compiling
+
+/*
+ * x86-64 native tier for the block engine. MOV, word sized ALU opcodes and
+ * conditional jumps are emitted natively; any other opcode calls its block
+ * handler, so semantics are always the same as the interpreter.
+ */
+struct Jit {
+    uint8_t *code;          // mmap'd buffer, writable only while emitting
+    size_t size, used;
+    uint64_t compiled, failed;
+};
+
+// Returns NULL if the host is not supported
+Jit *Jit_create(size_t size);
+
+void Jit_destroy(Jit *jit);
+
+// Drops all compiled code
+void Jit_reset(Jit *jit);
+
+// Returns NULL if the block could not be compiled (ex: buffer full)
+BlockNativeFn Jit_compile(Jit *jit, const Block *block, const Memory *memory, const uint64_t *generation);
+
+#endif //SIM86_JIT_H
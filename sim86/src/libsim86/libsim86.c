@@ -0,0 +1,359 @@
+#include "libsim86.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "memory/memory.h"
+#include "alu/alu.h"
+#include "opcode_encoding_table/opcode_encoding_table.h"
+#include "opcode_fetch/opcode_fetch.h"
+#include "opcode_run/opcode_run.h"
+#include "opcode_clocks/opcode_clocks.h"
+#include "opcode_decompile/opcode_decompile.h"
+#include "block_run/block_run.h"
+#include "jit/jit.h"
+
+// Public values are the internal ones
+_Static_assert((int) Sim86Register_IP == (int) Register_IP && (int) Sim86Register_COUNT == (int) Register_COUNT,
+               "Sim86Register must follow Register");
+_Static_assert((int) Sim86Stop_END == (int) RunStop_END && (int) Sim86Stop_UNTIL_IP == (int) RunStop_UNTIL_IP,
+               "Sim86Stop must follow RunStop");
+
+struct Sim86 {
+    Memory memory;
+    BlockEngine *blocks;        // NULL on the opcodes engine
+    bool clocked;
+    CpuModel model;
+    uint64_t instructions, clocks;
+    uint64_t snapshotInstructions, snapshotClocks;
+    Sim86TraceFn trace;
+    void *traceUser;
+    FILE *traceFile;
+};
+
+static pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+
+int Sim86_api_version(void) {
+    return SIM86_API_VERSION;
+}
+
+Sim86Err Sim86_create(Sim86 **out, const Sim86Engine engine) {
+    *out = NULL;
+    if(engine != Sim86Engine_OPCODES && engine != Sim86Engine_BLOCKS && engine != Sim86Engine_JIT) {
+        return Sim86Err_INVALID;
+    }
+
+    // Machines may be created from several threads, and decode right away
+    pthread_once(&tableOnce, OpcodeEncodingTable_init);
+
+    Sim86 *sim = calloc(1, sizeof(*sim));
+    if(sim == NULL) {
+        return Sim86Err_NO_MEMORY;
+    }
+    sim->memory = Memory_create();
+    sim->memory.opcodeCache = OpcodeCache_create();
+    if(sim->memory.ram == NULL || sim->memory.opcodeCache == NULL) {
+        Sim86_destroy(sim);
+        return Sim86Err_NO_MEMORY;
+    }
+
+    if(engine != Sim86Engine_OPCODES) {
+        sim->blocks = BlockEngine_create(&sim->memory);
+        if(sim->blocks == NULL) {
+            Sim86_destroy(sim);
+            return Sim86Err_NO_MEMORY;
+        }
+        if(engine == Sim86Engine_JIT && !BlockEngine_enable_jit(sim->blocks, JIT_DEFAULT_THRESHOLD)) {
+            Sim86_destroy(sim);
+            return Sim86Err_UNSUPPORTED;
+        }
+    }
+
+    *out = sim;
+    return Sim86Err_OK;
+}
+
+void Sim86_destroy(Sim86 *sim) {
+    if(sim == NULL) {
+        return;
+    }
+
+    BlockEngine_destroy(sim->blocks);
+    OpcodeCache_destroy(sim->memory.opcodeCache);
+    Memory_destroy(&sim->memory);
+    free(sim);
+}
+
+static Sim86Err load_err(const MemoryLoadErr err) {
+    switch(err) {
+        case MemoryLoadErr_OK: return Sim86Err_OK;
+        case MemoryLoadErr_OPEN: return Sim86Err_OPEN;
+        case MemoryLoadErr_READ: return Sim86Err_READ;
+        case MemoryLoadErr_TOO_BIG: return Sim86Err_TOO_BIG;
+    }
+    return Sim86Err_READ;
+}
+
+// Power on state, keeping the engine. Blocks are dropped on the next run, the opcode cache generation moved
+static Sim86Err reset(Sim86 *sim) {
+    if(!Memory_reset(&sim->memory)) {
+        return Sim86Err_NO_MEMORY;
+    }
+    sim->instructions = sim->clocks = 0;
+    return Sim86Err_OK;
+}
+
+Sim86Err Sim86_load_program(Sim86 *sim, const void *code, const size_t len) {
+    if(len > RAM_SIZE) {
+        return Sim86Err_TOO_BIG;
+    }
+
+    const Sim86Err err = reset(sim);
+    if(err) {
+        return err;
+    }
+
+    Memory *memory = &sim->memory;
+    uint8_t *codeSegment = Memory_segment_ptr(memory, Register_CS);
+    Memory_write_bytes(memory, codeSegment - memory->ram, code, len);
+    Memory_clear_dirty(memory); // Loaded, not written by the program
+    memory->codeEnd = codeSegment + (len < SEGMENT_SIZE ? len : SEGMENT_SIZE);
+    return Sim86Err_OK;
+}
+
+Sim86Err Sim86_load_program_file(Sim86 *sim, const char *path) {
+    const Sim86Err err = reset(sim);
+    if(err) {
+        return err;
+    }
+    return load_err(Memory_load_code_image(&sim->memory, path));
+}
+
+Sim86Err Sim86_load_image(Sim86 *sim, const uint32_t addr, const void *data, const size_t len) {
+    if(addr > RAM_SIZE || len > RAM_SIZE - addr) {
+        return Sim86Err_TOO_BIG;
+    }
+
+    Memory_write_bytes(&sim->memory, addr, data, len);
+    return Sim86Err_OK;
+}
+
+Sim86Err Sim86_snapshot(Sim86 *sim) {
+    if(!Memory_snapshot(&sim->memory)) {
+        return Sim86Err_NO_MEMORY;
+    }
+    sim->snapshotInstructions = sim->instructions;
+    sim->snapshotClocks = sim->clocks;
+    return Sim86Err_OK;
+}
+
+Sim86Err Sim86_restore(Sim86 *sim) {
+    if(sim->memory.snapshot == NULL) {
+        return Sim86Err_INVALID;
+    }
+
+    Memory_restore(&sim->memory);
+    sim->instructions = sim->snapshotInstructions;
+    sim->clocks = sim->snapshotClocks;
+    return Sim86Err_OK;
+}
+
+Sim86Err Sim86_set_cpu(Sim86 *sim, const Sim86Cpu cpu) {
+    switch(cpu) {
+        case Sim86Cpu_NONE: {
+            sim->clocked = false;
+            return Sim86Err_OK;
+        }
+        case Sim86Cpu_8086:
+        case Sim86Cpu_8088: {
+            if(sim->blocks) {
+                return Sim86Err_UNSUPPORTED;
+            }
+            sim->clocked = true;
+            sim->model = cpu == Sim86Cpu_8086 ? CpuModel_8086 : CpuModel_8088;
+            return Sim86Err_OK;
+        }
+    }
+    return Sim86Err_INVALID;
+}
+
+void Sim86_set_trace(Sim86 *sim, const Sim86TraceFn fn, void *user) {
+    sim->trace = fn;
+    sim->traceUser = user;
+}
+
+void Sim86_set_trace_file(Sim86 *sim, FILE *file) {
+    sim->traceFile = file;
+}
+
+static void trace_opcode(Sim86 *sim, const Opcode *opcode, const uint16_t cs, const uint16_t ip) {
+    Memory *memory = &sim->memory;
+    char text[MAX_OP_LEN + 1];
+    Opcode_decompile(opcode, text);
+    Flags_sync(memory);
+
+    const Sim86TraceEvent event = {
+            .cs = cs,
+            .ip = ip,
+            .text = text,
+            .registers = memory->registers,
+            .flags = Flags_word(&memory->flags),
+            .clocks = sim->clocks,
+    };
+    sim->trace(sim->traceUser, &event);
+}
+
+// Same as `sim86 run` on the opcodes engine, estimating clocks and tracing if asked to
+static uint64_t run_opcodes(Sim86 *sim, const RunLimits *limits, RunStop *stop) {
+    Memory *memory = &sim->memory;
+    FILE *traceFile = sim->traceFile;
+    const uint64_t startClocks = sim->clocks;
+    uint64_t instructions = 0;
+
+    Opcode scratch;
+    while(!(*stop = RunLimits_check(limits, memory, instructions, sim->clocks - startClocks))) {
+        const Opcode *opcode = Opcode_fetch(&scratch, memory);
+        if(opcode == NULL) {
+            continue; // Not decodable, it halted
+        }
+
+        const uint16_t cs = memory->registers[Register_CS];
+        const uint16_t ip = memory->registers[Register_IP];
+        if(traceFile) {
+            Opcode_decompile_to_file(opcode, traceFile);
+            fputs(" ;", traceFile);
+        }
+
+        if(sim->clocked) {
+            OpcodeClocks clocks = OpcodeClocks_estimate(opcode, memory, sim->model);
+            OpcodeTraceState traceState;
+            if(traceFile) {
+                OpcodeTrace_begin(&traceState, memory);
+            }
+
+            OpcodeClocks_run(&clocks, opcode, memory, sim->model);
+            sim->clocks += OpcodeClocks_total(&clocks);
+
+            if(traceFile) {
+                OpcodeClocks_trace(&clocks, sim->clocks, traceFile);
+                fputs(" |", traceFile);
+                OpcodeTrace_end(&traceState, memory, traceFile);
+            }
+        } else {
+            Opcode_run(opcode, memory, traceFile);
+        }
+        instructions++;
+
+        if(traceFile) {
+            fputc('\n', traceFile);
+        }
+
+        if(sim->trace) {
+            trace_opcode(sim, opcode, cs, ip);
+        }
+    }
+
+    return instructions;
+}
+
+Sim86Stop Sim86_run_limited(Sim86 *sim, const Sim86Limits *limits) {
+    const RunLimits runLimits = {
+            .maxInstructions = limits->maxInstructions ? limits->maxInstructions : UINT64_MAX,
+            .maxClocks = limits->maxClocks && sim->clocked ? limits->maxClocks : UINT64_MAX,
+            .untilIp = limits->untilIp,
+    };
+
+    RunStop stop;
+    if(sim->blocks && !sim->trace) {
+        sim->instructions += BlockEngine_run(sim->blocks, &runLimits, sim->traceFile, &stop);
+    } else {
+        sim->instructions += run_opcodes(sim, &runLimits, &stop);
+    }
+    return (Sim86Stop) stop;
+}
+
+Sim86Stop Sim86_run(Sim86 *sim, const uint64_t n) {
+    const Sim86Limits limits = {.maxInstructions = n, .untilIp = SIM86_NO_IP};
+    return Sim86_run_limited(sim, &limits);
+}
+
+Sim86Stop Sim86_step(Sim86 *sim) {
+    return Sim86_run(sim, 1);
+}
+
+uint64_t Sim86_instructions(const Sim86 *sim) {
+    return sim->instructions;
+}
+
+uint64_t Sim86_clocks(const Sim86 *sim) {
+    return sim->clocks;
+}
+
+const char *Sim86_fault(const Sim86 *sim, uint16_t *cs, uint16_t *ip) {
+    const Memory *memory = &sim->memory;
+    if(!memory->halted) {
+        return NULL;
+    }
+
+    if(cs) *cs = memory->faultCs;
+    if(ip) *ip = memory->faultIp;
+    return memory->fault;
+}
+
+uint16_t Sim86_get_register(const Sim86 *sim, const Sim86Register reg) {
+    return reg < Sim86Register_COUNT ? sim->memory.registers[reg] : 0;
+}
+
+Sim86Err Sim86_set_register(Sim86 *sim, const Sim86Register reg, const uint16_t value) {
+    if(reg >= Sim86Register_COUNT) {
+        return Sim86Err_INVALID;
+    }
+    sim->memory.registers[reg] = value;
+    return Sim86Err_OK;
+}
+
+uint16_t Sim86_get_flags(Sim86 *sim) {
+    Flags_sync(&sim->memory);
+    return Flags_word(&sim->memory.flags);
+}
+
+void Sim86_set_flags(Sim86 *sim, const uint16_t flags) {
+    // As POPF
+    sim->memory.flags = Flags_from_word(flags);
+    sim->memory.lazyFlags.op = LazyFlagsOp_NONE;
+}
+
+Sim86Err Sim86_read_memory(const Sim86 *sim, const uint32_t addr, void *dst, const size_t len) {
+    if(addr > RAM_SIZE || len > RAM_SIZE - addr) {
+        return Sim86Err_TOO_BIG;
+    }
+
+    memcpy(dst, sim->memory.ram + addr, len);
+    return Sim86Err_OK;
+}
+
+Sim86Err Sim86_write_memory(Sim86 *sim, const uint32_t addr, const void *src, const size_t len) {
+    return Sim86_load_image(sim, addr, src, len);
+}
+
+uint64_t Sim86_checksum(const Sim86 *sim) {
+    return Memory_checksum(&sim->memory);
+}
+
+const char *Sim86Err_name(const Sim86Err err) {
+    switch(err) {
+        case Sim86Err_OK: return "ok";
+        case Sim86Err_NO_MEMORY: return "out of memory";
+        case Sim86Err_OPEN: return "can't open file";
+        case Sim86Err_READ: return "can't read file";
+        case Sim86Err_TOO_BIG: return "doesn't fit in memory";
+        case Sim86Err_INVALID: return "invalid argument";
+        case Sim86Err_UNSUPPORTED: return "not supported";
+    }
+    return "?";
+}
+
+const char *Sim86Stop_name(const Sim86Stop stop) {
+    return RunStop_name((RunStop) stop);
+}
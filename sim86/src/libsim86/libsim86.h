@@ -0,0 +1,160 @@
+#ifndef SIM86_LIBSIM86_H
+#define SIM86_LIBSIM86_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Embeddable 8086 simulator, built as libsim86.a and libsim86.so by `./build lib`. This header is all a
+ * program needs: it doesn't depend on the simulator internals, and values only ever get added to its enums.
+ *
+ * Every machine owns its 1 MB of RAM, so different machines can run on different threads. Nothing here
+ * prints or exits: calls return a Sim86Err, runs return why they stopped.
+ */
+
+#define SIM86_API_VERSION 2 // Sim86_set_trace_file since 2
+#define SIM86_RAM_SIZE 0x100000
+#define SIM86_NO_IP UINT32_MAX
+
+typedef struct Sim86 Sim86;
+
+typedef enum {
+    Sim86Err_OK = 0,
+    Sim86Err_NO_MEMORY,
+    Sim86Err_OPEN,          // errno is set
+    Sim86Err_READ,          // errno is set
+    Sim86Err_TOO_BIG,       // Doesn't fit in RAM from its address
+    Sim86Err_INVALID,       // Unknown register, engine or CPU, or nothing to restore
+    Sim86Err_UNSUPPORTED,   // Not on this host (jit) or not with this engine (clocks)
+} Sim86Err;
+
+typedef enum {
+    Sim86Engine_OPCODES = 0, // Decode and run one opcode at a time
+    Sim86Engine_BLOCKS,      // Translated basic blocks
+    Sim86Engine_JIT,         // Translated basic blocks, hot ones compiled to native code (x86-64 hosts)
+} Sim86Engine;
+
+typedef enum {
+    Sim86Cpu_NONE = 0,  // Don't estimate clocks
+    Sim86Cpu_8086,
+    Sim86Cpu_8088,
+} Sim86Cpu;
+
+typedef enum {
+    Sim86Register_AX = 0,
+    Sim86Register_BX,
+    Sim86Register_CX,
+    Sim86Register_DX,
+    Sim86Register_SP,
+    Sim86Register_BP,
+    Sim86Register_SI,
+    Sim86Register_DI,
+    Sim86Register_ES,
+    Sim86Register_CS,
+    Sim86Register_SS,
+    Sim86Register_DS,
+    Sim86Register_IP,
+    Sim86Register_COUNT,
+} Sim86Register;
+
+// Why a run stopped. Faults and limits have the values of the `sim86 run` exit status
+typedef enum {
+    Sim86Stop_RUNNING = 0,
+    Sim86Stop_END,          // IP reached the end of the program
+    Sim86Stop_FAULT,        // See Sim86_fault
+    Sim86Stop_INSTRUCTIONS, // Instruction limit
+    Sim86Stop_CYCLES,       // Clock limit
+    Sim86Stop_UNTIL_IP,     // IP reached the until IP
+} Sim86Stop;
+
+typedef struct {
+    uint64_t maxInstructions;   // 0 for no limit
+    uint64_t maxClocks;         // 0 for no limit. Ignored unless clocks are estimated, see Sim86_set_cpu
+    uint32_t untilIp;           // In any code segment, SIM86_NO_IP for none
+} Sim86Limits;
+
+// One opcode just run
+typedef struct {
+    uint16_t cs, ip;            // Where it was
+    const char *text;           // As `sim86 trace` prints it, ex: `mov ax, 1`
+    const uint16_t *registers;  // After running it, indexed by Sim86Register
+    uint16_t flags;             // FLAGS register after running it
+    uint64_t clocks;            // Total so far, 0 unless clocks are estimated
+} Sim86TraceEvent;
+
+typedef void (*Sim86TraceFn)(void *user, const Sim86TraceEvent *event);
+
+int Sim86_api_version(void);
+
+// Creates a machine with no program. Returns Sim86Err_UNSUPPORTED if the engine can't run on this host
+Sim86Err Sim86_create(Sim86 **sim, Sim86Engine engine);
+
+void Sim86_destroy(Sim86 *sim);
+
+// Resets the machine, then places the program at 0000:0000, where it starts. It ends when IP reaches its
+// end, or the end of the segment if longer
+Sim86Err Sim86_load_program(Sim86 *sim, const void *code, size_t len);
+
+// Same as Sim86_load_program from a file. Whole pages are mapped copy on write instead of read
+Sim86Err Sim86_load_program_file(Sim86 *sim, const char *path);
+
+// Copies data anywhere in RAM, ex: tables or a framebuffer after the program
+Sim86Err Sim86_load_image(Sim86 *sim, uint32_t addr, const void *data, size_t len);
+
+// Remembers the whole state, to come back to it with Sim86_restore as many times as needed. Restoring only
+// copies back what was written since, so running the same program again costs microseconds
+Sim86Err Sim86_snapshot(Sim86 *sim);
+
+Sim86Err Sim86_restore(Sim86 *sim);
+
+// Estimates the clocks of every opcode, opcodes engine only. Sim86Cpu_NONE turns it off
+Sim86Err Sim86_set_cpu(Sim86 *sim, Sim86Cpu cpu);
+
+// Called after every opcode, fn NULL to remove it. While set, every engine runs one opcode at a time
+void Sim86_set_trace(Sim86 *sim, Sim86TraceFn fn, void *user);
+
+// Writes what `sim86 trace` prints for every opcode run, with its clocks if estimated, file NULL to stop.
+// The final registers are left to the caller. Native code doesn't trace, the jit engine then runs blocks
+void Sim86_set_trace_file(Sim86 *sim, FILE *file);
+
+// Runs until the program ends, it faults or a limit is reached
+Sim86Stop Sim86_run_limited(Sim86 *sim, const Sim86Limits *limits);
+
+// Runs at most n opcodes, 0 for no limit
+Sim86Stop Sim86_run(Sim86 *sim, uint64_t n);
+
+// Runs a single opcode
+Sim86Stop Sim86_step(Sim86 *sim);
+
+// Opcodes run and clocks estimated since the program was loaded
+uint64_t Sim86_instructions(const Sim86 *sim);
+
+uint64_t Sim86_clocks(const Sim86 *sim);
+
+// Why it faulted (ex: `Divide error`) and the opcode at cs:ip that did, or NULL if it didn't
+const char *Sim86_fault(const Sim86 *sim, uint16_t *cs, uint16_t *ip);
+
+// 0 for an unknown register
+uint16_t Sim86_get_register(const Sim86 *sim, Sim86Register reg);
+
+Sim86Err Sim86_set_register(Sim86 *sim, Sim86Register reg, uint16_t value);
+
+// FLAGS register, as PUSHF stores it
+uint16_t Sim86_get_flags(Sim86 *sim);
+
+void Sim86_set_flags(Sim86 *sim, uint16_t flags);
+
+// Linear addresses, the range can't go past the end of RAM
+Sim86Err Sim86_read_memory(const Sim86 *sim, uint32_t addr, void *dst, size_t len);
+
+Sim86Err Sim86_write_memory(Sim86 *sim, uint32_t addr, const void *src, size_t len);
+
+// Hash of the whole RAM, as `sim86 run --final-state` prints it
+uint64_t Sim86_checksum(const Sim86 *sim);
+
+const char *Sim86Err_name(Sim86Err err);
+
+const char *Sim86Stop_name(Sim86Stop stop);
+
+#endif //SIM86_LIBSIM86_H
@@ -1,12 +1,27 @@
 #include "memory.h"
 
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alu/alu.h"
+
 //#define INIT_SEGMENT_POS(n) (RAM_LOW_RESERVED + n*(SEGMENT_SIZE >> 4))
 #define INIT_SEGMENT(n) 0 // By convention (not rel 8086) we start every segment at 0
 #define MEM_MASK (RAM_SIZE-1)
 
-static uint8_t ram[RAM_SIZE];
+// Page aligned, so loaded images can be mapped straight over it. Zero pages are only backed once touched
+static uint8_t *ram_alloc(void) {
+    void *ram = mmap(NULL, RAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ram == MAP_FAILED ? NULL : ram;
+}
 
-Memory Memory_create(void) {
+// Power on state over ram
+static Memory memory_with_ram(uint8_t *ram) {
     Memory ret = {
             .ram = ram,
             .codeEnd = NULL,
@@ -26,38 +41,583 @@ Memory Memory_create(void) {
                     [Register_IP] = 0,
             },
             .flags = {0},
+            .lazyFlags = {0},
+            .opcodeCache = NULL,
+            .dirty = {0},
+            .dirtyShift = DIRTY_PAGE_DEFAULT_SHIFT,
+            .snapshot = NULL,
+            .halted = false,
+            .fault = NULL,
     };
     return ret;
 }
 
+Memory Memory_create(void) {
+    return memory_with_ram(ram_alloc());
+}
+
+void Memory_destroy(Memory *mem) {
+    Memory_drop_snapshot(mem);
+    if(mem->ram) {
+        munmap(mem->ram, RAM_SIZE);
+    }
+    mem->ram = NULL;
+    mem->codeEnd = NULL;
+}
+
+bool Memory_reset(Memory *mem) {
+    Memory_drop_snapshot(mem);
+
+    // Fresh zero pages over the old ones, whatever was written or mapped there
+    if(mmap(mem->ram, RAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        return false;
+    }
+
+    Memory fresh = memory_with_ram(mem->ram);
+    fresh.opcodeCache = mem->opcodeCache;
+    fresh.dirtyShift = mem->dirtyShift;
+    *mem = fresh;
+    if(mem->opcodeCache) {
+        OpcodeCache_clear(mem->opcodeCache);
+    }
+    return true;
+}
+
 inline uint8_t *Memory_segment_ptr(const Memory *mem, const Register segmentReg) {
     return &mem->ram[mem->registers[segmentReg] << 4];
 }
 
+inline uint32_t Memory_linear_addr(const Memory *mem, const Register segmentReg, const uint16_t addr) {
+    return ((mem->registers[segmentReg] << 4) + addr) & MEM_MASK; // 20 address lines, wraps at 1 MB
+}
+
 inline const uint8_t *Memory_code_ptr(const Memory *mem) {
-    return Memory_segment_ptr(mem, Register_CS) + mem->registers[Register_IP];
+    return Memory_addr_ptr(mem, Register_CS, mem->registers[Register_IP]);
 }
 
 inline uint8_t *Memory_addr_ptr(const Memory *mem, const Register segmentReg, const uint16_t addr) {
-    return Memory_segment_ptr(mem, segmentReg) + addr;
+    return &mem->ram[Memory_linear_addr(mem, segmentReg, addr)];
+}
+
+inline uint32_t Memory_code_addr(const Memory *mem) {
+    return (uint32_t) (Memory_code_ptr(mem) - mem->ram);
+}
+
+// Whether both bytes of a word are next to each other in RAM: anywhere but the last byte of the segment or of RAM
+static inline bool word_contiguous(const uint16_t addr, const uint32_t linearAddr) {
+    return addr != UINT16_MAX && linearAddr != MEM_MASK;
+}
+
+uint16_t Memory_read(const Memory *mem, const Register segmentReg, const uint16_t addr, const RegSize size) {
+    const uint32_t linearAddr = Memory_linear_addr(mem, segmentReg, addr);
+    const uint8_t *addrPtr = &mem->ram[linearAddr];
+    switch(size) {
+        case RegSize_BYTE: return *addrPtr;
+        case RegSize_WORD: {
+            if(word_contiguous(addr, linearAddr)) {
+                return (addrPtr[1] << 8) | addrPtr[0]; // Little endian
+            }
+            // High byte wraps to the start of the segment
+            return (mem->ram[Memory_linear_addr(mem, segmentReg, addr + 1)] << 8) | addrPtr[0];
+        }
+    }
+    assert(false);
+}
+
+// Returns false if out of memory, the page is then left untouched
+static bool snapshot_save_page(MemorySnapshot *snapshot, const uint8_t *src, const uint32_t page) {
+    if(snapshot->pages[page] == NULL) {
+        uint8_t *copy = malloc(SNAPSHOT_PAGE_SIZE);
+        if(copy == NULL) {
+            return false;
+        }
+        memcpy(copy, src + ((uint32_t) page << SNAPSHOT_PAGE_SHIFT), SNAPSHOT_PAGE_SIZE);
+        snapshot->pages[page] = copy;
+        snapshot->pagesSaved++;
+    } // Else it already holds the snapshot content
+
+    snapshot->touched[page / 64] |= (uint64_t) 1 << (page % 64);
+    return true;
+}
+
+static inline bool snapshot_touch(MemorySnapshot *snapshot, const uint8_t *src, const uint32_t addr, const uint32_t len) {
+    const uint32_t firstPage = addr >> SNAPSHOT_PAGE_SHIFT;
+    const uint32_t lastPage = (addr + len - 1) >> SNAPSHOT_PAGE_SHIFT;
+    for(uint32_t page = firstPage; page <= lastPage && page < SNAPSHOT_PAGE_COUNT; ++page) {
+        if(!(snapshot->touched[page / 64] & ((uint64_t) 1 << (page % 64)))
+           && !snapshot_save_page(snapshot, src, page)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Snapshot, dirty pages and opcode cache bookkeeping of writing len contiguous bytes at linearAddr.
+// Must come before the write, the snapshot copies the page first
+static void touch_linear(Memory *mem, const uint32_t linearAddr, const uint32_t len) {
+    if(mem->snapshot) {
+        // Copy on write. Without a copy the write can't be rolled back, so the machine stops after it
+        if(!snapshot_touch(mem->snapshot, mem->ram, linearAddr, len)) {
+            Memory_fault(mem, mem->registers[Register_IP], "Out of memory for the snapshot");
+        }
+    }
+
+    // Word writes may straddle two pages, block writes many
+    const uint32_t firstPage = linearAddr >> mem->dirtyShift;
+    const uint32_t lastPage = (linearAddr + len - 1) >> mem->dirtyShift;
+    if(lastPage < (uint32_t) (RAM_SIZE >> mem->dirtyShift)) {
+        for(uint32_t page = firstPage; page <= lastPage; ++page) {
+            mem->dirty[page / 64] |= (uint64_t) 1 << (page % 64);
+        }
+    }
+
+    if(mem->opcodeCache) {
+        // Self modifying code
+        OpcodeCache_invalidate(mem->opcodeCache, linearAddr, len);
+    }
+}
+
+// Writes size contiguous bytes at linearAddr
+static void write_linear(Memory *mem, const uint32_t linearAddr, const RegSize size, const uint16_t data) {
+    uint8_t *addrPtr = &mem->ram[linearAddr];
+    touch_linear(mem, linearAddr, size);
+
+    switch(size) {
+        case RegSize_BYTE: {
+            *addrPtr = data;
+        } break;
+        case RegSize_WORD: {
+            // Little endian
+            addrPtr[0] = data;
+            addrPtr[1] = data >> 8;
+        } break;
+    }
+}
+
+void Memory_write(Memory *mem, const Register segmentReg, const uint16_t addr, const RegSize size, const uint16_t data) {
+    const uint32_t linearAddr = Memory_linear_addr(mem, segmentReg, addr);
+    if(size == RegSize_BYTE || word_contiguous(addr, linearAddr)) {
+        write_linear(mem, linearAddr, size, data);
+    } else {
+        // High byte wraps to the start of the segment
+        write_linear(mem, linearAddr, RegSize_BYTE, data);
+        write_linear(mem, Memory_linear_addr(mem, segmentReg, addr + 1), RegSize_BYTE, data >> 8);
+    }
+}
+
+inline void Memory_push(Memory *mem, const uint16_t data) {
+    const uint16_t sp = mem->registers[Register_SP] - 2;
+    mem->registers[Register_SP] = sp;
+    const uint32_t linearAddr = Memory_linear_addr(mem, Register_SS, sp);
+    if(word_contiguous(sp, linearAddr)) {
+        write_linear(mem, linearAddr, RegSize_WORD, data);
+    } else {
+        Memory_write(mem, Register_SS, sp, RegSize_WORD, data);
+    }
+}
+
+inline uint16_t Memory_pop(Memory *mem) {
+    const uint16_t sp = mem->registers[Register_SP];
+    mem->registers[Register_SP] = sp + 2;
+    const uint32_t linearAddr = Memory_linear_addr(mem, Register_SS, sp);
+    if(word_contiguous(sp, linearAddr)) {
+        const uint8_t *addrPtr = &mem->ram[linearAddr];
+        return (addrPtr[1] << 8) | addrPtr[0]; // Little endian
+    }
+    return Memory_read(mem, Register_SS, sp, RegSize_WORD);
+}
+
+void Memory_copy(Memory *mem, const uint32_t dstAddr, const uint32_t srcAddr, const uint32_t len) {
+    assert(dstAddr + len <= RAM_SIZE && srcAddr + len <= RAM_SIZE);
+    if(len == 0) {
+        return;
+    }
+
+    touch_linear(mem, dstAddr, len);
+    memmove(&mem->ram[dstAddr], &mem->ram[srcAddr], len);
+}
+
+void Memory_write_bytes(Memory *mem, const uint32_t addr, const uint8_t *data, const uint32_t len) {
+    assert(addr + len <= RAM_SIZE);
+    if(len == 0) {
+        return;
+    }
+
+    touch_linear(mem, addr, len);
+    memcpy(&mem->ram[addr], data, len);
+}
+
+void Memory_fill(Memory *mem, const uint32_t addr, const RegSize size, const uint16_t data, const uint32_t count) {
+    const uint32_t len = count * size;
+    assert(addr + len <= RAM_SIZE);
+    if(len == 0) {
+        return;
+    }
+
+    touch_linear(mem, addr, len);
+    uint8_t *dst = &mem->ram[addr];
+    if(size == RegSize_BYTE || (data & 0xFF) == (data >> 8)) {
+        memset(dst, data & 0xFF, len);
+    } else {
+        for(uint32_t i = 0; i < len; i += 2) {
+            // Little endian
+            dst[i] = data;
+            dst[i + 1] = data >> 8;
+        }
+    }
 }
 
 inline bool Memory_code_ended(const Memory *mem) {
-    return Memory_code_ptr(mem) == mem->codeEnd;
+    return mem->halted || Memory_code_ptr(mem) == mem->codeEnd;
+}
+
+void Memory_fault(Memory *mem, const uint16_t ip, const char *reason) {
+    mem->halted = true;
+    mem->fault = reason;
+    mem->faultCs = mem->registers[Register_CS];
+    mem->faultIp = ip;
+}
+
+bool Memory_set_dirty_page_size(Memory *mem, const uint32_t pageSize) {
+    if(pageSize == 0 || (pageSize & (pageSize - 1))) {
+        return false;
+    }
+
+    const uint8_t shift = __builtin_ctz(pageSize);
+    if(shift < DIRTY_PAGE_MIN_SHIFT || shift > DIRTY_PAGE_MAX_SHIFT) {
+        return false;
+    }
+
+    mem->dirtyShift = shift;
+    Memory_clear_dirty(mem);
+    return true;
+}
+
+void Memory_clear_dirty(Memory *mem) {
+    memset(mem->dirty, 0, sizeof(mem->dirty));
+}
+
+// Next page at or after page with its dirty bit equal to set, or pageCount
+static uint32_t find_page(const Memory *mem, uint32_t page, const uint32_t pageCount, const bool set) {
+    while(page < pageCount) {
+        const uint64_t word = set ? mem->dirty[page / 64] : ~mem->dirty[page / 64];
+        const uint64_t bits = word >> (page % 64);
+        if(bits) {
+            page += __builtin_ctzll(bits);
+            return page < pageCount ? page : pageCount;
+        }
+        page = (page / 64 + 1) * 64;
+    }
+    return pageCount;
+}
+
+bool Memory_next_dirty(const Memory *mem, uint32_t *cursor, MemoryRange *range) {
+    const uint32_t pageCount = RAM_SIZE >> mem->dirtyShift;
+
+    const uint32_t first = find_page(mem, *cursor >> mem->dirtyShift, pageCount, true);
+    if(first == pageCount) {
+        *cursor = RAM_SIZE;
+        return false;
+    }
+    const uint32_t end = find_page(mem, first, pageCount, false);
+
+    range->start = first << mem->dirtyShift;
+    range->end = end << mem->dirtyShift;
+    *cursor = range->end;
+    return true;
+}
+
+MemoryLoadErr Memory_load_image(Memory *mem, const char *path, const uint32_t addr, uint32_t *len) {
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return MemoryLoadErr_OPEN;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        return MemoryLoadErr_READ;
+    }
+    if(addr > RAM_SIZE || (uint64_t) st.st_size > RAM_SIZE - addr) {
+        close(fd);
+        return MemoryLoadErr_TOO_BIG;
+    }
+    const uint32_t size = st.st_size;
+
+    // Whole pages at a page aligned address are mapped copy on write, and only read when touched
+    const uint32_t pageSize = sysconf(_SC_PAGESIZE);
+    uint32_t mapped = addr % pageSize == 0 ? size - size % pageSize : 0;
+    if(mapped && mmap(mem->ram + addr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        close(fd);
+        return MemoryLoadErr_READ;
+    }
+
+    // The rest is copied
+    while(mapped < size) {
+        const ssize_t n = pread(fd, mem->ram + addr + mapped, size - mapped, mapped);
+        if(n <= 0) {
+            close(fd);
+            return MemoryLoadErr_READ;
+        }
+        mapped += n;
+    }
+
+    close(fd);
+    *len = size;
+    return MemoryLoadErr_OK;
 }
 
-bool Memory_load_code(Memory *mem, FILE *codeSrc) {
+MemoryLoadErr Memory_load_code_image(Memory *mem, const char *path) {
     uint8_t *codeSegment = Memory_segment_ptr(mem, Register_CS);
 
-    int codeLen = (int) fread(codeSegment, 1, SEGMENT_SIZE, codeSrc);
-    if(codeLen < SEGMENT_SIZE && ferror(codeSrc)) {
+    uint32_t len;
+    const MemoryLoadErr err = Memory_load_image(mem, path, codeSegment - mem->ram, &len);
+    if(err) {
+        return err;
+    }
+
+    // IP can't go past the segment, the rest is there for other segments to reach
+    mem->codeEnd = codeSegment + (len < SEGMENT_SIZE ? len : SEGMENT_SIZE);
+    return MemoryLoadErr_OK;
+}
+
+uint64_t Memory_checksum(const Memory *mem) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for(size_t i = 0; i < RAM_SIZE; ++i) {
+        hash ^= mem->ram[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+uint16_t Flags_pack(const Flags *flags) {
+    return flags->carry
+           | flags->parity << 1
+           | flags->auxCarry << 2
+           | flags->zero << 3
+           | flags->sign << 4
+           | flags->overflow << 5
+           | flags->trap << 6
+           | flags->interrupt << 7
+           | flags->direction << 8
+           ;
+}
+
+Flags Flags_unpack(const uint16_t packed) {
+    Flags flags = {
+        .carry = packed & 1,
+        .parity = (packed >> 1) & 1,
+        .auxCarry = (packed >> 2) & 1,
+        .zero = (packed >> 3) & 1,
+        .sign = (packed >> 4) & 1,
+        .overflow = (packed >> 5) & 1,
+        .trap = (packed >> 6) & 1,
+        .interrupt = (packed >> 7) & 1,
+        .direction = (packed >> 8) & 1,
+    };
+    return flags;
+}
+
+uint16_t Flags_word(const Flags *flags) {
+    return 0xF002
+           | flags->carry
+           | flags->parity << 2
+           | flags->auxCarry << 4
+           | flags->zero << 6
+           | flags->sign << 7
+           | flags->trap << 8
+           | flags->interrupt << 9
+           | flags->direction << 10
+           | flags->overflow << 11
+           ;
+}
+
+Flags Flags_from_word(const uint16_t word) {
+    Flags flags = {
+        .carry = word & 1,
+        .parity = (word >> 2) & 1,
+        .auxCarry = (word >> 4) & 1,
+        .zero = (word >> 6) & 1,
+        .sign = (word >> 7) & 1,
+        .trap = (word >> 8) & 1,
+        .interrupt = (word >> 9) & 1,
+        .direction = (word >> 10) & 1,
+        .overflow = (word >> 11) & 1,
+    };
+    return flags;
+}
+
+bool Memory_snapshot(Memory *mem) {
+    Memory_drop_snapshot(mem);
+
+    MemorySnapshot *snapshot = calloc(1, sizeof(*snapshot));
+    if(snapshot == NULL) {
+        return false;
+    }
+
+    memcpy(snapshot->registers, mem->registers, sizeof(snapshot->registers));
+    snapshot->flags = mem->flags;
+    snapshot->lazyFlags = mem->lazyFlags;
+    snapshot->codeEnd = mem->codeEnd;
+    memcpy(snapshot->dirty, mem->dirty, sizeof(snapshot->dirty));
+
+    mem->snapshot = snapshot;
+    return true;
+}
+
+void Memory_restore(Memory *mem) {
+    MemorySnapshot *snapshot = mem->snapshot;
+    assert(snapshot);
+
+    for(uint32_t word = 0; word < SNAPSHOT_PAGE_COUNT / 64; ++word) {
+        for(uint64_t bits = snapshot->touched[word]; bits; bits &= bits - 1) {
+            const uint32_t page = word * 64 + __builtin_ctzll(bits);
+            const uint32_t addr = page << SNAPSHOT_PAGE_SHIFT;
+            memcpy(mem->ram + addr, snapshot->pages[page], SNAPSHOT_PAGE_SIZE);
+            if(mem->opcodeCache) {
+                OpcodeCache_invalidate(mem->opcodeCache, addr, SNAPSHOT_PAGE_SIZE);
+            }
+            snapshot->pagesRestored++;
+        }
+        snapshot->touched[word] = 0;
+    }
+
+    memcpy(mem->registers, snapshot->registers, sizeof(mem->registers));
+    mem->flags = snapshot->flags;
+    mem->lazyFlags = snapshot->lazyFlags;
+    mem->codeEnd = snapshot->codeEnd;
+    mem->halted = false;
+    memcpy(mem->dirty, snapshot->dirty, sizeof(mem->dirty));
+    snapshot->restores++;
+}
+
+void Memory_drop_snapshot(Memory *mem) {
+    MemorySnapshot *snapshot = mem->snapshot;
+    if(snapshot == NULL) {
+        return;
+    }
+
+    for(uint32_t page = 0; page < SNAPSHOT_PAGE_COUNT; ++page) {
+        free(snapshot->pages[page]);
+    }
+    free(snapshot);
+    mem->snapshot = NULL;
+}
+
+/*
+ * State file: STATE_MAGIC, registers (u16 LE each), packed flags (u16 LE), code end (u32 LE),
+ * then every non zero RAM page as its index (u32 LE) followed by its SNAPSHOT_PAGE_SIZE bytes.
+ */
+#define STATE_MAGIC "SIM86ST1"
+
+static void put_u16(uint8_t *dst, const uint16_t v) {
+    dst[0] = v;
+    dst[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *dst, const uint32_t v) {
+    put_u16(dst, v);
+    put_u16(dst + 2, v >> 16);
+}
+
+static uint16_t get_u16(const uint8_t *src) {
+    return src[0] | (src[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *src) {
+    return get_u16(src) | ((uint32_t) get_u16(src + 2) << 16);
+}
+
+#define STATE_HEADER_SIZE (sizeof(STATE_MAGIC) - 1 + 2 * Register_COUNT + 2 + 4)
+
+bool Memory_save_state(Memory *mem, FILE *out) {
+    // Lazy flags are not part of the file
+    Flags_sync(mem);
+
+    uint8_t header[STATE_HEADER_SIZE];
+    uint8_t *h = header;
+    memcpy(h, STATE_MAGIC, sizeof(STATE_MAGIC) - 1);
+    h += sizeof(STATE_MAGIC) - 1;
+    for(Register reg = 0; reg < Register_COUNT; ++reg, h += 2) {
+        put_u16(h, mem->registers[reg]);
+    }
+    put_u16(h, Flags_pack(&mem->flags));
+    put_u32(h + 2, mem->codeEnd ? (uint32_t) (mem->codeEnd - mem->ram) : 0);
+
+    if(fwrite(header, sizeof(header), 1, out) != 1) {
         return false;
     }
 
-    mem->codeEnd = codeSegment + codeLen;
+    static const uint8_t zeroPage[SNAPSHOT_PAGE_SIZE];
+    for(uint32_t page = 0; page < SNAPSHOT_PAGE_COUNT; ++page) {
+        const uint8_t *data = mem->ram + (page << SNAPSHOT_PAGE_SHIFT);
+        if(memcmp(data, zeroPage, SNAPSHOT_PAGE_SIZE) == 0) {
+            continue;
+        }
+
+        uint8_t index[4];
+        put_u32(index, page);
+        if(fwrite(index, sizeof(index), 1, out) != 1 || fwrite(data, SNAPSHOT_PAGE_SIZE, 1, out) != 1) {
+            return false;
+        }
+    }
+
+    return fflush(out) == 0;
+}
+
+bool Memory_load_state(Memory *mem, FILE *in) {
+    uint8_t header[STATE_HEADER_SIZE];
+    if(fread(header, sizeof(header), 1, in) != 1 || memcmp(header, STATE_MAGIC, sizeof(STATE_MAGIC) - 1) != 0) {
+        return false;
+    }
+
+    const uint8_t *h = header + sizeof(STATE_MAGIC) - 1;
+    const uint32_t codeEnd = get_u32(h + 2 * Register_COUNT + 2);
+    if(codeEnd > RAM_SIZE) {
+        return false;
+    }
+
+    // Pages go to scratch RAM first, so a truncated or invalid file leaves the machine as it was
+    uint8_t *ram = calloc(RAM_SIZE, 1);
+    if(ram == NULL) {
+        return false;
+    }
+
+    uint8_t index[4];
+    while(fread(index, sizeof(index), 1, in) == 1) {
+        const uint32_t page = get_u32(index);
+        if(page >= SNAPSHOT_PAGE_COUNT || fread(ram + (page << SNAPSHOT_PAGE_SHIFT), SNAPSHOT_PAGE_SIZE, 1, in) != 1) {
+            free(ram);
+            return false;
+        }
+    }
+    if(ferror(in)) {
+        free(ram);
+        return false;
+    }
+
+    Memory_drop_snapshot(mem);
+    memcpy(mem->ram, ram, RAM_SIZE);
+    free(ram);
+    for(Register reg = 0; reg < Register_COUNT; ++reg, h += 2) {
+        mem->registers[reg] = get_u16(h);
+    }
+    mem->flags = Flags_unpack(get_u16(h));
+    mem->lazyFlags.op = LazyFlagsOp_NONE;
+    mem->codeEnd = mem->ram + codeEnd;
+    mem->halted = false;
+
+    if(mem->opcodeCache) {
+        OpcodeCache_invalidate(mem->opcodeCache, 0, RAM_SIZE);
+    }
+    Memory_clear_dirty(mem);
     return true;
 }
 
+#undef STATE_MAGIC
+#undef STATE_HEADER_SIZE
+
 int Flags_serialize(const Flags *flags, char *dst) {
     char *ogDst = dst;
     if(flags->carry) *dst++ = 'C';
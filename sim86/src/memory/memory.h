@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "opcode/opcode.h"
+#include "opcode_cache/opcode_cache.h"
 
 #define RAM_SIZE 0x100000 // 1 MB
 #define SEGMENT_SIZE 0x10000
@@ -14,6 +15,11 @@
 
 #define FLAG_COUNT 9
 
+#define DIRTY_PAGE_MIN_SHIFT 8      // 256 B, smallest dirty page size
+#define DIRTY_PAGE_MAX_SHIFT 16     // 64 KB
+#define DIRTY_PAGE_DEFAULT_SHIFT 12 // 4 KB
+#define DIRTY_MAP_WORDS ((RAM_SIZE >> DIRTY_PAGE_MIN_SHIFT) / 64)
+
 typedef struct {
     bool
     overflow, direction, interrupt, trap,
@@ -21,25 +27,164 @@ typedef struct {
     carry;
 } Flags;
 
+typedef enum {
+    LazyFlagsOp_NONE = 0, // Flags are up to date
+    LazyFlagsOp_ADD,      // ADC too
+    LazyFlagsOp_SUB,      // SBB, CMP and NEG too
+    LazyFlagsOp_INC,      // Leaves carry untouched
+    LazyFlagsOp_DEC,      // Leaves carry untouched
+    LazyFlagsOp_LOGIC,    // Leaves auxCarry untouched
+    LazyFlagsOp_SHIFT,    // Leaves auxCarry untouched, carry and overflow are l and r
+} LazyFlagsOp;
+
+// Last flag setting operation. Flags are only computed when asked for (see alu.h)
+typedef struct {
+    LazyFlagsOp op;
+    RegSize size;
+    uint16_t l, r;
+    uint32_t result; // Not truncated to size, so the carry out is the bit above it
+} LazyFlags;
+
+#define SNAPSHOT_PAGE_SHIFT 12 // 4 KB copy on write pages
+#define SNAPSHOT_PAGE_SIZE (1 << SNAPSHOT_PAGE_SHIFT)
+#define SNAPSHOT_PAGE_COUNT (RAM_SIZE >> SNAPSHOT_PAGE_SHIFT)
+
+// Linear address range [start, end)
+typedef struct {
+    uint32_t start, end;
+} MemoryRange;
+
+/*
+ * Machine state at Memory_snapshot time. RAM is not copied: a page is saved
+ * right before its first write, so restoring only copies back written pages.
+ */
+typedef struct {
+    uint16_t registers[Register_COUNT];
+    Flags flags;
+    LazyFlags lazyFlags;
+    uint8_t *codeEnd;
+    uint64_t dirty[DIRTY_MAP_WORDS];
+    uint64_t touched[SNAPSHOT_PAGE_COUNT / 64]; // Pages written since the snapshot was taken or restored
+    uint8_t *pages[SNAPSHOT_PAGE_COUNT];         // Snapshot content of every page written since it was taken
+    uint64_t pagesSaved, pagesRestored, restores;
+} MemorySnapshot;
+
 typedef struct {
     uint8_t *ram;
     uint8_t *codeEnd; // Keep track of when to finish
     uint16_t registers[Register_COUNT];
-    Flags flags;
+    Flags flags;          // Stale while lazyFlags.op is set, read them through Flags_sync or the Flag_ getters
+    LazyFlags lazyFlags;
+    OpcodeCache *opcodeCache; // Optional. Invalidated on writes to cached code
+    uint64_t dirty[DIRTY_MAP_WORDS]; // Bit per page written since the last Memory_clear_dirty
+    uint8_t dirtyShift;              // Dirty page size is 1 << dirtyShift
+    MemorySnapshot *snapshot;        // Optional, see Memory_snapshot
+    bool halted;                     // Stopped by a fault, see Memory_fault
+    const char *fault;               // Why it halted, valid while halted
+    uint16_t faultCs, faultIp;       // Opcode that faulted
 } Memory;
 
+// Every memory owns its RAM, so independent machines can run on different threads.
+// RAM is NULL if it could not be allocated
 Memory Memory_create(void);
 
+// Frees the RAM and the snapshot. The opcode cache is owned by whoever set it
+void Memory_destroy(Memory *mem);
+
+// Back to the state of Memory_create, keeping the RAM mapping, dirty page size and opcode cache (emptied).
+// Returns false if the RAM could not be cleared, leaving it unusable
+bool Memory_reset(Memory *mem);
+
 uint8_t *Memory_segment_ptr(const Memory *mem, Register segmentReg);
 
 const uint8_t *Memory_code_ptr(const Memory *mem);
 
+// Physical address of segment:addr, 20 bits wide
+uint32_t Memory_linear_addr(const Memory *mem, Register segmentReg, uint16_t addr);
+
 uint8_t *Memory_addr_ptr(const Memory *mem, Register segmentReg, uint16_t addr);
 
+uint32_t Memory_code_addr(const Memory *mem);
+
+// Words at offset 0xFFFF take their high byte from the start of the segment, as on the 8086
+uint16_t Memory_read(const Memory *mem, Register segmentReg, uint16_t addr, RegSize size);
+
+void Memory_write(Memory *mem, Register segmentReg, uint16_t addr, RegSize size, uint16_t data);
+
+// Stack accesses skip the effective address calculation: SP moves by a word and SS:SP is accessed directly
+void Memory_push(Memory *mem, uint16_t data);
+
+uint16_t Memory_pop(Memory *mem);
+
+// Copies len bytes between linear addresses, as memmove does. Neither range may go past the end of RAM
+void Memory_copy(Memory *mem, uint32_t dstAddr, uint32_t srcAddr, uint32_t len);
+
+// Writes data count times from linear address addr, which may not go past the end of RAM
+void Memory_fill(Memory *mem, uint32_t addr, RegSize size, uint16_t data, uint32_t count);
+
+// Copies len bytes from outside the machine to linear address addr, which may not go past the end of RAM
+void Memory_write_bytes(Memory *mem, uint32_t addr, const uint8_t *data, uint32_t len);
+
+// Also true once halted
 bool Memory_code_ended(const Memory *mem);
 
-bool Memory_load_code(Memory *mem, FILE *code);
+// Records a fault of the opcode at CS:ip (ex: divide error) and halts, reason must be a static string.
+// There is no interrupt table to dispatch it to, every segment starts at 0 over the code. Nothing is
+// printed, whoever runs the machine reports it
+void Memory_fault(Memory *mem, uint16_t ip, const char *reason);
+
+// Page size must be a power of 2 between 1 << DIRTY_PAGE_MIN_SHIFT and 1 << DIRTY_PAGE_MAX_SHIFT. Clears the dirty pages
+bool Memory_set_dirty_page_size(Memory *mem, uint32_t pageSize);
+
+void Memory_clear_dirty(Memory *mem);
+
+// Finds the next run of dirty pages starting at or after *cursor, and moves the cursor past it.
+// Start with *cursor = 0. Returns false when there are no more
+bool Memory_next_dirty(const Memory *mem, uint32_t *cursor, MemoryRange *range);
+
+typedef enum {
+    MemoryLoadErr_OK = 0,
+    MemoryLoadErr_OPEN,     // errno is set
+    MemoryLoadErr_READ,     // errno is set
+    MemoryLoadErr_TOO_BIG,  // Doesn't fit in RAM from its address
+} MemoryLoadErr;
+
+// Places the whole file at linear address addr, storing its size in len. When addr is page aligned the file
+// is mapped copy on write instead of read, so large images cost nothing until touched
+MemoryLoadErr Memory_load_image(Memory *mem, const char *path, uint32_t addr, uint32_t *len);
+
+// Loads the whole file at the start of the CS segment. Code ends with the file or the segment
+MemoryLoadErr Memory_load_code_image(Memory *mem, const char *path);
+
+// Takes a snapshot of the current state, replacing the previous one. Returns false if out of memory
+bool Memory_snapshot(Memory *mem);
+
+// Rolls back to the snapshot. It stays in place, so it can be restored again
+void Memory_restore(Memory *mem);
+
+void Memory_drop_snapshot(Memory *mem);
+
+// Registers, flags and every non zero RAM page. Returns false on write error
+bool Memory_save_state(Memory *mem, FILE *out);
+
+// Replaces the whole state with one written by Memory_save_state. Returns false, leaving the state as it was,
+// if it is not valid or out of memory
+bool Memory_load_state(Memory *mem, FILE *in);
+
+// Hash of the whole RAM, to compare runs
+uint64_t Memory_checksum(const Memory *mem);
 
 int Flags_serialize(const Flags *flags, char *dst);
 
+// One bit per flag, in Flags_serialize order
+uint16_t Flags_pack(const Flags *flags);
+
+Flags Flags_unpack(uint16_t packed);
+
+// FLAGS register as PUSHF stores it, with the 8086 layout: unused bits read 1 except 3 and 5
+uint16_t Flags_word(const Flags *flags);
+
+// As POPF loads it, unused bits are ignored
+Flags Flags_from_word(uint16_t word);
+
 #endif //SIM86_MEMORY_H
@@ -19,3 +19,31 @@ inline int RegSize_max(const RegSize size) {
     }
     assert(false);
 }
+
+bool OpcodeType_is_string(const OpcodeType type) {
+    switch(type) {
+        case OpcodeType_MOVS:
+        case OpcodeType_CMPS:
+        case OpcodeType_SCAS:
+        case OpcodeType_LODS:
+        case OpcodeType_STOS: return true;
+        default: return false;
+    }
+}
+
+bool Opcode_transfers_control(const Opcode *opcode) {
+    switch(opcode->type) {
+        case OpcodeType_JMP:
+        case OpcodeType_CALL:
+        case OpcodeType_RET: return true;
+        case OpcodeType_PUSH: return false; // Its register is a source, even if decoded as dst
+        default:
+            // Writing CS (POP CS, MOV CS) moves to other code just as well
+            return opcode->dst.type == OpcodeArgType_IPINC
+                   || (opcode->dst.type == OpcodeArgType_REGISTER && opcode->dst.reg.reg == Register_CS);
+    }
+}
+
+bool Opcode_falls_through(const Opcode *opcode) {
+    return opcode->type != OpcodeType_JMP && opcode->type != OpcodeType_RET;
+}
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#define MAX_OPCODE_LEN 8 // Bytes, segment override and repeat prefixes included
+
 typedef enum {
     Register_AX = 0,
     Register_BX,
@@ -59,6 +61,8 @@ typedef struct {
     OpcodeAddrRegTerm terms[2];
     int16_t displacement;
     RegSize size;
+    Register segment;       // SS when based on BP, else DS, unless overridden
+    bool segmentOverride;   // Segment comes from a prefix
 } OpcodeMemAccess;
 
 typedef struct {
@@ -84,14 +88,34 @@ typedef struct {
     };
 } OpcodeArg;
 
+typedef enum {
+    OpcodeRep_NONE = 0,
+    OpcodeRep_REPNE,    // Repeat while ZF is clear
+    OpcodeRep_REP,      // REPE on compare opcodes: repeat while ZF is set
+} OpcodeRep;
+
 typedef struct {
     OpcodeType type;
     OpcodeArg dst, src;
     uint8_t len;
+    uint8_t encoding; // Encoding table row it was decoded with
+    bool segmentOverride; // Segment override prefix, already applied to memory arguments
+    Register segment;
+    OpcodeRep rep;        // Repeat prefix, only string opcodes use it
+    bool far;             // JMP, CALL or RET that loads (or saves) CS too
 } Opcode;
 
 RegSize OpcodeArg_size(const OpcodeArg *arg);
 
 int RegSize_max(RegSize size);
 
+// MOVS, CMPS, SCAS, LODS and STOS, which step SI and/or DI and can be repeated
+bool OpcodeType_is_string(OpcodeType type);
+
+// Branches, jumps, calls, returns and writes to CS: CS:IP may not be the next opcode once it runs, so they end blocks
+bool Opcode_transfers_control(const Opcode *opcode);
+
+// Whether the next opcode may run after it: every transfer but JMP and RET (calls come back)
+bool Opcode_falls_through(const Opcode *opcode);
+
 #endif //SIM86_OPCODE_DECODE_H
@@ -0,0 +1,113 @@
+#include "opcode_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_MASK (OPCODE_CACHE_SIZE - 1)
+#define ADDR_MASK (OPCODE_CACHE_ADDR_SPACE - 1)
+
+OpcodeCache *OpcodeCache_create(void) {
+    OpcodeCache *cache = calloc(1, sizeof(*cache));
+    if(cache == NULL) {
+        return NULL;
+    }
+
+    cache->codeLo = UINT32_MAX;
+    cache->codeHi = 0;
+    return cache;
+}
+
+void OpcodeCache_destroy(OpcodeCache *cache) {
+    free(cache);
+}
+
+const Opcode *OpcodeCache_get(OpcodeCache *cache, const uint32_t addr) {
+    const OpcodeCacheEntry *entry = &cache->entries[addr & CACHE_MASK];
+    if(entry->valid && entry->addr == addr) {
+        cache->hits++;
+        return &entry->opcode;
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+const Opcode *OpcodeCache_put(OpcodeCache *cache, const uint32_t addr, const Opcode *opcode) {
+    OpcodeCacheEntry *entry = &cache->entries[addr & CACHE_MASK];
+    entry->addr = addr;
+    entry->valid = true;
+    entry->opcode = *opcode;
+
+    if(addr < cache->codeLo) cache->codeLo = addr;
+    if(addr + opcode->len > cache->codeHi) cache->codeHi = addr + opcode->len;
+
+    for(uint32_t i = addr; i < addr + opcode->len; ++i) {
+        cache->codeMap[(i & ADDR_MASK) >> 3] |= 1 << (i & 7);
+    }
+
+    return &entry->opcode;
+}
+
+void OpcodeCache_watch(OpcodeCache *cache, const uint32_t addr, const uint32_t len) {
+    if(len == 0) {
+        return;
+    }
+
+    if(addr < cache->codeLo) cache->codeLo = addr;
+    if(addr + len > cache->codeHi) cache->codeHi = addr + len;
+
+    for(uint32_t i = addr; i < addr + len; ++i) {
+        cache->codeMap[(i & ADDR_MASK) >> 3] |= 1 << (i & 7);
+    }
+}
+
+void OpcodeCache_invalidate(OpcodeCache *cache, const uint32_t addr, const uint32_t len) {
+    if(addr >= cache->codeHi || addr + len <= cache->codeLo) {
+        return; // Fast path: write is not on cached code
+    }
+
+    for(uint32_t i = addr; i < addr + len; ++i) {
+        if(cache->codeMap[(i & ADDR_MASK) >> 3] & (1 << (i & 7))) {
+            cache->generation++;
+            break;
+        }
+    }
+
+    // Any opcode starting up to MAX_OPCODE_LEN - 1 bytes before the write may overlap it
+    const uint32_t first = addr >= MAX_OPCODE_LEN - 1 ? addr - (MAX_OPCODE_LEN - 1) : 0;
+    for(uint32_t opAddr = first; opAddr < addr + len; ++opAddr) {
+        OpcodeCacheEntry *entry = &cache->entries[opAddr & CACHE_MASK];
+        if(entry->valid && entry->addr == opAddr && opAddr + entry->opcode.len > addr) {
+            entry->valid = false;
+            cache->invalidations++;
+        }
+    }
+}
+
+void OpcodeCache_clear(OpcodeCache *cache) {
+    for(uint32_t i = 0; i < OPCODE_CACHE_SIZE; ++i) {
+        cache->entries[i].valid = false;
+    }
+
+    // Only the code map bytes ever set
+    if(cache->codeLo < cache->codeHi) {
+        const uint32_t first = (cache->codeLo & ADDR_MASK) >> 3;
+        const uint32_t last = ((cache->codeHi - 1) & ADDR_MASK) >> 3;
+        if(first <= last) {
+            memset(&cache->codeMap[first], 0, last - first + 1);
+        } else {
+            memset(cache->codeMap, 0, sizeof(cache->codeMap));
+        }
+    }
+    cache->codeLo = UINT32_MAX;
+    cache->codeHi = 0;
+    cache->generation++;
+}
+
+double OpcodeCache_hit_rate(const OpcodeCache *cache) {
+    const uint64_t total = cache->hits + cache->misses;
+    return total ? (double) cache->hits / (double) total : 0;
+}
+
+#undef CACHE_MASK
+#undef ADDR_MASK
@@ -0,0 +1,48 @@
+#ifndef SIM86_OPCODE_CACHE_H
+#define SIM86_OPCODE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "opcode/opcode.h"
+
+#define OPCODE_CACHE_SIZE 4096        // Entries, must be a power of 2
+#define OPCODE_CACHE_ADDR_SPACE 0x100000 // Linear addresses covered by the code map (1 MB)
+
+typedef struct {
+    uint32_t addr; // Linear address of the first opcode byte
+    bool valid;
+    Opcode opcode;
+} OpcodeCacheEntry;
+
+// Direct mapped cache of decoded opcodes, indexed by linear code address
+typedef struct {
+    OpcodeCacheEntry entries[OPCODE_CACHE_SIZE];
+    uint32_t codeLo, codeHi; // Linear address range [codeLo, codeHi) ever cached
+    uint8_t codeMap[OPCODE_CACHE_ADDR_SPACE / 8]; // Bit per byte ever cached as part of an opcode
+    uint64_t generation; // Bumped on every write landing on a code map byte
+    uint64_t hits, misses, invalidations;
+} OpcodeCache;
+
+OpcodeCache *OpcodeCache_create(void);
+
+void OpcodeCache_destroy(OpcodeCache *cache);
+
+// Returns NULL on miss
+const Opcode *OpcodeCache_get(OpcodeCache *cache, uint32_t addr);
+
+const Opcode *OpcodeCache_put(OpcodeCache *cache, uint32_t addr, const Opcode *opcode);
+
+// Treats [addr, addr + len) as code without caching anything, so writes to it bump the generation
+void OpcodeCache_watch(OpcodeCache *cache, uint32_t addr, uint32_t len);
+
+// Drops every cached opcode overlapping the written range [addr, addr + len)
+void OpcodeCache_invalidate(OpcodeCache *cache, uint32_t addr, uint32_t len);
+
+// Drops every cached opcode and forgets the code map, as if just created. Counters are kept and the
+// generation is bumped
+void OpcodeCache_clear(OpcodeCache *cache);
+
+double OpcodeCache_hit_rate(const OpcodeCache *cache);
+
+#endif //SIM86_OPCODE_CACHE_H
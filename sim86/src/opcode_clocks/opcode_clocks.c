@@ -0,0 +1,413 @@
+#include "opcode_clocks.h"
+
+#include "opcode_run/opcode_run.h"
+#include "alu/alu.h"
+
+#define WORD_TRANSFER_PENALTY 4
+
+typedef struct {
+    uint8_t notTaken, taken;
+} JumpClocks;
+
+static const JumpClocks jumpClocks[OpcodeType_COUNT] = {
+    [OpcodeType_JE]     = {4, 16},
+    [OpcodeType_JL]     = {4, 16},
+    [OpcodeType_JLE]    = {4, 16},
+    [OpcodeType_JB]     = {4, 16},
+    [OpcodeType_JBE]    = {4, 16},
+    [OpcodeType_JP]     = {4, 16},
+    [OpcodeType_JO]     = {4, 16},
+    [OpcodeType_JS]     = {4, 16},
+    [OpcodeType_JNE]    = {4, 16},
+    [OpcodeType_JNL]    = {4, 16},
+    [OpcodeType_JNLE]   = {4, 16},
+    [OpcodeType_JNB]    = {4, 16},
+    [OpcodeType_JNBE]   = {4, 16},
+    [OpcodeType_JNP]    = {4, 16},
+    [OpcodeType_JNO]    = {4, 16},
+    [OpcodeType_JNS]    = {4, 16},
+    [OpcodeType_LOOP]   = {5, 17},
+    [OpcodeType_LOOPZ]  = {6, 18},
+    [OpcodeType_LOOPNZ] = {5, 19},
+    [OpcodeType_JCXZ]   = {6, 18},
+    [OpcodeType_JMP]    = {15, 15},
+    [OpcodeType_CALL]   = {19, 19},
+};
+
+// Base clocks by operand form, plus word transfers to memory (a read-modify-write is 2)
+typedef struct {
+    uint8_t regReg, regMem, memReg, regImm, memImm;
+    uint8_t memRegTransfers, memImmTransfers;
+} FormClocks;
+
+static const FormClocks movClocks = {2, 8, 9,  4, 10, 1, 1};
+static const FormClocks aluClocks = {3, 9, 16, 4, 17, 2, 2};
+static const FormClocks cmpClocks = {3, 9, 9,  4, 10, 1, 1};
+
+// Single operand opcodes take the register or memory form. Shifts by CL take 4 more per bit
+static const FormClocks incClocks[2] = {{3, 0, 15, 0, 0, 2, 0}, {2, 0, 15, 0, 0, 2, 0}}; // Byte, word
+static const FormClocks negClocks = {3, 0, 16, 0, 0, 2, 0};
+static const FormClocks shiftClocks = {8, 0, 20, 2, 15, 2, 2};
+
+// Best case of each, they depend on the operands
+static const FormClocks mulClocks[2]  = {{70,  0, 76,  0, 0, 1, 0}, {118, 0, 124, 0, 0, 1, 0}};
+static const FormClocks imulClocks[2] = {{80,  0, 86,  0, 0, 1, 0}, {128, 0, 134, 0, 0, 1, 0}};
+static const FormClocks divClocks[2]  = {{80,  0, 86,  0, 0, 1, 0}, {144, 0, 150, 0, 0, 1, 0}};
+static const FormClocks idivClocks[2] = {{101, 0, 107, 0, 0, 1, 0}, {165, 0, 171, 0, 0, 1, 0}};
+
+// Only the register form, without operands
+static const FormClocks flagClocks = {2, 0, 0, 0, 0, 0, 0};
+
+static const FormClocks *form_clocks(const OpcodeType type, const RegSize size) {
+    const bool word = size == RegSize_WORD;
+    switch(type) {
+        case OpcodeType_MOV: return &movClocks;
+        case OpcodeType_ADD:
+        case OpcodeType_ADC:
+        case OpcodeType_SUB:
+        case OpcodeType_SBB:
+        case OpcodeType_AND:
+        case OpcodeType_OR:
+        case OpcodeType_XOR: return &aluClocks;
+        case OpcodeType_CMP: return &cmpClocks;
+        case OpcodeType_INC:
+        case OpcodeType_DEC: return &incClocks[word];
+        case OpcodeType_NEG: return &negClocks;
+        case OpcodeType_ROL:
+        case OpcodeType_ROR:
+        case OpcodeType_RCL:
+        case OpcodeType_RCR:
+        case OpcodeType_SHL:
+        case OpcodeType_SHR:
+        case OpcodeType_SAR: return &shiftClocks;
+        case OpcodeType_MUL: return &mulClocks[word];
+        case OpcodeType_IMUL: return &imulClocks[word];
+        case OpcodeType_DIV: return &divClocks[word];
+        case OpcodeType_IDIV: return &idivClocks[word];
+        case OpcodeType_CLC:
+        case OpcodeType_STC:
+        case OpcodeType_CMC:
+        case OpcodeType_CLD:
+        case OpcodeType_STD:
+        case OpcodeType_CLI:
+        case OpcodeType_STI: return &flagClocks;
+        default: return NULL;
+    }
+}
+
+static uint16_t ea_clocks(const OpcodeMemAccess *mem) {
+    const bool base = mem->terms[0].present;
+    const bool index = mem->terms[1].present;
+    // [bp] can only be encoded with a displacement
+    const bool disp = mem->displacement != 0 || (base && !index && mem->terms[0].reg.reg == Register_BP);
+
+    if(!base) {
+        return 6; // Direct address
+    }
+    if(!index) {
+        return disp ? 9 : 5;
+    }
+
+    // [bp+di] and [bx+si] take a clock less than [bp+si] and [bx+di]
+    const Register baseReg = mem->terms[0].reg.reg;
+    const Register indexReg = mem->terms[1].reg.reg;
+    const bool fast = (baseReg == Register_BP && indexReg == Register_DI) || (baseReg == Register_BX && indexReg == Register_SI);
+    return (fast ? 7 : 8) + (disp ? 4 : 0);
+}
+
+static uint16_t transfer_penalty(const OpcodeMemAccess *mem, const Memory *memory, const CpuModel model, const uint8_t transfers) {
+    if(mem->size != RegSize_WORD) {
+        return 0;
+    }
+
+    switch(model) {
+        case CpuModel_8086: return (OpcodeMemAccess_offset(mem, memory) & 1) ? transfers * WORD_TRANSFER_PENALTY : 0;
+        case CpuModel_8088: return transfers * WORD_TRANSFER_PENALTY;
+    }
+    return 0;
+}
+
+// Single run, and per element when repeated (plus REP_CLOCKS). Word transfers are per element
+typedef struct {
+    uint8_t once, repeated;
+    uint8_t siTransfers, diTransfers;
+} StringClocks;
+
+#define REP_CLOCKS 9
+
+static const StringClocks stringClocks[OpcodeType_COUNT] = {
+    [OpcodeType_MOVS] = {18, 17, 1, 1},
+    [OpcodeType_CMPS] = {22, 22, 1, 1},
+    [OpcodeType_SCAS] = {15, 15, 0, 1},
+    [OpcodeType_LODS] = {12, 13, 1, 0},
+    [OpcodeType_STOS] = {11, 10, 0, 1},
+};
+
+// Elements step by their size, so every one has the parity of the first
+static uint32_t string_penalty(const Opcode *opcode, const Memory *memory, const CpuModel model) {
+    const StringClocks *string = &stringClocks[opcode->type];
+    if(OpcodeArg_size(&opcode->dst) != RegSize_WORD) {
+        return 0;
+    }
+
+    switch(model) {
+        case CpuModel_8086: return WORD_TRANSFER_PENALTY * (
+                (memory->registers[Register_SI] & 1) * string->siTransfers
+                + (memory->registers[Register_DI] & 1) * string->diTransfers);
+        case CpuModel_8088: return WORD_TRANSFER_PENALTY * (string->siTransfers + string->diTransfers);
+    }
+    return 0;
+}
+
+static OpcodeClocks string_clocks(const Opcode *opcode, const Memory *memory, const CpuModel model, const uint16_t reps) {
+    const StringClocks *string = &stringClocks[opcode->type];
+    const uint32_t penalty = string_penalty(opcode, memory, model);
+
+    OpcodeClocks clocks = {0};
+    if(opcode->rep == OpcodeRep_NONE) {
+        clocks.base = string->once;
+        clocks.penalty = penalty;
+    } else {
+        clocks.base = REP_CLOCKS + string->repeated * reps;
+        clocks.penalty = penalty * reps;
+    }
+    if(opcode->segmentOverride) {
+        clocks.ea = 2; // Segment override prefix
+    }
+    return clocks;
+}
+
+// Register (or no operand), segment register, memory and immediate forms, then the far ones of RET.
+// Every one moves a word through SS:SP, two if far
+typedef struct {
+    uint8_t reg, seg, mem, imm;
+    uint8_t far, farImm;
+} StackClocks;
+
+static const StackClocks stackClocks[OpcodeType_COUNT] = {
+    [OpcodeType_PUSH]  = {11, 10, 16, 0,  0,  0},
+    [OpcodeType_POP]   = {8,  8,  17, 0,  0,  0},
+    [OpcodeType_PUSHF] = {10, 0,  0,  0,  0,  0},
+    [OpcodeType_POPF]  = {8,  0,  0,  0,  0,  0},
+    [OpcodeType_RET]   = {8,  0,  0,  12, 18, 17},
+};
+
+// Jumps and calls without an IPINC: near through a register or memory, far direct or through memory.
+// Calls also push the return address, two words if far
+typedef struct {
+    uint8_t reg, mem, far, farMem;
+} BranchClocks;
+
+static const BranchClocks branchClocks[OpcodeType_COUNT] = {
+    [OpcodeType_JMP]  = {11, 18, 15, 24},
+    [OpcodeType_CALL] = {16, 21, 28, 37},
+};
+
+// Pushes write below SP and pops read at SP, both with its parity
+static uint32_t stack_penalty(const Memory *memory, const CpuModel model) {
+    switch(model) {
+        case CpuModel_8086: return (memory->registers[Register_SP] & 1) * WORD_TRANSFER_PENALTY;
+        case CpuModel_8088: return WORD_TRANSFER_PENALTY;
+    }
+    return 0;
+}
+
+static OpcodeClocks stack_clocks(const Opcode *opcode, const Memory *memory, const CpuModel model) {
+    const StackClocks *stack = &stackClocks[opcode->type];
+    const OpcodeArg *arg = &opcode->dst;
+
+    OpcodeClocks clocks = {.base = stack->reg, .penalty = stack_penalty(memory, model)};
+    if(opcode->far) {
+        clocks.base = arg->type == OpcodeArgType_IMMEDIATE ? stack->farImm : stack->far;
+        clocks.penalty *= 2;
+        return clocks;
+    }
+
+    switch(arg->type) {
+        case OpcodeArgType_REGISTER: {
+            if(arg->reg.reg >= Register_ES && arg->reg.reg <= Register_DS) {
+                clocks.base = stack->seg;
+            }
+        } break;
+        case OpcodeArgType_MEMORY: {
+            clocks.base = stack->mem;
+            clocks.ea = ea_clocks(&arg->mem) + (opcode->segmentOverride ? 2 : 0);
+            clocks.penalty += transfer_penalty(&arg->mem, memory, model, 1);
+        } break;
+        case OpcodeArgType_IMMEDIATE: clocks.base = stack->imm; break;
+        default: break;
+    }
+    return clocks;
+}
+
+static OpcodeClocks branch_clocks(const Opcode *opcode, const Memory *memory, const CpuModel model) {
+    const BranchClocks *branch = &branchClocks[opcode->type];
+    const OpcodeArg *arg = &opcode->dst;
+    const uint8_t words = opcode->far ? 2 : 1;
+
+    OpcodeClocks clocks = {0};
+    if(opcode->type == OpcodeType_CALL) {
+        clocks.penalty = words * stack_penalty(memory, model);
+    }
+    if(arg->type == OpcodeArgType_MEMORY) {
+        clocks.base = opcode->far ? branch->farMem : branch->mem;
+        clocks.ea = ea_clocks(&arg->mem) + (opcode->segmentOverride ? 2 : 0);
+        clocks.penalty += transfer_penalty(&arg->mem, memory, model, words);
+    } else {
+        clocks.base = opcode->far ? branch->far : branch->reg;
+    }
+    return clocks;
+}
+
+static bool is_accumulator(const OpcodeArg *arg) {
+    return arg->type == OpcodeArgType_REGISTER && arg->reg.reg == Register_AX;
+}
+
+OpcodeClocks OpcodeClocks_estimate(const Opcode *opcode, const Memory *memory, const CpuModel model) {
+    OpcodeClocks clocks = {0};
+
+    if(opcode->dst.type == OpcodeArgType_IPINC) {
+        clocks.base = jumpClocks[opcode->type].notTaken;
+        if(opcode->type == OpcodeType_CALL) {
+            clocks.penalty = stack_penalty(memory, model); // Return address
+        }
+        return clocks;
+    }
+
+    if(OpcodeType_is_string(opcode->type)) {
+        return string_clocks(opcode, memory, model, memory->registers[Register_CX]);
+    }
+
+    if(stackClocks[opcode->type].reg) {
+        return stack_clocks(opcode, memory, model);
+    }
+
+    if(branchClocks[opcode->type].reg) {
+        return branch_clocks(opcode, memory, model);
+    }
+
+    const FormClocks *form = form_clocks(opcode->type, opcode->dst.type ? OpcodeArg_size(&opcode->dst) : RegSize_BYTE);
+    if(form == NULL) {
+        return clocks;
+    }
+
+    const OpcodeArg *dst = &opcode->dst;
+    const OpcodeArg *src = &opcode->src;
+
+    if(dst->type == OpcodeArgType_MEMORY) {
+        const bool imm = src->type == OpcodeArgType_IMMEDIATE;
+        const OpcodeMemAccess *mem = &dst->mem;
+
+        if(opcode->type == OpcodeType_MOV && !mem->terms[0].present && is_accumulator(src)) {
+            clocks.base = 10; // mov [addr], acc has its own encoding without effective address
+        } else {
+            clocks.base = imm ? form->memImm : form->memReg;
+            clocks.ea = ea_clocks(mem);
+        }
+        clocks.penalty = transfer_penalty(mem, memory, model, imm ? form->memImmTransfers : form->memRegTransfers);
+
+    } else if(src->type == OpcodeArgType_MEMORY) {
+        const OpcodeMemAccess *mem = &src->mem;
+
+        if(opcode->type == OpcodeType_MOV && !mem->terms[0].present && is_accumulator(dst)) {
+            clocks.base = 10; // mov acc, [addr]
+        } else {
+            clocks.base = form->regMem;
+            clocks.ea = ea_clocks(mem);
+        }
+        clocks.penalty = transfer_penalty(mem, memory, model, 1);
+
+    } else if(src->type == OpcodeArgType_IMMEDIATE) {
+        clocks.base = form->regImm;
+
+    } else {
+        clocks.base = form->regReg;
+    }
+
+    if(form == &shiftClocks && src->type == OpcodeArgType_REGISTER) {
+        clocks.base += 4 * (memory->registers[Register_CX] & UINT8_MAX); // By CL
+    }
+
+    if(opcode->segmentOverride && (dst->type == OpcodeArgType_MEMORY || src->type == OpcodeArgType_MEMORY)) {
+        clocks.ea += 2; // Segment override prefix
+    }
+
+    return clocks;
+}
+
+void OpcodeClocks_jump_taken(OpcodeClocks *clocks, const Opcode *opcode) {
+    clocks->base = jumpClocks[opcode->type].taken;
+}
+
+void OpcodeClocks_repeated(OpcodeClocks *clocks, const Opcode *opcode, const Memory *memory, const CpuModel model, const uint16_t reps) {
+    if(OpcodeType_is_string(opcode->type) && opcode->rep != OpcodeRep_NONE) {
+        *clocks = string_clocks(opcode, memory, model, reps);
+    }
+}
+
+// Whether the branch just run was taken, even to the next opcode. Branches leave flags alone, and loops
+// have already decremented CX
+static bool branch_taken(const Opcode *opcode, Memory *memory) {
+    const uint16_t cx = memory->registers[Register_CX];
+    switch(opcode->type) {
+        case OpcodeType_JE: return Cond_JE(memory);
+        case OpcodeType_JL: return Cond_JL(memory);
+        case OpcodeType_JLE: return Cond_JLE(memory);
+        case OpcodeType_JB: return Cond_JB(memory);
+        case OpcodeType_JBE: return Cond_JBE(memory);
+        case OpcodeType_JP: return Cond_JP(memory);
+        case OpcodeType_JO: return Cond_JO(memory);
+        case OpcodeType_JS: return Cond_JS(memory);
+        case OpcodeType_JNE: return Cond_JNE(memory);
+        case OpcodeType_JNL: return Cond_JNL(memory);
+        case OpcodeType_JNLE: return Cond_JNLE(memory);
+        case OpcodeType_JNB: return Cond_JNB(memory);
+        case OpcodeType_JNBE: return Cond_JNBE(memory);
+        case OpcodeType_JNP: return Cond_JNP(memory);
+        case OpcodeType_JNO: return Cond_JNO(memory);
+        case OpcodeType_JNS: return Cond_JNS(memory);
+        case OpcodeType_LOOP: return cx;
+        case OpcodeType_LOOPZ: return cx && Flag_zero(memory);
+        case OpcodeType_LOOPNZ: return cx && !Flag_zero(memory);
+        case OpcodeType_JCXZ: return !cx;
+        default: return true; // JMP and CALL
+    }
+}
+
+inline void OpcodeClocks_run(OpcodeClocks *clocks, const Opcode *opcode, Memory *memory, const CpuModel model) {
+    const uint16_t count = memory->registers[Register_CX];
+    memory->registers[Register_IP] += opcode->len;
+    Opcode_exec(opcode, memory);
+
+    if(opcode->dst.type == OpcodeArgType_IPINC && branch_taken(opcode, memory)) {
+        OpcodeClocks_jump_taken(clocks, opcode);
+    }
+    if(opcode->rep != OpcodeRep_NONE) {
+        OpcodeClocks_repeated(clocks, opcode, memory, model, count - memory->registers[Register_CX]);
+    }
+}
+
+inline uint32_t OpcodeClocks_total(const OpcodeClocks *clocks) {
+    return clocks->base + clocks->ea + clocks->penalty;
+}
+
+void OpcodeClocks_trace(const OpcodeClocks *clocks, const uint64_t totalClocks, FILE *trace) {
+    fprintf(trace, " Clocks: +%u = %llu", OpcodeClocks_total(clocks), (unsigned long long) totalClocks);
+    if(clocks->ea || clocks->penalty) {
+        fprintf(trace, " (%u", clocks->base);
+        if(clocks->ea) fprintf(trace, " + %uea", clocks->ea);
+        if(clocks->penalty) fprintf(trace, " + %up", clocks->penalty);
+        fputc(')', trace);
+    }
+}
+
+const char *CpuModel_name(const CpuModel model) {
+    switch(model) {
+        case CpuModel_8086: return "8086";
+        case CpuModel_8088: return "8088";
+    }
+    return "?";
+}
+
+#undef WORD_TRANSFER_PENALTY
+#undef REP_CLOCKS
@@ -0,0 +1,50 @@
+#ifndef SIM86_OPCODE_CLOCKS_H
+#define SIM86_OPCODE_CLOCKS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "opcode/opcode.h"
+#include "memory/memory.h"
+
+typedef enum {
+    CpuModel_8086 = 0, // 16 bit bus: word transfers to odd addresses take an extra bus cycle
+    CpuModel_8088,     // 8 bit bus: every word transfer takes an extra bus cycle
+} CpuModel;
+
+typedef struct {
+    uint32_t base;     // Opcode clocks
+    uint16_t ea;       // Effective address calculation clocks
+    uint32_t penalty;  // Word transfer penalty clocks
+} OpcodeClocks;
+
+/*
+ * Estimates the clocks of an opcode, following the 8086 family user's manual timings.
+ * Memory must be the state before running the opcode. Jumps are estimated as not taken,
+ * call OpcodeClocks_jump_taken once it is known they were.
+ */
+OpcodeClocks OpcodeClocks_estimate(const Opcode *opcode, const Memory *memory, CpuModel model);
+
+// Replaces the jump not taken clocks with the taken ones
+void OpcodeClocks_jump_taken(OpcodeClocks *clocks, const Opcode *opcode);
+
+/*
+ * Repeated string opcodes are estimated for CX elements, as if run one at a time. Replaces them with
+ * the clocks of reps elements once known, REPE/REPNE may stop early. Memory can be the state after
+ * running it: SI and DI keep their parity.
+ */
+void OpcodeClocks_repeated(OpcodeClocks *clocks, const Opcode *opcode, const Memory *memory, CpuModel model, uint16_t reps);
+
+// Runs the opcode, advancing IP, after its clocks were estimated. Then corrects them for a taken jump or
+// the repetitions it really did
+void OpcodeClocks_run(OpcodeClocks *clocks, const Opcode *opcode, Memory *memory, CpuModel model);
+
+uint32_t OpcodeClocks_total(const OpcodeClocks *clocks);
+
+// Prints `Clocks: +13 = 120 (8 + 5ea)`
+void OpcodeClocks_trace(const OpcodeClocks *clocks, uint64_t totalClocks, FILE *trace);
+
+const char *CpuModel_name(CpuModel model);
+
+#endif //SIM86_OPCODE_CLOCKS_H
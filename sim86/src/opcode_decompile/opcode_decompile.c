@@ -62,32 +62,88 @@ const char *OpcodeRegAccess_decompile(const OpcodeRegAccess *regAccess) {
     }
 }
 
+// Appends src without its terminator
+static inline char *append_str(char *dst, const char *src) {
+    while(*src) {
+        *dst++ = *src++;
+    }
+    return dst;
+}
+
+// Appends value in decimal, two digits at a time
+static char *append_uint(char *dst, uint32_t value) {
+    static const char digitPairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+    char buf[10];
+    char *end = buf + sizeof(buf);
+    char *start = end;
+
+    while(value >= 100) {
+        const uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--start = digitPairs[pair + 1];
+        *--start = digitPairs[pair];
+    }
+    if(value >= 10) {
+        *--start = digitPairs[value * 2 + 1];
+        *--start = digitPairs[value * 2];
+    } else {
+        *--start = (char) ('0' + value);
+    }
+
+    while(start < end) {
+        *dst++ = *start++;
+    }
+    return dst;
+}
+
+static inline char *append_int(char *dst, const int32_t value) {
+    if(value < 0) {
+        *dst++ = '-';
+        return append_uint(dst, -(uint32_t) value);
+    }
+    return append_uint(dst, value);
+}
+
 int OpcodeMemAccess_decompile(const OpcodeMemAccess *memAccess, const bool explicitSize, char *dst) {
     const char *ogDst = dst;
     const OpcodeAddrRegTerm *terms = memAccess->terms;
     const int16_t displacement = memAccess->displacement;
 
     if(explicitSize) {
-        dst += sprintf(dst, "%s ", RegSize_decompile(memAccess->size));
+        dst = append_str(dst, RegSize_decompile(memAccess->size));
+        *dst++ = ' ';
     }
 
     *dst++ = '[';
 
+    if(memAccess->segmentOverride) {
+        const OpcodeRegAccess segment = {memAccess->segment, RegSize_WORD, RegOffset_NONE};
+        dst = append_str(dst, OpcodeRegAccess_decompile(&segment));
+        *dst++ = ':';
+    }
+
     if(terms[0].present) {
-        dst += sprintf(dst, "%s", OpcodeRegAccess_decompile(&memAccess->terms[0].reg));
+        dst = append_str(dst, OpcodeRegAccess_decompile(&memAccess->terms[0].reg));
     }
 
     if(terms[1].present) {
-        dst += sprintf(dst, "+%s", OpcodeRegAccess_decompile(&memAccess->terms[1].reg));
+        *dst++ = '+';
+        dst = append_str(dst, OpcodeRegAccess_decompile(&memAccess->terms[1].reg));
     }
 
-    if(displacement) {
-        if(!terms[0].present && !terms[1].present) {
-            dst += sprintf(dst, "%d", displacement);
-        } else if(displacement > 0) {
-            dst += sprintf(dst, "+%d", displacement);
+    if(!terms[0].present && !terms[1].present) {
+        dst = append_int(dst, displacement); // Direct address, even 0
+    } else if(displacement) {
+        if(displacement > 0) {
+            *dst++ = '+';
+            dst = append_uint(dst, displacement);
         } else {
-            dst += sprintf(dst, "-%d", -displacement);
+            *dst++ = '-';
+            dst = append_uint(dst, -displacement);
         }
     }
 
@@ -106,28 +162,40 @@ const char *RegSize_decompile(const RegSize regSize) {
 }
 
 int OpcodeImmAccess_decompile(const OpcodeImmAccess *immAccess, const bool explicitSize, char *dst) {
-    const char *size = explicitSize ? RegSize_decompile(immAccess->size) : "";
-    const char *ws = explicitSize ? " " : "";
+    const char *ogDst = dst;
+    if(explicitSize) {
+        dst = append_str(dst, RegSize_decompile(immAccess->size));
+        *dst++ = ' ';
+    }
     // We decide to output all immediate values as unsigned by convention
     const int value = immAccess->size == RegSize_BYTE ? (uint8_t) immAccess->value : (uint16_t) immAccess->value;
-    return sprintf(dst, "%s%s%d", size, ws, value);
+    dst = append_uint(dst, value);
+    *dst = 0;
+    return (int) (dst - ogDst);
 }
 
 int OpcodeIpincAccess_decompile(const OpcodeImmAccess *ipincAccess, char *dst) {
-    // ipinc = increment after jmp instruction
-    const int ipinc = ipincAccess->value + 2;
+    const char *ogDst = dst;
+    // ipinc = increment after jmp instruction, which is one opcode byte and the increment long
+    const int ipinc = ipincAccess->value + 1 + ipincAccess->size;
 
+    *dst++ = '$';
     if(ipinc >= 0) {
-        return sprintf(dst, "$+%d", ipinc);
-    } else {
-        return sprintf(dst, "$%d", ipinc);
+        *dst++ = '+';
     }
+    dst = append_int(dst, ipinc);
+    *dst = 0;
+    return (int) (dst - ogDst);
 }
 
 int OpcodeArg_decompile(const OpcodeArg *arg, bool explicitSize, char *dst) {
     switch(arg->type) {
         case OpcodeArgType_NONE: return 0;
-        case OpcodeArgType_REGISTER: return sprintf(dst, "%s", OpcodeRegAccess_decompile(&arg->reg));
+        case OpcodeArgType_REGISTER: {
+            char *end = append_str(dst, OpcodeRegAccess_decompile(&arg->reg));
+            *end = 0;
+            return (int) (end - dst);
+        }
         case OpcodeArgType_MEMORY: return OpcodeMemAccess_decompile(&arg->mem, explicitSize, dst);
         case OpcodeArgType_IMMEDIATE: return OpcodeImmAccess_decompile(&arg->imm, explicitSize, dst);
         case OpcodeArgType_IPINC: return OpcodeIpincAccess_decompile(&arg->ipinc, dst);
@@ -135,15 +203,91 @@ int OpcodeArg_decompile(const OpcodeArg *arg, bool explicitSize, char *dst) {
     }
 }
 
+static bool OpcodeType_is_shift(const OpcodeType type) {
+    switch(type) {
+        case OpcodeType_ROL:
+        case OpcodeType_ROR:
+        case OpcodeType_RCL:
+        case OpcodeType_RCR:
+        case OpcodeType_SHL:
+        case OpcodeType_SHR:
+        case OpcodeType_SAR: return true;
+        default: return false;
+    }
+}
+
+// `rep movsb`: operands are implicit, the size goes in the name
+static char *append_string_opcode(char *dst, const Opcode *opcode) {
+    dst += OpcodeType_decompile(opcode->type, dst);
+    *dst++ = OpcodeArg_size(&opcode->dst) == RegSize_WORD ? 'w' : 'b';
+    *dst = 0;
+    return dst;
+}
+
+static const char *OpcodeRep_decompile(const OpcodeRep rep, const OpcodeType type) {
+    const bool compare = type == OpcodeType_CMPS || type == OpcodeType_SCAS;
+    switch(rep) {
+        case OpcodeRep_NONE: return "";
+        case OpcodeRep_REPNE: return "repne ";
+        case OpcodeRep_REP: return compare ? "repe " : "rep ";
+    }
+    assert(false);
+}
+
+// `jmp 4660:22136`, `call far [bx]`, `retf 4`
+static char *append_far_opcode(char *dst, const Opcode *opcode) {
+    dst += OpcodeType_decompile(opcode->type, dst);
+    if(opcode->type == OpcodeType_RET) {
+        *dst++ = 'f';
+        if(opcode->dst.type == OpcodeArgType_IMMEDIATE) {
+            *dst++ = ' ';
+            dst += OpcodeImmAccess_decompile(&opcode->dst.imm, false, dst);
+        }
+    } else if(opcode->dst.type == OpcodeArgType_IMMEDIATE) {
+        *dst++ = ' ';
+        dst += OpcodeImmAccess_decompile(&opcode->src.imm, false, dst);
+        *dst++ = ':';
+        dst += OpcodeImmAccess_decompile(&opcode->dst.imm, false, dst);
+    } else {
+        dst = append_str(dst, " far ");
+        dst += OpcodeMemAccess_decompile(&opcode->dst.mem, false, dst);
+    }
+    *dst = 0;
+    return dst;
+}
+
 int Opcode_decompile(const Opcode *opcode, char *dst) {
     char *ogDst = dst;
+    const bool string = OpcodeType_is_string(opcode->type);
 
+    // Single operand opcodes and shifts by CL don't get the size from a register either
     const bool explicitSize =
             (opcode->dst.type == OpcodeArgType_MEMORY && opcode->src.type == OpcodeArgType_IMMEDIATE)
             || (opcode->src.type == OpcodeArgType_MEMORY && opcode->dst.type == OpcodeArgType_IMMEDIATE)
+            || (opcode->dst.type == OpcodeArgType_MEMORY && opcode->src.type == OpcodeArgType_NONE)
+            || (opcode->dst.type == OpcodeArgType_MEMORY && OpcodeType_is_shift(opcode->type))
     ;
 
+    // Without a memory argument to carry it, the override is printed as a prefix
+    const bool memoryArg = opcode->dst.type == OpcodeArgType_MEMORY || opcode->src.type == OpcodeArgType_MEMORY;
+    if(opcode->segmentOverride && (string || !memoryArg)) {
+        const OpcodeRegAccess segment = {opcode->segment, RegSize_WORD, RegOffset_NONE};
+        dst = append_str(dst, OpcodeRegAccess_decompile(&segment));
+        *dst++ = ' ';
+    }
+
+    dst = append_str(dst, OpcodeRep_decompile(opcode->rep, opcode->type));
+    if(string) {
+        return (int) (append_string_opcode(dst, opcode) - ogDst);
+    }
+    if(opcode->far) {
+        return (int) (append_far_opcode(dst, opcode) - ogDst);
+    }
+
     dst += OpcodeType_decompile(opcode->type, dst);
+    if(opcode->type == OpcodeType_JMP && opcode->dst.type == OpcodeArgType_IPINC && opcode->dst.ipinc.size == RegSize_WORD) {
+        dst = append_str(dst, " near"); // Assemblers pick the short form whenever it fits
+    }
 
     if(opcode->dst.type != OpcodeArgType_NONE) {
         *dst++ = ' ';
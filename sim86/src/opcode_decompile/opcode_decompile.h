@@ -7,8 +7,9 @@
 #include "opcode/opcode.h"
 
 #define MAX_OP_NAME_LEN 10 // Example: SEGMENT
-#define MAX_OP_ARG_LEN 30  // Example: `word [bp + di - 10044]\0`
-#define MAX_OP_LEN (MAX_OP_NAME_LEN + 2*MAX_OP_ARG_LEN)
+#define MAX_OP_ARG_LEN 33  // Example: `word [es:bp + di - 10044]\0`
+#define MAX_OP_PREFIX_LEN 9 // Example: `es repne `
+#define MAX_OP_LEN (MAX_OP_PREFIX_LEN + MAX_OP_NAME_LEN + 2*MAX_OP_ARG_LEN)
 
 int OpcodeType_decompile(OpcodeType type, char *dst);
 
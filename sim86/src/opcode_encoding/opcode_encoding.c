@@ -10,6 +10,12 @@
  * d = 0: Instruction source is specified in REG field.
  * d = 1: Instruction destination is specified in REG field.
  *
+ * v = 0: Shift/rotate count is one.
+ * v = 1: Shift/rotate count is specified in CL register.
+ *
+ * z = 0: Repeat prefix stops once the zero flag is set (REPNE).
+ * z = 1: Repeat prefix stops once the zero flag is clear (REP, REPE).
+ *
  * mod = 00: Memory Mode, no displacement follows (expect R/M = 110, then 16 bit displacement follows).
  * mod = 01: Memory Mode, 8-bit displacement follows.
  * mod = 10: Memory Mode, 16-bit displacement follows.
@@ -17,94 +23,70 @@
  */
 #include "opcode_encoding.h"
 
-#include <assert.h>
+#include "opcode_encoding_table/opcode_encoding_table.h"
 
-typedef struct {
-    const uint8_t *code, *end;
-    uint8_t curr;
-    uint8_t len;
-} CodeReader;
-
-static CodeReader CodeReader_new(const uint8_t code[], const uint8_t end[]) {
-    CodeReader ret = {
-      .code = code,
-      .end = end,
-      .curr = 0,
-      .len = 0,
-    };
-    return ret;
-}
+// Decoders are only fast if every helper folds into them
+#define DECODE_INLINE static inline __attribute__((always_inline))
 
-typedef enum {
-    CodeReaderErr_OK = 0,
-    CodeReaderErr_END,          // No more code available to satisfy advance request
-    CodeReaderErr_UNALIGNED,    // Advance request is not 8bit aligned (spans multiple bytes)
-    CodeReaderErr_INVALID,      // Erroneous input
-} CodeReaderErr;
+typedef struct {
+    uint8_t s, w, d, v, z, mod, reg, rm, sr;
+} DecodeFieldValues;
 
-inline static uint8_t right_mask(const uint8_t n) {
-    return (1 << n) - 1;
-}
+typedef struct {
+    bool s, w, d, v, z, mod, reg, rm, sr, strSi, strDi, disp, data, dataIfW, ipinc8, ipinc16, seg, far;
+} DecodeFieldPresence;
 
-static CodeReaderErr CodeReader_get_bits_and_advance(CodeReader *reader, const uint8_t n, uint8_t *out) {
-    *out = 0;
-    if(n == 0) {
-        return CodeReaderErr_OK;
-    }
-    if(n > 8) {
-        return CodeReaderErr_INVALID; // Max is 8
+/*
+ * State of a generated decoder. Every field of the row is known at compile time, so once the
+ * helpers are inlined the bit offsets, shifts, masks and presence flags are all constants.
+ */
+typedef struct {
+    const uint8_t *code, *end;
+    uint32_t bit;           // Bits read so far
+    OpcodeDecodeErr err;    // First error, the rest of the fields are skipped
+    DecodeFieldValues field;
+    DecodeFieldPresence has;
+} Decoder;
+
+DECODE_INLINE uint8_t read_bits(Decoder *dec, const uint8_t n) {
+    const uint32_t byte = dec->bit >> 3;
+    const uint32_t offset = dec->bit & 7;
+
+    if(dec->err) {
+        return 0;
     }
-
-    uint8_t len = reader->len;
-    if(len > 0 && n > len) {
-        return CodeReaderErr_UNALIGNED;
+    if(offset + n > 8) {
+        dec->err = OpcodeDecodeErr_INVALID; // Fields are cross byte
+        return 0;
     }
-
-    if(len == 0) {
-        // Advance
-        if(reader->code == reader->end) {
-            return CodeReaderErr_END;
-        }
-
-        reader->curr = *reader->code;
-        reader->code++;
-        reader->len = 8;
-        len = reader->len;
+    if(dec->code + byte >= dec->end) {
+        dec->err = OpcodeDecodeErr_END;
+        return 0;
     }
 
-    *out = (reader->curr & right_mask(len)) >> (len - n);
-    reader->len -= n;
-
-    return CodeReaderErr_OK;
+    dec->bit += n;
+    return (dec->code[byte] >> (8 - offset - n)) & ((1 << n) - 1);
 }
 
-static CodeReaderErr CodeReader_get_bytes_and_advance(CodeReader *reader, const uint8_t n, int16_t *out) {
-    *out = 0;
-    if(n == 0) {
-        return CodeReaderErr_OK;
-    }
-    if(n > 2) {
-        return CodeReaderErr_INVALID; // Max is 2
-    }
-
-    if(reader->len != 0) {
-        return CodeReaderErr_UNALIGNED;
+DECODE_INLINE void read_literal(Decoder *dec, const uint8_t n, const uint8_t value) {
+    if(read_bits(dec, n) != value && !dec->err) {
+        dec->err = OpcodeDecodeErr_NOT_COMPAT; // Literal is not present in code
     }
+}
 
-    const uint8_t *data = reader->code;
-
-    if(reader->code + n > reader->end) {
-        return CodeReaderErr_END;
+// Reads a n byte little endian value, sign extending bytes. The code pointer must already be byte aligned
+DECODE_INLINE int16_t read_bytes(const uint8_t **code, const uint8_t *end, const uint8_t n, OpcodeDecodeErr *err) {
+    const uint8_t *data = *code;
+    if(n == 0 || *err) {
+        return 0;
     }
-    reader->code += n;
-
-    if(n == 1) {
-        *out = (int16_t) ((int8_t) *data);
-    } else { // n == 2
-        *out = (int16_t) ((data[1] << 8) | data[0]);
+    if(data + n > end) {
+        *err = OpcodeDecodeErr_END;
+        return 0;
     }
 
-    return CodeReaderErr_OK;
+    *code += n;
+    return n == 1 ? (int16_t) ((int8_t) data[0]) : (int16_t) ((data[1] << 8) | data[0]);
 }
 
 static OpcodeRegAccess resolve_reg_access(const uint8_t reg, const bool w) {
@@ -149,133 +131,93 @@ static OpcodeMemAccess resolve_mem_access(const uint8_t rm, const int16_t displa
                 .terms = {{{0,0,0}, false}, {{0,0,0}, false}},
                 .displacement = displacement,
                 .size = size,
+                .segment = Register_DS,
         };
         return ret;
     } else {
+        // Addressing based on BP is relative to the stack segment
         const OpcodeMemAccess ret = {
                 .terms = {rmToTerms[rm][0], rmToTerms[rm][1]},
                 .displacement = displacement,
                 .size = size,
+                .segment = rmToTerms[rm][0].reg.reg == Register_BP ? Register_SS : Register_DS,
         };
         return ret;
     }
 }
 
-static inline OpcodeDecodeErr CodeReaderErr_to_OpcodeDecodeErr(const CodeReaderErr err) {
-    switch(err) {
-        case CodeReaderErr_OK: return OpcodeDecodeErr_OK;
-        case CodeReaderErr_END: return OpcodeDecodeErr_END;
-        case CodeReaderErr_UNALIGNED: return OpcodeDecodeErr_INVALID; // Fields are cross byte
-        case CodeReaderErr_INVALID: assert(false);
-    }
-    assert(false);
+// Implicit operand of string opcodes
+static OpcodeMemAccess resolve_string_access(const Register reg, const Register segment, const bool w) {
+    const OpcodeMemAccess ret = {
+            .terms = {{{reg, RegSize_WORD, RegOffset_NONE}, true}, {{0,0,0}, false}},
+            .displacement = 0,
+            .size = w ? RegSize_WORD : RegSize_BYTE,
+            .segment = segment,
+    };
+    return ret;
 }
 
-static OpcodeDecodeErr decode_fields(bool hasField[], uint8_t fields[], const OpcodeEncField encFields[], CodeReader *reader) {
-    for(int fieldIdx = 0; encFields[fieldIdx].type != OpcodeEncFieldType_END; fieldIdx++) {
-        if(fieldIdx >= MAX_ENC_FIELDS) {
-            return OpcodeDecodeErr_INVALID; // Missing end field
-        }
-
-        const OpcodeEncField field = encFields[fieldIdx];
-        const OpcodeEncFieldType fieldType = field.type;
-        hasField[fieldType] = true;
-
-        if(field.length == 0) {
-            fields[fieldType] = field.value;
-            continue;
-        }
-
-        uint8_t value;
-        const CodeReaderErr err = CodeReader_get_bits_and_advance(reader, field.length, &value);
-        if(err) {
-            return CodeReaderErr_to_OpcodeDecodeErr(err);
-        }
-
-        if(fieldType == OpcodeEncFieldType_LITERAL && value != field.value) {
-            return OpcodeDecodeErr_NOT_COMPAT; // Literal is not present in code
-        }
-
-        fields[fieldType] = value;
+// Builds the opcode out of the fields the row read, common to every decoder
+DECODE_INLINE OpcodeDecodeErr decode_operands(Decoder *dec, Opcode *opcode, const OpcodeType type) {
+    if(dec->err) {
+        return dec->err;
     }
-
-    if(reader->len != 0) {
+    if(dec->bit & 7) {
         return OpcodeDecodeErr_INVALID; // Byte left not fully consumed
     }
-
-    return OpcodeDecodeErr_OK;
-}
-
-static OpcodeType resolve_type(const OpcodeEncType encType) {
-    // TODO: Verify this keeps being true after encoding access refactoring
-    return (OpcodeType) encType;
-}
-
-OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *opcode, const uint8_t code[], const uint8_t codeEnd[]) {
-    bool hasField[OpcodeEncFieldType_COUNT] = {0};
-    uint8_t fields[OpcodeEncFieldType_COUNT] = {0};
-
-    #define FIELD(field) fields[OpcodeEncFieldType_##field]
-    #define HAS_FIELD(field) hasField[OpcodeEncFieldType_##field]
-
-    CodeReader codeReader = CodeReader_new(code, codeEnd);
-
-    const OpcodeDecodeErr decodeErr = decode_fields(hasField, fields, encoding->fields, &codeReader);
-    if(decodeErr) {
-        return decodeErr;
-    }
     if(opcode == NULL) {
         // Just checking if encoding is compatible
         return OpcodeDecodeErr_OK;
     }
 
-    const uint8_t mod = FIELD(MOD);
-    const uint8_t rm = FIELD(RM);
-    const bool w = FIELD(W);
-    const bool s = FIELD(S);
-    const bool d = FIELD(D);
+    const DecodeFieldPresence has = dec->has;
+    const uint8_t mod = dec->field.mod;
+    const uint8_t rm = dec->field.rm;
+    const bool w = dec->field.w;
+    const bool s = dec->field.s;
+    const bool d = dec->field.d;
 
     const bool directAccess = mod == B8(00) && rm == B8(110);
-    const RegSize dispLen = directAccess || mod == B8(10) ? RegSize_WORD : mod == B8(01) ? RegSize_BYTE : 0;
-    const RegSize dataLen = HAS_FIELD(DATA_IF_W) && w && !s ? RegSize_WORD : HAS_FIELD(DATA) ? RegSize_BYTE : 0;
-    const RegSize ipincLen = HAS_FIELD(IPINC16) ? RegSize_WORD : HAS_FIELD(IPINC8) ? RegSize_BYTE : 0;
-
-    CodeReaderErr readErr;
-
-    int16_t displacement;
-    if((readErr = CodeReader_get_bytes_and_advance(&codeReader, dispLen, &displacement))) {
-        return CodeReaderErr_to_OpcodeDecodeErr(readErr);
-    }
-
-    int16_t data;
-    if((readErr = CodeReader_get_bytes_and_advance(&codeReader, dataLen, &data))) {
-        return CodeReaderErr_to_OpcodeDecodeErr(readErr);
+    const RegSize dispLen = !has.mod || mod == B8(11) ? 0
+            : directAccess || mod == B8(10) ? RegSize_WORD : mod == B8(01) ? RegSize_BYTE : 0;
+    const RegSize dataLen = has.dataIfW && w && !s ? RegSize_WORD : has.data ? RegSize_BYTE : 0;
+    const RegSize ipincLen = has.ipinc16 ? RegSize_WORD : has.ipinc8 ? RegSize_BYTE : 0;
+
+    const uint8_t *code = dec->code + (dec->bit >> 3);
+    OpcodeDecodeErr err = OpcodeDecodeErr_OK;
+    const int16_t displacement = read_bytes(&code, dec->end, dispLen, &err);
+    const int16_t data = read_bytes(&code, dec->end, dataLen, &err);
+    const int16_t ipinc = read_bytes(&code, dec->end, ipincLen, &err);
+    const int16_t segment = read_bytes(&code, dec->end, has.seg ? RegSize_WORD : 0, &err);
+    if(err) {
+        return err;
     }
-
-    int16_t ipinc;
-    if((readErr = CodeReader_get_bytes_and_advance(&codeReader, ipincLen, &ipinc))) {
-        return CodeReaderErr_to_OpcodeDecodeErr(readErr);
+    if(has.far && mod == B8(11)) {
+        return OpcodeDecodeErr_NOT_COMPAT; // A far pointer can't be in a register
     }
 
-    opcode->type = resolve_type(encoding->type);
+    opcode->type = type;
     opcode->dst.type = OpcodeArgType_NONE;
     opcode->src.type = OpcodeArgType_NONE;
-    opcode->len = codeReader.code - code;
+    opcode->len = code - dec->code;
+    opcode->segmentOverride = false;
+    opcode->rep = !has.z ? OpcodeRep_NONE : dec->field.z ? OpcodeRep_REP : OpcodeRep_REPNE;
+    opcode->far = has.far;
 
     OpcodeArg *regArg = d ? &opcode->dst : &opcode->src;
     OpcodeArg *rmArg = d ? &opcode->src : &opcode->dst;
 
-    if(hasField[OpcodeEncFieldType_REG]) {
+    if(has.reg) {
         regArg->type = OpcodeArgType_REGISTER;
-        regArg->reg = resolve_reg_access(FIELD(REG), w);
+        regArg->reg = resolve_reg_access(dec->field.reg, w);
     }
 
-    if(hasField[OpcodeEncFieldType_SR]) {
+    if(has.sr) {
         regArg->type = OpcodeArgType_REGISTER;
-        regArg->reg = resolve_seg_reg_access(FIELD(SR));
+        regArg->reg = resolve_seg_reg_access(dec->field.sr);
     }
 
-    if(hasField[OpcodeEncFieldType_MOD]) {
+    if(has.mod) {
         if(mod == B8(11)) {
             // Register Mode
             rmArg->type = OpcodeArgType_REGISTER;
@@ -287,6 +229,30 @@ OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *op
         }
     }
 
+    // [si] takes the reg side unless the accumulator is there, [di] the rm side
+    if(has.strSi) {
+        OpcodeArg *siArg = regArg->type == OpcodeArgType_NONE ? regArg : rmArg;
+        siArg->type = OpcodeArgType_MEMORY;
+        siArg->mem = resolve_string_access(Register_SI, Register_DS, w);
+    }
+
+    if(has.strDi) {
+        rmArg->type = OpcodeArgType_MEMORY;
+        rmArg->mem = resolve_string_access(Register_DI, Register_ES, w);
+    }
+
+    if(has.v) {
+        // Shift count
+        if(dec->field.v) {
+            opcode->src.type = OpcodeArgType_REGISTER;
+            opcode->src.reg = resolve_reg_access(1, false); // CL
+        } else {
+            opcode->src.type = OpcodeArgType_IMMEDIATE;
+            opcode->src.imm = (OpcodeImmAccess) {.value = 1, .size = RegSize_BYTE};
+        }
+        return OpcodeDecodeErr_OK;
+    }
+
     // Immediate argument is the one not filled yet, or dstArg if only one arg
     OpcodeArg *immArg;
     if(regArg->type == OpcodeArgType_NONE && rmArg->type == OpcodeArgType_NONE) {
@@ -302,7 +268,7 @@ OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *op
     if(dataLen) {
         immArg->type = OpcodeArgType_IMMEDIATE;
         immArg->imm.value = data;
-        immArg->imm.size = s ? RegSize_WORD : dataLen;
+        immArg->imm.size = s && w ? RegSize_WORD : dataLen; // Sign extended to the operand size
     }
 
     if(ipincLen) {
@@ -311,8 +277,74 @@ OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *op
         immArg->imm.size = ipincLen;
     }
 
+    if(has.seg) {
+        // Far pointer: the offset went to dst
+        opcode->src.type = OpcodeArgType_IMMEDIATE;
+        opcode->src.imm = (OpcodeImmAccess) {.value = segment, .size = RegSize_WORD};
+    }
+
     return OpcodeDecodeErr_OK;
+}
+
+/*
+ * One straight line decoder per encoding table row. Every field macro becomes an expression
+ * reading its bits (or setting its fixed value), and the row is the comma separated sequence of them.
+ */
+#define OPCODE_FIELDS
+#define B(bits) read_literal(&dec, sizeof(#bits) - 1, B8(bits))
+#define FIELD_BITS(name, n) (dec.has.name = true, dec.field.name = read_bits(&dec, n))
+#define FIELD_SET(name, value) (dec.has.name = true, dec.field.name = (value))
+#define FIELD_MARK(name) (dec.has.name = true)
+
+#define D FIELD_BITS(d, 1)
+#define S FIELD_BITS(s, 1)
+#define W FIELD_BITS(w, 1)
+#define V FIELD_BITS(v, 1)
+#define Z FIELD_BITS(z, 1)
+
+#define RM FIELD_BITS(rm, 3)
+#define MOD FIELD_BITS(mod, 2)
+#define REG FIELD_BITS(reg, 3)
+#define SR FIELD_BITS(sr, 2)
+#define STR_SI FIELD_MARK(strSi)
+#define STR_DI FIELD_MARK(strDi)
+
+#define DISP FIELD_MARK(disp)
+#define DATA FIELD_MARK(data)
+#define IPINC8 FIELD_MARK(ipinc8)
+#define IPINC16 FIELD_MARK(ipinc16)
+#define DATA_IF_W FIELD_MARK(dataIfW)
+#define SEG FIELD_MARK(seg)
+#define FAR FIELD_MARK(far)
+
+#define SET_D(value) FIELD_SET(d, value)
+#define SET_S(value) FIELD_SET(s, value)
+#define SET_W(value) FIELD_SET(w, value)
+
+#define SET_RM(value) FIELD_SET(rm, value)
+#define SET_MOD(value) FIELD_SET(mod, value)
+#define SET_REG(value) FIELD_SET(reg, value)
+
+#define BYTE SET_W(0)
+#define WORD SET_W(1)
+#define FROM_REG SET_D(0)
+#define TO_REG SET_D(1)
+#define ACC SET_REG(0)
+#define DIRECT_ACCESS (SET_MOD(0), SET_RM(B8(110)))
+
+#define OPCODE(name, ...) \
+OpcodeDecodeErr OPCODE_DECODER(__LINE__)(Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd) { \
+    Decoder dec = {.code = code, .end = codeEnd}; \
+    (void) (__VA_ARGS__); \
+    return decode_operands(&dec, opcode, (OpcodeType) OpcodeEncType_##name); \
+}
+#define SUB_OP OPCODE
+#include "opcode_encoding_table/opcode_encoding_table.inl"
+
+#undef FIELD_BITS
+#undef FIELD_SET
+#undef FIELD_MARK
 
-    #undef HAS_FIELD
-    #undef FIELD
+OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd) {
+    return encoding->decode(opcode, code, codeEnd);
 }
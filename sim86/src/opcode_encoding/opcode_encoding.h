@@ -25,11 +25,15 @@ typedef enum {
     OpcodeEncFieldType_S,
     OpcodeEncFieldType_W,
     OpcodeEncFieldType_D,
+    OpcodeEncFieldType_V,
+    OpcodeEncFieldType_Z,
 
     OpcodeEncFieldType_MOD,
     OpcodeEncFieldType_REG,
     OpcodeEncFieldType_RM,
     OpcodeEncFieldType_SR,
+    OpcodeEncFieldType_STR_SI, // Implicit DS:[SI] string operand
+    OpcodeEncFieldType_STR_DI, // Implicit ES:[DI] string operand
 
     OpcodeEncFieldType_DISP,
     OpcodeEncFieldType_DATA,
@@ -37,6 +41,8 @@ typedef enum {
     OpcodeEncFieldType_IPINC16,
 
     OpcodeEncFieldType_DATA_IF_W,
+    OpcodeEncFieldType_SEG,     // Segment word of a far pointer, after its offset (the data)
+    OpcodeEncFieldType_FAR,     // Far jump, call or return: CS is loaded or saved along with IP
 
     OpcodeEncFieldType_COUNT,
 } OpcodeEncFieldType;
@@ -47,11 +53,6 @@ typedef struct {
     uint8_t value;
 } OpcodeEncField;
 
-typedef struct {
-    OpcodeEncType type;
-    OpcodeEncField fields[MAX_ENC_FIELDS];
-} OpcodeEncoding;
-
 typedef enum {
     OpcodeDecodeErr_OK = 0,
     OpcodeDecodeErr_NOT_COMPAT, // Encoding and code are not compatible
@@ -59,6 +60,23 @@ typedef enum {
     OpcodeDecodeErr_INVALID,    // OpcodeEncoding is invalid
 } OpcodeDecodeErr;
 
-OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *opcode, const uint8_t code[], const uint8_t codeEnd[]);
+// Decodes a single encoding. With a NULL opcode it only checks whether the code matches it
+typedef OpcodeDecodeErr (*OpcodeDecodeFn)(Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd);
+
+typedef struct {
+    OpcodeEncType type;
+    OpcodeEncField fields[MAX_ENC_FIELDS]; // Row layout, for reporting. Decoding goes through decode
+    OpcodeDecodeFn decode;
+} OpcodeEncoding;
+
+// Specialized decoder of every encoding table row, generated from the table and named after its line
+#define OPCODE_DECODER(line) OPCODE_DECODER_(line)
+#define OPCODE_DECODER_(line) OpcodeEncoding_decode_##line
+
+#define OPCODE(name, ...) OpcodeDecodeErr OPCODE_DECODER(__LINE__)(Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd);
+#define SUB_OP OPCODE
+#include "opcode_encoding_table/opcode_encoding_table.inl"
+
+OpcodeDecodeErr OpcodeEncoding_decode(const OpcodeEncoding *encoding, Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd);
 
 #endif //SIM86_OPCODE_ENCODING_H
@@ -1,10 +1,26 @@
 #include "opcode_encoding_table.h"
 
+#include <stdbool.h>
+
+#define DISPATCH_REG_COUNT 8
+
 static const OpcodeEncoding table[] = {
     #include "opcode_encoding_table.inl"
 };
 static const size_t tableSize = sizeof(table) / sizeof(*table);
 
+/*
+ * First byte dispatch table. Encodings only discriminate on the first byte
+ * and, for opcode groups like `100000`, on the ModRM reg field of the second byte.
+ */
+typedef struct {
+    const OpcodeEncoding *byReg[DISPATCH_REG_COUNT];
+    bool needsReg; // Whether the ModRM reg field is needed to pick the encoding
+} DispatchEntry;
+
+static DispatchEntry dispatch[UINT8_MAX + 1];
+static bool dispatchReady = false;
+
 OpcodeEncodingTable OpcodeEncodingTable_get(void) {
     OpcodeEncodingTable ret = {
             .size = sizeof(table) / sizeof(*table),
@@ -13,7 +29,7 @@ OpcodeEncodingTable OpcodeEncodingTable_get(void) {
     return ret;
 }
 
-const OpcodeEncoding *OpcodeEncoding_find(const uint8_t *codeStart, const uint8_t *codeEnd) {
+static const OpcodeEncoding *linear_find(const uint8_t *codeStart, const uint8_t *codeEnd) {
     for(size_t i = 0; i < tableSize; ++i) {
         int err = OpcodeEncoding_decode(&table[i], NULL, codeStart, codeEnd);
         if(err == OpcodeDecodeErr_OK) {
@@ -26,3 +42,45 @@ const OpcodeEncoding *OpcodeEncoding_find(const uint8_t *codeStart, const uint8_
 
     return NULL;
 }
+
+void OpcodeEncodingTable_init(void) {
+    if(dispatchReady) {
+        return;
+    }
+
+    for(int byte = 0; byte <= UINT8_MAX; ++byte) {
+        DispatchEntry *entry = &dispatch[byte];
+
+        for(uint8_t reg = 0; reg < DISPATCH_REG_COUNT; ++reg) {
+            // As long as the longest opcode, the rest zeroed, so no decoder reads past it
+            const uint8_t probe[MAX_OPCODE_LEN] = {byte, reg << 3};
+            entry->byReg[reg] = linear_find(probe, probe + sizeof(probe));
+            entry->needsReg = entry->needsReg || entry->byReg[reg] != entry->byReg[0];
+        }
+    }
+
+    dispatchReady = true;
+}
+
+const OpcodeEncoding *OpcodeEncoding_find(const uint8_t *codeStart, const uint8_t *codeEnd) {
+    if(codeStart >= codeEnd) {
+        return NULL;
+    }
+
+    if(!dispatchReady) {
+        OpcodeEncodingTable_init();
+    }
+
+    const DispatchEntry *entry = &dispatch[codeStart[0]];
+    if(!entry->needsReg) {
+        return entry->byReg[0];
+    }
+
+    if(codeEnd - codeStart < 2) {
+        return NULL; // Second byte is needed but code ended
+    }
+
+    return entry->byReg[(codeStart[1] >> 3) & (DISPATCH_REG_COUNT - 1)];
+}
+
+#undef DISPATCH_REG_COUNT
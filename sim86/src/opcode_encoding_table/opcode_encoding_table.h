@@ -12,6 +12,10 @@ typedef struct {
 
 OpcodeEncodingTable OpcodeEncodingTable_get(void);
 
+// Builds the first byte dispatch table. Called lazily by OpcodeEncoding_find.
+// Not thread safe, call it before decoding from several threads
+void OpcodeEncodingTable_init(void);
+
 const OpcodeEncoding *OpcodeEncoding_find(const uint8_t *codeStart, const uint8_t *codeEnd);
 
 #endif //SIM86_OPCODE_ENCODING_TABLE_H
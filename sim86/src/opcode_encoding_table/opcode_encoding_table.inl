@@ -1,29 +1,36 @@
 #include "utils/binary_lit.h"
 
 #ifndef OPCODE
-#define OPCODE(name, ...) {OpcodeEncType_##name, {__VA_ARGS__, {OpcodeEncFieldType_END}}},
+#define OPCODE(name, ...) {OpcodeEncType_##name, {__VA_ARGS__, {OpcodeEncFieldType_END}}, OPCODE_DECODER(__LINE__)},
 #endif
 
 #ifndef SUB_OP
 #define SUB_OP OPCODE
 #endif
 
+// Field macros can be replaced as a whole, see the decoders in opcode_encoding.c
+#ifndef OPCODE_FIELDS
 #define B(bits) {OpcodeEncFieldType_LITERAL, sizeof(#bits)-1, B8(bits)}
 #define D {OpcodeEncFieldType_D, 1, 0}
 #define S {OpcodeEncFieldType_S, 1, 0}
 #define W {OpcodeEncFieldType_W, 1, 0}
-//#define V {OpcodeEncFieldType_V, 1, 0}
-//#define Z {OpcodeEncFieldType_Z, 1, 0}
+#define V {OpcodeEncFieldType_V, 1, 0}
+#define Z {OpcodeEncFieldType_Z, 1, 0}
 
 #define RM {OpcodeEncFieldType_RM, 3, 0}
 #define MOD {OpcodeEncFieldType_MOD, 2, 0}
 #define REG {OpcodeEncFieldType_REG, 3, 0}
 #define SR {OpcodeEncFieldType_SR, 2, 0}
+#define STR_SI {OpcodeEncFieldType_STR_SI, 0, 0}
+#define STR_DI {OpcodeEncFieldType_STR_DI, 0, 0}
 
 #define DISP {OpcodeEncFieldType_DISP, 0, 0}
 #define DATA {OpcodeEncFieldType_DATA, 0, 0}
 #define IPINC8 {OpcodeEncFieldType_IPINC8, 0, 0}
+#define IPINC16 {OpcodeEncFieldType_IPINC16, 0, 0}
 #define DATA_IF_W {OpcodeEncFieldType_DATA_IF_W, 0, 0}
+#define SEG {OpcodeEncFieldType_SEG, 0, 0}
+#define FAR {OpcodeEncFieldType_FAR, 0, 0}
 
 #define SET_D(value) {OpcodeEncFieldType_D, 0, value}
 #define SET_S(value) {OpcodeEncFieldType_S, 0, value}
@@ -39,6 +46,11 @@
 #define TO_REG SET_D(1)
 #define ACC SET_REG(0)
 #define DIRECT_ACCESS SET_MOD(0), SET_RM(B8(110))
+#endif
+
+// Prefixes, decoded along with the opcode they precede (see Opcode_decode)
+OPCODE(SEGMENT, B(001), SR, B(110))
+OPCODE(REP, B(1111001), Z)
 
 OPCODE(MOV, B(100010), D, W, MOD, REG, RM)
 SUB_OP(MOV, B(1100011), W, MOD, B(000), RM, DATA, DATA_IF_W, FROM_REG)
@@ -80,6 +92,75 @@ OPCODE(XOR, B(001100), D, W, MOD, REG, RM)
 SUB_OP(XOR, B(100000), S, W, MOD, B(110), RM, DATA, DATA_IF_W)
 SUB_OP(XOR, B(0011010), W, DATA, DATA_IF_W, TO_REG, ACC)
 
+OPCODE(INC, B(1111111), W, MOD, B(000), RM)
+SUB_OP(INC, B(01000), REG, WORD, TO_REG)
+
+OPCODE(DEC, B(1111111), W, MOD, B(001), RM)
+SUB_OP(DEC, B(01001), REG, WORD, TO_REG)
+
+OPCODE(NEG, B(1111011), W, MOD, B(011), RM)
+
+// Multiply and divide the accumulator (AL or AX, DX:AX) by the operand
+OPCODE(MUL,  B(1111011), W, MOD, B(100), RM)
+OPCODE(IMUL, B(1111011), W, MOD, B(101), RM)
+OPCODE(DIV,  B(1111011), W, MOD, B(110), RM)
+OPCODE(IDIV, B(1111011), W, MOD, B(111), RM)
+
+// v = 0: Count is 1, v = 1: count is CL
+OPCODE(ROL, B(110100), V, W, MOD, B(000), RM)
+OPCODE(ROR, B(110100), V, W, MOD, B(001), RM)
+OPCODE(RCL, B(110100), V, W, MOD, B(010), RM)
+OPCODE(RCR, B(110100), V, W, MOD, B(011), RM)
+OPCODE(SHL, B(110100), V, W, MOD, B(100), RM)
+OPCODE(SHR, B(110100), V, W, MOD, B(101), RM)
+OPCODE(SAR, B(110100), V, W, MOD, B(111), RM)
+
+// String opcodes address [si] in DS (can be overridden) and [di] in ES, then step them by the operand size
+OPCODE(MOVS, B(1010010), W, STR_DI, STR_SI, FROM_REG)
+OPCODE(CMPS, B(1010011), W, STR_SI, STR_DI, TO_REG)
+OPCODE(SCAS, B(1010111), W, ACC, STR_DI, TO_REG)
+OPCODE(LODS, B(1010110), W, ACC, STR_SI, TO_REG)
+OPCODE(STOS, B(1010101), W, ACC, STR_DI, FROM_REG)
+
+// Stack opcodes move words through SS:SP
+OPCODE(PUSH, B(11111111), MOD, B(110), RM, WORD)
+SUB_OP(PUSH, B(01010), REG, WORD, TO_REG)
+SUB_OP(PUSH, B(000), SR, B(110), TO_REG)
+
+OPCODE(POP, B(10001111), MOD, B(000), RM, WORD)
+SUB_OP(POP, B(01011), REG, WORD, TO_REG)
+SUB_OP(POP, B(000), SR, B(111), TO_REG)
+
+OPCODE(PUSHF, B(10011100))
+OPCODE(POPF, B(10011101))
+
+// Near targets are relative, or absolute from a register or memory. Far ones load CS too, from a
+// pointer (offset then segment) in the code or in memory
+OPCODE(JMP, B(11101011), IPINC8)
+SUB_OP(JMP, B(11101001), IPINC16)
+SUB_OP(JMP, B(11111111), MOD, B(100), RM, WORD)
+SUB_OP(JMP, B(11101010), DATA, DATA_IF_W, WORD, SEG, FAR)
+SUB_OP(JMP, B(11111111), MOD, B(101), RM, WORD, FAR)
+
+OPCODE(CALL, B(11101000), IPINC16)
+SUB_OP(CALL, B(11111111), MOD, B(010), RM, WORD)
+SUB_OP(CALL, B(10011010), DATA, DATA_IF_W, WORD, SEG, FAR)
+SUB_OP(CALL, B(11111111), MOD, B(011), RM, WORD, FAR)
+
+// Optionally frees the given bytes of arguments after popping the return address
+OPCODE(RET, B(11000011))
+SUB_OP(RET, B(11000010), DATA, DATA_IF_W, WORD)
+SUB_OP(RET, B(11001011), FAR)
+SUB_OP(RET, B(11001010), DATA, DATA_IF_W, WORD, FAR)
+
+OPCODE(CLC, B(11111000))
+OPCODE(STC, B(11111001))
+OPCODE(CMC, B(11110101))
+OPCODE(CLD, B(11111100))
+OPCODE(STD, B(11111101))
+OPCODE(CLI, B(11111010))
+OPCODE(STI, B(11111011))
+
 OPCODE(JE,      B(01110100), IPINC8)
 OPCODE(JL,      B(01111100), IPINC8)
 OPCODE(JLE,     B(01111110), IPINC8)
@@ -108,17 +189,22 @@ OPCODE(JCXZ,    B(11100011), IPINC8)
 #undef D
 #undef S
 #undef W
-//#undef V
-//#undef Z
+#undef V
+#undef Z
 
 #undef RM
 #undef MOD
 #undef REG
+#undef STR_SI
+#undef STR_DI
 
 #undef DISP
 #undef DATA
 #undef IPINC8
+#undef IPINC16
 #undef DATA_IF_W
+#undef SEG
+#undef FAR
 #undef DATA_IF_SW
 
 #undef SET_D
@@ -136,3 +222,5 @@ OPCODE(JCXZ,    B(11100011), IPINC8)
 #undef TO_REG
 #undef ACC
 #undef DIRECT_ACCESS
+
+#undef OPCODE_FIELDS
@@ -0,0 +1,112 @@
+#include "opcode_fetch.h"
+
+#include <stdlib.h>
+
+#include "opcode_encoding_table/opcode_encoding_table.h"
+
+// Fault reason of a decode error, see Memory_fault
+static const char *decode_fault(const OpcodeDecodeErr err) {
+    switch(err) {
+        case OpcodeDecodeErr_OK: break; // No error
+        case OpcodeDecodeErr_NOT_COMPAT: return "Unknown opcode";
+        case OpcodeDecodeErr_END: return "Code ended in the middle of an opcode";
+        case OpcodeDecodeErr_INVALID: return "Invalid opcode code for encoding";
+    }
+    return NULL;
+}
+
+static void apply_segment_override(OpcodeArg *arg, const Register segment) {
+    // Only the [di] operand of string opcodes defaults to ES, and it can't be overridden
+    if(arg->type == OpcodeArgType_MEMORY && arg->mem.segment != Register_ES) {
+        arg->mem.segment = segment;
+        arg->mem.segmentOverride = true;
+    }
+}
+
+OpcodeDecodeErr Opcode_decode(Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd) {
+    const uint8_t *start = code;
+    bool segmentOverride = false;
+    Register segment = Register_DS;
+    OpcodeRep rep = OpcodeRep_NONE;
+
+    for(;;) {
+        const OpcodeEncoding *encoding = OpcodeEncoding_find(code, codeEnd);
+        if(encoding == NULL) {
+            return code < codeEnd ? OpcodeDecodeErr_NOT_COMPAT : OpcodeDecodeErr_END;
+        }
+
+        const OpcodeDecodeErr err = OpcodeEncoding_decode(encoding, opcode, code, codeEnd);
+        if(err) {
+            return err;
+        }
+        opcode->encoding = encoding - OpcodeEncodingTable_get().table;
+
+        // Prefixes, the last one of each kind wins
+        if(opcode->type == OpcodeType_SEGMENT) {
+            segmentOverride = true;
+            segment = opcode->src.reg.reg;
+        } else if(opcode->type == OpcodeType_REP) {
+            rep = opcode->rep;
+        } else {
+            break;
+        }
+
+        code += opcode->len;
+        if(code - start >= MAX_OPCODE_LEN) {
+            return OpcodeDecodeErr_NOT_COMPAT;
+        }
+    }
+
+    opcode->len += code - start;
+    opcode->rep = rep;
+    if(segmentOverride) {
+        opcode->segmentOverride = true;
+        opcode->segment = segment;
+        apply_segment_override(&opcode->dst, segment);
+        apply_segment_override(&opcode->src, segment);
+    }
+    return OpcodeDecodeErr_OK;
+}
+
+OpcodeDecodeErr Opcode_decode_at(Opcode *opcode, const Memory *mem, const uint16_t ip) {
+    const uint8_t *code = Memory_addr_ptr(mem, Register_CS, ip);
+    // Code past the end of the program can only be reached by jumping there (ex: far into a loaded image)
+    const uint8_t *codeEnd = code < mem->codeEnd ? mem->codeEnd : mem->ram + RAM_SIZE;
+    return Opcode_decode(opcode, code, codeEnd);
+}
+
+bool Opcode_parse(Opcode *opcode, Memory *mem) {
+    if(Memory_code_ended(mem)) {
+        return false;
+    }
+
+    const OpcodeDecodeErr err = Opcode_decode_at(opcode, mem, mem->registers[Register_IP]);
+    if(err) {
+        Memory_fault(mem, mem->registers[Register_IP], decode_fault(err));
+        return false;
+    }
+
+    return true;
+}
+
+const Opcode *Opcode_fetch(Opcode *scratch, Memory *mem) {
+    OpcodeCache *cache = mem->opcodeCache;
+    if(cache == NULL) {
+        return Opcode_parse(scratch, mem) ? scratch : NULL;
+    }
+
+    if(Memory_code_ended(mem)) {
+        return NULL;
+    }
+
+    const uint32_t addr = Memory_code_addr(mem);
+    const Opcode *cached = OpcodeCache_get(cache, addr);
+    if(cached) {
+        return cached;
+    }
+
+    if(!Opcode_parse(scratch, mem)) {
+        return NULL;
+    }
+    return OpcodeCache_put(cache, addr, scratch);
+}
@@ -0,0 +1,26 @@
+#ifndef SIM86_OPCODE_FETCH_H
+#define SIM86_OPCODE_FETCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "opcode/opcode.h"
+#include "memory/memory.h"
+#include "opcode_encoding/opcode_encoding.h"
+
+// Decodes the opcode at code along with its prefixes, which are folded into it (len included)
+OpcodeDecodeErr Opcode_decode(Opcode *opcode, const uint8_t code[], const uint8_t *codeEnd);
+
+// Decodes the opcode at CS:ip without reporting errors. Unknown opcodes yield OpcodeDecodeErr_NOT_COMPAT.
+// Opcodes in the program can't cross its end, the ones past it (far jump targets) the end of RAM
+OpcodeDecodeErr Opcode_decode_at(Opcode *opcode, const Memory *mem, uint16_t ip);
+
+// Decodes the opcode at CS:IP. Unknown or malformed opcodes halt the machine (see Memory_fault).
+// Returns false if code ended or it halted
+bool Opcode_parse(Opcode *opcode, Memory *mem);
+
+// Same as Opcode_parse, but served from the memory opcode cache when available. Returns NULL if code ended
+// or it halted
+const Opcode *Opcode_fetch(Opcode *scratch, Memory *mem);
+
+#endif //SIM86_OPCODE_FETCH_H
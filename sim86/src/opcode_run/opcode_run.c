@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "opcode_decompile/opcode_decompile.h"
+#include "alu/alu.h"
 
 static uint8_t *reg_ptr_byte(const OpcodeRegAccess *access, const Memory *memory) {
     const uint16_t *reg = &memory->registers[access->reg];
@@ -45,16 +46,20 @@ static inline uint32_t mem_effective_addr(const OpcodeMemAccess *access, const M
            ;
 }
 
+static inline Register mem_segment(const OpcodeMemAccess *access) {
+    return access->segment; // Resolved when decoded, prefixes included
+}
+
+uint16_t OpcodeMemAccess_offset(const OpcodeMemAccess *access, const Memory *memory) {
+    return mem_effective_addr(access, memory);
+}
+
+Register OpcodeMemAccess_segment(const OpcodeMemAccess *access) {
+    return mem_segment(access);
+}
+
 static inline uint16_t get_memory(const OpcodeMemAccess *access, const Memory *memory) {
-    // TODO: Make segment selection more robust, depending on opcode
-    const OpcodeAddrRegTerm lTerm = access->terms[0];
-    const Register segmentReg = lTerm.present && lTerm.reg.reg == Register_BP ? Register_SS : Register_DS;
-    const uint8_t *addrPtr = Memory_addr_ptr(memory, segmentReg, mem_effective_addr(access, memory));
-    switch(access->size) {
-        case RegSize_BYTE: return *addrPtr;
-        case RegSize_WORD: return (addrPtr[1] << 8) | addrPtr[0]; // Little endian
-    }
-    assert(false);
+    return Memory_read(memory, mem_segment(access), mem_effective_addr(access, memory), access->size);
 }
 
 static inline uint16_t get_immediate(const OpcodeImmAccess *access) {
@@ -87,18 +92,7 @@ static void set_register(const OpcodeRegAccess *access, Memory *memory, const ui
 }
 
 static inline void set_memory(const OpcodeMemAccess *access, Memory *memory, const uint16_t data) {
-    // TODO: Make segment selection more robust, depending on opcode
-    const OpcodeAddrRegTerm lTerm = access->terms[0];
-    const Register segmentReg = lTerm.present && lTerm.reg.reg == Register_BP ? Register_SS : Register_DS;
-    uint8_t *addrPtr = Memory_addr_ptr(memory, segmentReg, mem_effective_addr(access, memory));
-    switch(access->size) {
-        case RegSize_BYTE: *addrPtr = data;
-        case RegSize_WORD: {
-            // Little endian
-            addrPtr[0] = data;
-            addrPtr[1] = data >> 8;
-        }
-    }
+    Memory_write(memory, mem_segment(access), mem_effective_addr(access, memory), access->size, data);
 }
 
 static void set_arg_data(const OpcodeArg *arg, Memory *memory, const uint16_t data) {
@@ -126,45 +120,28 @@ static inline void unconditional_jmp(const Opcode *opcode, Memory *memory) {
     memory->registers[Register_IP] += get_immediate(&opcode->dst.ipinc);
 }
 
-/* ------------------------- FLAGS ---------------------- */
-
-static inline bool set_add_carry(const RegSize size, const uint16_t a, const uint16_t b) {
-    return b > RegSize_max(size) - a;
-}
-
-static inline bool set_sub_carry(const uint16_t a, const uint16_t b) {
-    return a < b;
-}
-
-static inline bool set_add_overflow(const RegSize size, const uint16_t a, const uint16_t b) {
-    return set_add_carry(size, a << 1, b << 1) ^ set_add_carry(size, a, b);
-}
-
-static inline bool set_sub_overflow(const uint16_t a, const uint16_t b) {
-    return set_sub_carry(a << 1, b << 1) ^ set_sub_carry(a, b);
-}
-
-static inline bool set_add_aux_carry(const uint16_t a, const uint16_t b) {
-    return (b & 0xF) > 0xF - (a & 0xF);
-}
-
-static inline bool set_sub_aux_carry(const uint16_t a, const uint16_t b) {
-    return set_sub_carry(a & 0xF, b & 0xF);
-}
-
-static inline bool set_sign(const RegSize size, const uint16_t result) {
-    return ((RegSize_max(size) + 1) >> 1) & result;
-}
-
-static inline bool set_zero(const uint16_t result) {
-    return result == 0;
-}
-
-static inline bool set_parity(const uint8_t result) {
-    uint8_t y = result ^ (result >> 1);
-    y = y ^ (y >> 2);
-    y = y ^ (y >> 4);
-    return !(y & 1);
+typedef struct {
+    uint16_t cs, ip;
+} FarPtr;
+
+// Where a JMP or CALL goes, taken before it pushes anything. Far pointers in memory hold the offset first
+static FarPtr branch_target(const Opcode *opcode, const Memory *memory) {
+    const OpcodeArg *arg = &opcode->dst;
+    FarPtr target = {memory->registers[Register_CS], memory->registers[Register_IP]};
+
+    if(arg->type == OpcodeArgType_IPINC) {
+        target.ip += get_immediate(&arg->ipinc);
+    } else if(!opcode->far) {
+        target.ip = get_arg_data(arg, memory);
+    } else if(arg->type == OpcodeArgType_IMMEDIATE) {
+        target.ip = get_immediate(&arg->imm);
+        target.cs = get_immediate(&opcode->src.imm);
+    } else {
+        const uint16_t offset = mem_effective_addr(&arg->mem, memory);
+        target.ip = Memory_read(memory, mem_segment(&arg->mem), offset, RegSize_WORD);
+        target.cs = Memory_read(memory, mem_segment(&arg->mem), offset + 2, RegSize_WORD);
+    }
+    return target;
 }
 
 /* -------------------- OPCODES --------------------------- */
@@ -176,6 +153,11 @@ static void NONE(const Opcode *opcode, Memory *memory) {
     abort();
 }
 
+static void SEGMENT(const Opcode *opcode, Memory *memory) {
+    fprintf(stderr, "Segment prefix run on its own!\n");
+    abort();
+}
+
 static void MOV(const Opcode *opcode, Memory *memory) {
     set_arg_data(&opcode->dst, memory, get_arg_data(&opcode->src, memory));
 }
@@ -183,227 +165,455 @@ static void MOV(const Opcode *opcode, Memory *memory) {
 static void ADD(const Opcode *opcode, Memory *memory) {
     const uint16_t l = get_arg_data(&opcode->dst, memory);
     const uint16_t r = get_arg_data(&opcode->src, memory);
-    const uint16_t result = l + r;
-
-    set_arg_data(&opcode->dst, memory, result);
-
-    const RegSize size = OpcodeArg_size(&opcode->dst);
-    memory->flags.overflow = set_add_overflow(size, l, r);
-    memory->flags.sign = set_sign(size, result);
-    memory->flags.zero = set_zero(result);
-    memory->flags.auxCarry = set_add_aux_carry(l, r);
-    memory->flags.parity = set_parity(result);
-    memory->flags.carry = set_add_carry(size, l, r);
+    set_arg_data(&opcode->dst, memory, Alu_add(memory, OpcodeArg_size(&opcode->dst), l, r));
 }
 
 static void ADC(const Opcode *opcode, Memory *memory) {
-    // TODO
+    const uint16_t l = get_arg_data(&opcode->dst, memory);
+    const uint16_t r = get_arg_data(&opcode->src, memory);
+    set_arg_data(&opcode->dst, memory, Alu_adc(memory, OpcodeArg_size(&opcode->dst), l, r));
 }
 
 static void SUB(const Opcode *opcode, Memory *memory) {
     const uint16_t l = get_arg_data(&opcode->dst, memory);
     const uint16_t r = get_arg_data(&opcode->src, memory);
-    const uint16_t result = l - r;
-
-    set_arg_data(&opcode->dst, memory, result);
-
-    const RegSize size = OpcodeArg_size(&opcode->dst);
-    memory->flags.overflow = set_sub_overflow(l, r);
-    memory->flags.sign = set_sign(size, result);
-    memory->flags.zero = set_zero(result);
-    memory->flags.auxCarry = set_sub_aux_carry(l, r);
-    memory->flags.parity = set_parity(result);
-    memory->flags.carry = set_sub_carry(l, r);
+    set_arg_data(&opcode->dst, memory, Alu_sub(memory, OpcodeArg_size(&opcode->dst), l, r));
 }
 
 static void SBB(const Opcode *opcode, Memory *memory) {
-    // TODO
+    const uint16_t l = get_arg_data(&opcode->dst, memory);
+    const uint16_t r = get_arg_data(&opcode->src, memory);
+    set_arg_data(&opcode->dst, memory, Alu_sbb(memory, OpcodeArg_size(&opcode->dst), l, r));
 }
 
 static void CMP(const Opcode *opcode, Memory *memory) {
     const uint16_t l = get_arg_data(&opcode->dst, memory);
     const uint16_t r = get_arg_data(&opcode->src, memory);
-    const uint16_t result = l - r;
-
-    const RegSize size = OpcodeArg_size(&opcode->dst);
-    memory->flags.overflow = set_sub_overflow(l, r);
-    memory->flags.sign = set_sign(size, result);
-    memory->flags.zero = set_zero(result);
-    memory->flags.auxCarry = set_sub_aux_carry(l, r);
-    memory->flags.parity = set_parity(result);
-    memory->flags.carry = set_sub_carry(l, r);
+    Alu_sub(memory, OpcodeArg_size(&opcode->dst), l, r);
 }
 
 static void AND(const Opcode *opcode, Memory *memory) {
     const uint16_t l = get_arg_data(&opcode->dst, memory);
     const uint16_t r = get_arg_data(&opcode->src, memory);
-    const uint16_t result = l & r;
-
-    set_arg_data(&opcode->dst, memory, result);
-
-    const RegSize size = OpcodeArg_size(&opcode->dst);
-    memory->flags.overflow = 0;
-    memory->flags.sign = set_sign(size, result);
-    memory->flags.zero = set_zero(result);
-    memory->flags.parity = set_parity(result);
-    memory->flags.carry = 0;
+    set_arg_data(&opcode->dst, memory, Alu_and(memory, OpcodeArg_size(&opcode->dst), l, r));
 }
 
 static void OR(const Opcode *opcode, Memory *memory) {
     const uint16_t l = get_arg_data(&opcode->dst, memory);
     const uint16_t r = get_arg_data(&opcode->src, memory);
-    const uint16_t result = l | r;
+    set_arg_data(&opcode->dst, memory, Alu_or(memory, OpcodeArg_size(&opcode->dst), l, r));
+}
 
-    set_arg_data(&opcode->dst, memory, result);
+static void XOR(const Opcode *opcode, Memory *memory) {
+    const uint16_t l = get_arg_data(&opcode->dst, memory);
+    const uint16_t r = get_arg_data(&opcode->src, memory);
+    set_arg_data(&opcode->dst, memory, Alu_xor(memory, OpcodeArg_size(&opcode->dst), l, r));
+}
 
-    const RegSize size = OpcodeArg_size(&opcode->dst);
-    memory->flags.overflow = 0;
-    memory->flags.sign = set_sign(size, result);
-    memory->flags.zero = set_zero(result);
-    memory->flags.parity = set_parity(result);
-    memory->flags.carry = 0;
+#define UNARY(name, alu) \
+static void name(const Opcode *opcode, Memory *memory) { \
+    const uint16_t value = get_arg_data(&opcode->dst, memory); \
+    set_arg_data(&opcode->dst, memory, alu(memory, OpcodeArg_size(&opcode->dst), value)); \
 }
 
-static void XOR(const Opcode *opcode, Memory *memory) {
+UNARY(INC, Alu_inc)
+UNARY(DEC, Alu_dec)
+UNARY(NEG, Alu_neg)
+
+#undef UNARY
+
+// Count is CL or 1
+#define SHIFT(name, alu) \
+static void name(const Opcode *opcode, Memory *memory) { \
+    const uint16_t value = get_arg_data(&opcode->dst, memory); \
+    const uint8_t count = get_arg_data(&opcode->src, memory); \
+    set_arg_data(&opcode->dst, memory, alu(memory, OpcodeArg_size(&opcode->dst), value, count)); \
+}
+
+SHIFT(ROL, Alu_rol)
+SHIFT(ROR, Alu_ror)
+SHIFT(RCL, Alu_rcl)
+SHIFT(RCR, Alu_rcr)
+SHIFT(SHL, Alu_shl)
+SHIFT(SHR, Alu_shr)
+SHIFT(SAR, Alu_sar)
+
+#undef SHIFT
+
+static void MUL(const Opcode *opcode, Memory *memory) {
+    Alu_mul(memory, OpcodeArg_size(&opcode->dst), get_arg_data(&opcode->dst, memory));
+}
+
+static void IMUL(const Opcode *opcode, Memory *memory) {
+    Alu_imul(memory, OpcodeArg_size(&opcode->dst), get_arg_data(&opcode->dst, memory));
+}
+
+static void DIV(const Opcode *opcode, Memory *memory) {
+    if(!Alu_div(memory, OpcodeArg_size(&opcode->dst), get_arg_data(&opcode->dst, memory))) {
+        Memory_fault(memory, memory->registers[Register_IP] - opcode->len, "Divide error");
+    }
+}
+
+static void IDIV(const Opcode *opcode, Memory *memory) {
+    if(!Alu_idiv(memory, OpcodeArg_size(&opcode->dst), get_arg_data(&opcode->dst, memory))) {
+        Memory_fault(memory, memory->registers[Register_IP] - opcode->len, "Divide error");
+    }
+}
+
+/* -------------------- STRINGS --------------------------- */
+
+// SI and DI step by the operand size after every element, backwards if DF is set
+static inline uint16_t string_step(const Opcode *opcode, const Memory *memory) {
+    const uint16_t size = OpcodeArg_size(&opcode->dst);
+    return memory->flags.direction ? -size : size;
+}
+
+static inline void movs_once(const Opcode *opcode, Memory *memory, const uint16_t step) {
+    set_arg_data(&opcode->dst, memory, get_arg_data(&opcode->src, memory));
+    memory->registers[Register_SI] += step;
+    memory->registers[Register_DI] += step;
+}
+
+static inline void cmps_once(const Opcode *opcode, Memory *memory, const uint16_t step) {
     const uint16_t l = get_arg_data(&opcode->dst, memory);
     const uint16_t r = get_arg_data(&opcode->src, memory);
-    const uint16_t result = l ^ r;
+    Alu_sub(memory, OpcodeArg_size(&opcode->dst), l, r);
+    memory->registers[Register_SI] += step;
+    memory->registers[Register_DI] += step;
+}
 
-    set_arg_data(&opcode->dst, memory, result);
+static inline void scas_once(const Opcode *opcode, Memory *memory, const uint16_t step) {
+    const uint16_t l = get_arg_data(&opcode->dst, memory);
+    const uint16_t r = get_arg_data(&opcode->src, memory);
+    Alu_sub(memory, OpcodeArg_size(&opcode->dst), l, r);
+    memory->registers[Register_DI] += step;
+}
 
-    const RegSize size = OpcodeArg_size(&opcode->dst);
-    memory->flags.overflow = 0;
-    memory->flags.sign = set_sign(size, result);
-    memory->flags.zero = set_zero(result);
-    memory->flags.parity = set_parity(result);
-    memory->flags.carry = 0;
+static inline void lods_once(const Opcode *opcode, Memory *memory, const uint16_t step) {
+    set_arg_data(&opcode->dst, memory, get_arg_data(&opcode->src, memory));
+    memory->registers[Register_SI] += step;
 }
 
-static void JE(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.zero) {
-        unconditional_jmp(opcode, memory);
+static inline void stos_once(const Opcode *opcode, Memory *memory, const uint16_t step) {
+    set_arg_data(&opcode->dst, memory, get_arg_data(&opcode->src, memory));
+    memory->registers[Register_DI] += step;
+}
+
+/*
+ * Repeated forward MOVS as a single memmove. Only when neither range wraps around its segment
+ * or the 1 MB, and the destination doesn't start inside the source: copying forward one element
+ * at a time would then repeat the start of the source instead.
+ */
+static bool movs_bulk(const Opcode *opcode, Memory *memory) {
+    const uint16_t *regs = memory->registers;
+    const uint32_t len = (uint32_t) regs[Register_CX] * OpcodeArg_size(&opcode->dst);
+    if(regs[Register_SI] + len > SEGMENT_SIZE || regs[Register_DI] + len > SEGMENT_SIZE) {
+        return false;
+    }
+
+    const uint32_t src = Memory_linear_addr(memory, opcode->src.mem.segment, regs[Register_SI]);
+    const uint32_t dst = Memory_linear_addr(memory, opcode->dst.mem.segment, regs[Register_DI]);
+    if(src + len > RAM_SIZE || dst + len > RAM_SIZE || (dst > src && dst < src + len)) {
+        return false;
     }
+
+    Memory_copy(memory, dst, src, len);
+    memory->registers[Register_SI] += len;
+    memory->registers[Register_DI] += len;
+    memory->registers[Register_CX] = 0;
+    return true;
 }
 
-static void JL(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.sign ^ memory->flags.overflow) unconditional_jmp(opcode, memory);
+// Repeated forward STOS as a single memset, unless the destination wraps around its segment or the 1 MB
+static bool stos_bulk(const Opcode *opcode, Memory *memory) {
+    const uint16_t *regs = memory->registers;
+    const RegSize size = OpcodeArg_size(&opcode->dst);
+    const uint32_t len = (uint32_t) regs[Register_CX] * size;
+    if(regs[Register_DI] + len > SEGMENT_SIZE) {
+        return false;
+    }
+
+    const uint32_t dst = Memory_linear_addr(memory, opcode->dst.mem.segment, regs[Register_DI]);
+    if(dst + len > RAM_SIZE) {
+        return false;
+    }
+
+    Memory_fill(memory, dst, size, get_arg_data(&opcode->src, memory), regs[Register_CX]);
+    memory->registers[Register_DI] += len;
+    memory->registers[Register_CX] = 0;
+    return true;
+}
+
+static bool no_bulk(const Opcode *opcode, Memory *memory) {
+    return false;
+}
+
+/*
+ * With a repeat prefix, runs once per CX (decremented after each) until it is 0. Compare opcodes
+ * also stop once ZF doesn't match the prefix. Forward MOVS and STOS take their bulk path when the
+ * result is the same as stepping through every element.
+ */
+#define STRING(name, once, bulk, compare) \
+static void name(const Opcode *opcode, Memory *memory) { \
+    const uint16_t step = string_step(opcode, memory); \
+    if(opcode->rep == OpcodeRep_NONE) { \
+        once(opcode, memory, step); \
+        return; \
+    } \
+    if(!memory->flags.direction && bulk(opcode, memory)) { \
+        return; \
+    } \
+    uint16_t *cx = &memory->registers[Register_CX]; \
+    while(*cx) { \
+        once(opcode, memory, step); \
+        --*cx; \
+        if(compare && Flag_zero(memory) != (opcode->rep == OpcodeRep_REP)) break; \
+    } \
+}
+
+STRING(MOVS, movs_once, movs_bulk, false)
+STRING(CMPS, cmps_once, no_bulk, true)
+STRING(SCAS, scas_once, no_bulk, true)
+STRING(LODS, lods_once, no_bulk, false)
+STRING(STOS, stos_once, stos_bulk, false)
+
+#undef STRING
+
+static void REP(const Opcode *opcode, Memory *memory) {
+    fprintf(stderr, "Repeat prefix run on its own!\n");
+    abort();
 }
 
-static void JLE(const Opcode *opcode, Memory *memory) {
-    if((memory->flags.sign ^ memory->flags.overflow) || memory->flags.zero) unconditional_jmp(opcode, memory);
+/* -------------------- STACK ----------------------------- */
+
+static void PUSH(const Opcode *opcode, Memory *memory) {
+    const OpcodeArg *arg = &opcode->dst;
+    const bool sp = arg->type == OpcodeArgType_REGISTER && arg->reg.reg == Register_SP;
+    // The 8086 decrements SP before reading it, so PUSH SP stores the new value
+    Memory_push(memory, sp ? memory->registers[Register_SP] - 2 : get_arg_data(arg, memory));
 }
 
-static void JB(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.carry) unconditional_jmp(opcode, memory);
+static void POP(const Opcode *opcode, Memory *memory) {
+    set_arg_data(&opcode->dst, memory, Memory_pop(memory));
 }
 
-static void JBE(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.carry || memory->flags.zero) unconditional_jmp(opcode, memory);
+static void PUSHF(const Opcode *opcode, Memory *memory) {
+    Flags_sync(memory);
+    Memory_push(memory, Flags_word(&memory->flags));
 }
 
-static void JP(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.parity) unconditional_jmp(opcode, memory);
+static void POPF(const Opcode *opcode, Memory *memory) {
+    memory->flags = Flags_from_word(Memory_pop(memory));
+    memory->lazyFlags.op = LazyFlagsOp_NONE;
 }
 
-static void JO(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.overflow) unconditional_jmp(opcode, memory);
+static void JMP(const Opcode *opcode, Memory *memory) {
+    const FarPtr target = branch_target(opcode, memory);
+    memory->registers[Register_CS] = target.cs;
+    memory->registers[Register_IP] = target.ip;
 }
 
-static void JS(const Opcode *opcode, Memory *memory) {
-    if(memory->flags.sign) unconditional_jmp(opcode, memory);
+// Far calls push CS, then IP
+static void CALL(const Opcode *opcode, Memory *memory) {
+    const FarPtr target = branch_target(opcode, memory);
+    if(opcode->far) {
+        Memory_push(memory, memory->registers[Register_CS]);
+    }
+    Memory_push(memory, memory->registers[Register_IP]);
+    memory->registers[Register_CS] = target.cs;
+    memory->registers[Register_IP] = target.ip;
 }
 
-static void JNE(const Opcode *opcode, Memory *memory) {
-    if(!memory->flags.zero) unconditional_jmp(opcode, memory);
+// RET imm also frees imm bytes of arguments
+static void RET(const Opcode *opcode, Memory *memory) {
+    memory->registers[Register_IP] = Memory_pop(memory);
+    if(opcode->far) {
+        memory->registers[Register_CS] = Memory_pop(memory);
+    }
+    if(opcode->dst.type == OpcodeArgType_IMMEDIATE) {
+        memory->registers[Register_SP] += get_immediate(&opcode->dst.imm);
+    }
 }
 
-static void JNL(const Opcode *opcode, Memory *memory) {
-    if(!(memory->flags.sign ^ memory->flags.overflow)) unconditional_jmp(opcode, memory);
+/* -------------------- FLAGS ----------------------------- */
+
+static void CLC(const Opcode *opcode, Memory *memory) {
+    Flags_sync(memory);
+    memory->flags.carry = false;
 }
 
-static void JNLE(const Opcode *opcode, Memory *memory) {
-    if(!(memory->flags.sign ^ memory->flags.overflow) && !memory->flags.zero) unconditional_jmp(opcode, memory);
+static void STC(const Opcode *opcode, Memory *memory) {
+    Flags_sync(memory);
+    memory->flags.carry = true;
 }
 
-static void JNB(const Opcode *opcode, Memory *memory) {
-    if(!memory->flags.carry) unconditional_jmp(opcode, memory);
+static void CMC(const Opcode *opcode, Memory *memory) {
+    Flags_sync(memory);
+    memory->flags.carry = !memory->flags.carry;
 }
 
-static void JNBE(const Opcode *opcode, Memory *memory) {
-    if(!memory->flags.carry && !memory->flags.zero) unconditional_jmp(opcode, memory);
+// The rest are never computed lazily
+static void CLD(const Opcode *opcode, Memory *memory) {
+    memory->flags.direction = false;
 }
 
-static void JNP(const Opcode *opcode, Memory *memory) {
-    if(!memory->flags.parity) unconditional_jmp(opcode, memory);
+static void STD(const Opcode *opcode, Memory *memory) {
+    memory->flags.direction = true;
 }
 
-static void JNO(const Opcode *opcode, Memory *memory) {
-    if(!memory->flags.overflow) unconditional_jmp(opcode, memory);
+static void CLI(const Opcode *opcode, Memory *memory) {
+    memory->flags.interrupt = false;
 }
 
-static void JNS(const Opcode *opcode, Memory *memory) {
-    if(!memory->flags.sign) unconditional_jmp(opcode, memory);
+static void STI(const Opcode *opcode, Memory *memory) {
+    memory->flags.interrupt = true;
 }
 
-static void LOOP(const Opcode *opcode, Memory *memory) {
-    if(--memory->registers[Register_CX]) unconditional_jmp(opcode, memory);
+#define JUMP(name) \
+static void name(const Opcode *opcode, Memory *memory) { \
+    if(Cond_##name(memory)) unconditional_jmp(opcode, memory); \
 }
 
-static void LOOPZ(const Opcode *opcode, Memory *memory) {
-    if(--memory->registers[Register_CX] && memory->flags.zero) unconditional_jmp(opcode, memory);
+JUMP(JE)
+JUMP(JL)
+JUMP(JLE)
+JUMP(JB)
+JUMP(JBE)
+JUMP(JP)
+JUMP(JO)
+JUMP(JS)
+JUMP(JNE)
+JUMP(JNL)
+JUMP(JNLE)
+JUMP(JNB)
+JUMP(JNBE)
+JUMP(JNP)
+JUMP(JNO)
+JUMP(JNS)
+JUMP(LOOP)
+JUMP(LOOPZ)
+JUMP(LOOPNZ)
+JUMP(JCXZ)
+
+#undef JUMP
+
+void OpcodeTrace_begin(OpcodeTraceState *state, Memory *memory) {
+    memcpy(state->registers, memory->registers, sizeof(state->registers));
+    Flags_sync(memory);
+    state->flags = memory->flags;
+}
+
+void OpcodeTrace_changes(const uint16_t *regsBefore, const Flags *flagsBefore,
+                         const uint16_t *regsAfter, const Flags *flagsAfter, FILE *trace) {
+    // Trace Registers
+    OpcodeRegAccess regAccess = {.reg = 0, .size = RegSize_WORD, .offset = RegOffset_NONE};
+    for(Register reg = 0; reg < Register_COUNT; ++reg) {
+        if(regsBefore[reg] != regsAfter[reg]) {
+            regAccess.reg = reg;
+            fprintf(trace, " %s:0x%x->0x%x", OpcodeRegAccess_decompile(&regAccess), regsBefore[reg], regsAfter[reg]);
+        }
+    }
+
+    // Trace flags
+    char ogFlagsStr[FLAG_COUNT + 1];
+    Flags_serialize(flagsBefore, ogFlagsStr);
+
+    char flagsStr[FLAG_COUNT + 1];
+    Flags_serialize(flagsAfter, flagsStr);
+
+    if(strcmp(ogFlagsStr, flagsStr) != 0) {
+        fprintf(trace, " flags:%s->%s", ogFlagsStr, flagsStr);
+    }
 }
 
-static void LOOPNZ(const Opcode *opcode, Memory *memory) {
-    if(--memory->registers[Register_CX] && !memory->flags.zero) unconditional_jmp(opcode, memory);
+void OpcodeTrace_end(const OpcodeTraceState *state, Memory *memory, FILE *trace) {
+    Flags_sync(memory);
+    OpcodeTrace_changes(state->registers, &state->flags, memory->registers, &memory->flags, trace);
 }
 
-static void JCXZ(const Opcode *opcode, Memory *memory) {
-    if(!memory->registers[Register_CX]) unconditional_jmp(opcode, memory);
+void OpcodeTrace_final_state(const uint16_t *registers, const Flags *flags, FILE *trace) {
+    OpcodeRegAccess regAccess = {.reg=0, .size=RegSize_WORD, .offset=RegOffset_NONE};
+
+    fprintf(trace, "\nFinal registers:\n");
+    for(Register reg = 0; reg < Register_COUNT; ++reg) {
+        const uint16_t val = registers[reg];
+        if(val) {
+            regAccess.reg = reg;
+            fprintf(trace, "      %s: 0x%04x (%d)\n", OpcodeRegAccess_decompile(&regAccess), val, val);
+        }
+    }
+
+    char flagsBuf[FLAG_COUNT + 1];
+    Flags_serialize(flags, flagsBuf);
+    if(*flagsBuf) {
+        fprintf(trace, "   flags: %s\n", flagsBuf);
+    }
 }
 
-void Opcode_run(const Opcode *opcode, Memory *memory, FILE *trace) {
-    static OpcodeF ops[OpcodeType_COUNT] = {
-            [OpcodeType_NONE] = NONE,
+static const OpcodeF ops[OpcodeType_COUNT] = {
+        [OpcodeType_NONE] = NONE,
 
-            #define OPCODE(name, ...) [OpcodeType_##name] = name,
-            #define SUB_OP(...)
-            #include "../opcode_encoding_table/opcode_encoding_table.inl"
-    };
+        #define OPCODE(name, ...) [OpcodeType_##name] = name,
+        #define SUB_OP(...)
+        #include "../opcode_encoding_table/opcode_encoding_table.inl"
+};
 
+bool Opcode_can_fault(const Opcode *opcode) {
+    return opcode->type == OpcodeType_DIV || opcode->type == OpcodeType_IDIV;
+}
+
+void Opcode_exec(const Opcode *opcode, Memory *memory) {
+    ops[opcode->type](opcode, memory);
+}
+
+void Opcode_run(const Opcode *opcode, Memory *memory, FILE *trace) {
     // Trace setup
-    uint16_t ogRegs[Register_COUNT];
-    Flags ogFlags;
+    OpcodeTraceState traceState;
     if(trace) {
-        memcpy(ogRegs, memory->registers, 2*Register_COUNT);
-        ogFlags = memory->flags;
+        OpcodeTrace_begin(&traceState, memory);
     }
 
     // Advance IP
     memory->registers[Register_IP] += opcode->len;
 
     // Run opcode
-    ops[opcode->type](opcode, memory);
+    Opcode_exec(opcode, memory);
 
     if(trace) {
-        // Trace Registers
-        const uint16_t *regs = memory->registers;
-        OpcodeRegAccess regAccess = {.reg = 0, .size = RegSize_WORD, .offset = RegOffset_NONE};
-        for(Register reg = 0; reg < Register_COUNT; ++reg) {
-            if(ogRegs[reg] != regs[reg]) {
-                regAccess.reg = reg;
-                fprintf(trace, " %s:0x%x->0x%x", OpcodeRegAccess_decompile(&regAccess), ogRegs[reg], regs[reg]);
-            }
-        }
+        OpcodeTrace_end(&traceState, memory, trace);
+    }
+}
 
-        // Trace flags
-        char ogFlagsStr[FLAG_COUNT + 1];
-        Flags_serialize(&ogFlags, ogFlagsStr);
+const RunLimits RunLimits_NONE = {
+        .maxInstructions = UINT64_MAX,
+        .maxClocks = UINT64_MAX,
+        .untilIp = RUN_NO_IP,
+};
 
-        char flagsStr[FLAG_COUNT + 1];
-        Flags_serialize(&memory->flags, flagsStr);
+inline RunStop RunLimits_check(const RunLimits *limits, const Memory *memory, const uint64_t instructions, const uint64_t clocks) {
+    if(Memory_code_ended(memory)) {
+        return memory->halted ? RunStop_FAULT : RunStop_END;
+    }
+    if(memory->registers[Register_IP] == limits->untilIp) {
+        return RunStop_UNTIL_IP;
+    }
+    if(instructions >= limits->maxInstructions) {
+        return RunStop_INSTRUCTIONS;
+    }
+    if(clocks >= limits->maxClocks) {
+        return RunStop_CYCLES;
+    }
+    return RunStop_RUNNING;
+}
 
-        if(strcmp(ogFlagsStr, flagsStr) != 0) {
-            fprintf(trace, " flags:%s->%s", ogFlagsStr, flagsStr);
-        }
+const char *RunStop_name(const RunStop stop) {
+    switch(stop) {
+        case RunStop_RUNNING: return "running";
+        case RunStop_END: return "end of code";
+        case RunStop_FAULT: return "fault";
+        case RunStop_INSTRUCTIONS: return "instruction limit";
+        case RunStop_CYCLES: return "cycle limit";
+        case RunStop_UNTIL_IP: return "until ip reached";
     }
+    return "?";
 }
@@ -4,6 +4,63 @@
 #include "opcode/opcode.h"
 #include "memory/memory.h"
 
+typedef struct {
+    uint16_t registers[Register_COUNT];
+    Flags flags;
+} OpcodeTraceState;
+
+// Why a run stopped
+typedef enum {
+    RunStop_RUNNING = 0,
+    RunStop_END,            // IP reached the end of the code
+    RunStop_FAULT,          // Halted by Memory_fault
+    RunStop_INSTRUCTIONS,   // Instruction budget used up
+    RunStop_CYCLES,         // Clock budget used up
+    RunStop_UNTIL_IP,       // IP reached the requested stop IP
+} RunStop;
+
+#define RUN_NO_IP UINT32_MAX
+
+// Checked before every opcode, so every engine stops on the same one
+typedef struct {
+    uint64_t maxInstructions;   // UINT64_MAX for no limit
+    uint64_t maxClocks;         // UINT64_MAX for no limit, only counted when clocks are estimated
+    uint32_t untilIp;           // In any code segment, RUN_NO_IP for none
+} RunLimits;
+
+extern const RunLimits RunLimits_NONE;
+
+// Snapshot of the machine state before an opcode runs
+void OpcodeTrace_begin(OpcodeTraceState *state, Memory *memory);
+
+// Prints the registers and flags that changed since OpcodeTrace_begin
+void OpcodeTrace_end(const OpcodeTraceState *state, Memory *memory, FILE *trace);
+
+// Prints the registers and flags that differ between both states, ex: ` ax:0x0->0x6 flags:->Z`
+void OpcodeTrace_changes(const uint16_t *regsBefore, const Flags *flagsBefore,
+                         const uint16_t *regsAfter, const Flags *flagsAfter, FILE *trace);
+
+// Prints the `Final registers:` section closing a trace
+void OpcodeTrace_final_state(const uint16_t *registers, const Flags *flags, FILE *trace);
+
+// Effective address of a memory operand (without segment), with the current register values
+uint16_t OpcodeMemAccess_offset(const OpcodeMemAccess *access, const Memory *memory);
+
+// Segment register a memory operand is relative to
+Register OpcodeMemAccess_segment(const OpcodeMemAccess *access);
+
+// Whether running it may halt the machine (see Memory_fault)
+bool Opcode_can_fault(const Opcode *opcode);
+
+// Runs the opcode semantics only. IP must already point past the opcode
+void Opcode_exec(const Opcode *opcode, Memory *memory);
+
+// Reason to stop before running the opcode at IP, given what was run so far. RunStop_RUNNING to go on
+RunStop RunLimits_check(const RunLimits *limits, const Memory *memory, uint64_t instructions, uint64_t clocks);
+
+const char *RunStop_name(RunStop stop);
+
+// Advances IP and runs the opcode, tracing register and flag changes if trace is set
 void Opcode_run(const Opcode *opcode, Memory *memory, FILE *trace);
 
 #endif //SIM86_OPCODE_SIMULATE_H
@@ -0,0 +1,256 @@
+#include "profile.h"
+
+#if SIM86_PROFILE
+
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_TICKS_UNIT "rdtsc cycles"
+#else
+#define PROFILE_TICKS_UNIT "ns"
+#endif
+
+#include "opcode_encoding_table/opcode_encoding_table.h"
+#include "opcode_decompile/opcode_decompile.h"
+#include "opcode_fetch/opcode_fetch.h"
+
+typedef struct {
+    uint32_t key;
+    uint64_t count;
+} ProfileEntry;
+
+Profile *Profile_create(void) {
+    if(OpcodeEncodingTable_get().size > PROFILE_MAX_ENCODINGS) {
+        fprintf(stderr, "sim86: error: encoding table has more rows than the profiler can count\n");
+        return NULL;
+    }
+    return calloc(1, sizeof(Profile));
+}
+
+void Profile_destroy(Profile *profile) {
+    free(profile);
+}
+
+inline uint64_t Profile_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void push_frame(Profile *profile, const uint16_t entry, const uint16_t returnSp) {
+    if(profile->depth == PROFILE_MAX_DEPTH) {
+        return; // Its return can't pop the deepest frame, which sits higher up the stack
+    }
+
+    ProfileFunction *function = &profile->functions[entry];
+    function->calls++;
+    function->active++;
+    profile->frames[profile->depth++] = (ProfileFrame) {.entry = entry, .returnSp = returnSp};
+}
+
+static void pop_frame(Profile *profile) {
+    const ProfileFrame *frame = &profile->frames[--profile->depth];
+    ProfileFunction *function = &profile->functions[frame->entry];
+    if(--function->active == 0) {
+        function->totalInstructions += frame->instructions;
+        function->totalClocks += frame->clocks;
+    }
+
+    if(profile->depth) {
+        ProfileFrame *caller = &profile->frames[profile->depth - 1];
+        caller->instructions += frame->instructions;
+        caller->clocks += frame->clocks;
+    }
+}
+
+void Profile_start(Profile *profile, const Memory *memory) {
+    push_frame(profile, memory->registers[Register_IP], memory->registers[Register_SP]);
+}
+
+inline void Profile_count(Profile *profile, const Opcode *opcode, const uint16_t ip, const uint32_t clocks) {
+    profile->instructions++;
+    profile->byType[opcode->type]++;
+    profile->byEncoding[opcode->encoding]++;
+    profile->byIp[ip]++;
+    profile->clocks += clocks;
+
+    ProfileFrame *frame = &profile->frames[profile->depth - 1];
+    frame->instructions++;
+    frame->clocks += clocks;
+    ProfileFunction *function = &profile->functions[frame->entry];
+    function->instructions++;
+    function->clocks += clocks;
+}
+
+void Profile_call(Profile *profile, const uint16_t target, const uint16_t sp) {
+    push_frame(profile, target, sp);
+}
+
+void Profile_return(Profile *profile, const uint16_t sp) {
+    // The bottom frame is the run itself, programs may return past it
+    while(profile->depth > 1 && (int16_t) (sp - profile->frames[profile->depth - 1].returnSp) >= 0) {
+        pop_frame(profile);
+    }
+}
+
+void Profile_finish(Profile *profile) {
+    while(profile->depth) {
+        pop_frame(profile);
+    }
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const ProfileEntry *l = a, *r = b;
+    if(l->count != r->count) {
+        return l->count < r->count ? 1 : -1; // Hottest first
+    }
+    return l->key < r->key ? -1 : l->key > r->key;
+}
+
+// Non zero counts, hottest first. Returns how many
+static uint32_t sorted_entries(const uint64_t *counts, const uint32_t len, ProfileEntry *entries) {
+    uint32_t n = 0;
+    for(uint32_t i = 0; i < len; ++i) {
+        if(counts[i]) {
+            entries[n++] = (ProfileEntry) {.key = i, .count = counts[i]};
+        }
+    }
+    qsort(entries, n, sizeof(*entries), entry_cmp);
+    return n;
+}
+
+// Row layout as in the table, ex: `mov 1011 w reg data data_if_w`. Fixed fields are left out
+static void describe_encoding(const OpcodeEncoding *encoding, char *dst, const size_t size) {
+    static const char *fieldNames[OpcodeEncFieldType_COUNT] = {
+            [OpcodeEncFieldType_S] = "s",
+            [OpcodeEncFieldType_W] = "w",
+            [OpcodeEncFieldType_D] = "d",
+            [OpcodeEncFieldType_V] = "v",
+            [OpcodeEncFieldType_Z] = "z",
+            [OpcodeEncFieldType_MOD] = "mod",
+            [OpcodeEncFieldType_REG] = "reg",
+            [OpcodeEncFieldType_RM] = "rm",
+            [OpcodeEncFieldType_SR] = "sr",
+            [OpcodeEncFieldType_STR_SI] = "[si]",
+            [OpcodeEncFieldType_STR_DI] = "[di]",
+            [OpcodeEncFieldType_DISP] = "disp",
+            [OpcodeEncFieldType_DATA] = "data",
+            [OpcodeEncFieldType_IPINC8] = "ipinc8",
+            [OpcodeEncFieldType_IPINC16] = "ipinc16",
+            [OpcodeEncFieldType_DATA_IF_W] = "data_if_w",
+            [OpcodeEncFieldType_SEG] = "seg",
+            [OpcodeEncFieldType_FAR] = "far",
+    };
+
+    char name[MAX_OP_NAME_LEN + 1];
+    OpcodeType_decompile((OpcodeType) encoding->type, name);
+    size_t len = snprintf(dst, size, "%s", name);
+
+    for(const OpcodeEncField *field = encoding->fields; field->type != OpcodeEncFieldType_END && len < size; ++field) {
+        if(field->type == OpcodeEncFieldType_LITERAL) {
+            len += snprintf(dst + len, size - len, " ");
+            for(int bit = field->length - 1; bit >= 0 && len < size; --bit) {
+                len += snprintf(dst + len, size - len, "%d", (field->value >> bit) & 1);
+            }
+        } else if(field->length || field->type >= OpcodeEncFieldType_DISP) {
+            len += snprintf(dst + len, size - len, " %s", fieldNames[field->type]);
+        }
+    }
+}
+
+static void report_phases(const Profile *profile, FILE *out) {
+    static const char *names[ProfilePhase_COUNT] = {
+            [ProfilePhase_DECODE] = "decode",
+            [ProfilePhase_EXECUTE] = "execute",
+            [ProfilePhase_TRACE] = "trace",
+    };
+
+    uint64_t total = 0;
+    for(ProfilePhase phase = 0; phase < ProfilePhase_COUNT; ++phase) {
+        total += profile->ticks[phase];
+    }
+
+    fprintf(out, "   time split (%s):\n", PROFILE_TICKS_UNIT);
+    for(ProfilePhase phase = 0; phase < ProfilePhase_COUNT; ++phase) {
+        const uint64_t ticks = profile->ticks[phase];
+        fprintf(out, "      %-8s %14llu (%5.1f%%) %8.1f per instruction\n", names[phase], (unsigned long long) ticks,
+                total ? 100.0 * ticks / total : 0.0,
+                profile->instructions ? (double) ticks / profile->instructions : 0.0);
+    }
+}
+
+void Profile_report(const Profile *profile, const Memory *memory, FILE *out) {
+    ProfileEntry *entries = malloc((UINT16_MAX + 1) * sizeof(*entries));
+    if(entries == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate profile report\n");
+        return;
+    }
+    const double total = profile->instructions ? (double) profile->instructions : 1;
+
+    fprintf(out, "\nProfile: %llu instructions\n", (unsigned long long) profile->instructions);
+    report_phases(profile, out);
+
+    uint32_t n = sorted_entries(profile->byType, OpcodeType_COUNT, entries);
+    fprintf(out, "   hot instructions:\n");
+    for(uint32_t i = 0; i < n && i < PROFILE_REPORT_TOP; ++i) {
+        char name[MAX_OP_NAME_LEN + 1];
+        OpcodeType_decompile((OpcodeType) entries[i].key, name);
+        fprintf(out, "      %-24s %12llu (%5.1f%%)\n", name, (unsigned long long) entries[i].count,
+                100 * entries[i].count / total);
+    }
+
+    const OpcodeEncodingTable table = OpcodeEncodingTable_get();
+    n = sorted_entries(profile->byEncoding, table.size, entries);
+    fprintf(out, "   hot encodings:\n");
+    for(uint32_t i = 0; i < n && i < PROFILE_REPORT_TOP; ++i) {
+        char desc[128];
+        describe_encoding(&table.table[entries[i].key], desc, sizeof(desc));
+        fprintf(out, "      %-40s %12llu (%5.1f%%)\n", desc, (unsigned long long) entries[i].count,
+                100 * entries[i].count / total);
+    }
+
+    n = sorted_entries(profile->byIp, UINT16_MAX + 1, entries);
+    fprintf(out, "   hot addresses:\n");
+    for(uint32_t i = 0; i < n && i < PROFILE_REPORT_TOP; ++i) {
+        char text[MAX_OP_LEN + 1] = "?"; // Code may have been modified since
+        Opcode opcode;
+        if(Opcode_decode_at(&opcode, memory, entries[i].key) == OpcodeDecodeErr_OK) {
+            Opcode_decompile(&opcode, text);
+        }
+        fprintf(out, "      0x%04x %-30s %12llu (%5.1f%%)\n", entries[i].key, text,
+                (unsigned long long) entries[i].count, 100 * entries[i].count / total);
+    }
+
+    uint64_t *totals = malloc((UINT16_MAX + 1) * sizeof(*totals));
+    if(totals == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate profile report\n");
+        free(entries);
+        return;
+    }
+    for(uint32_t ip = 0; ip <= UINT16_MAX; ++ip) {
+        totals[ip] = profile->functions[ip].totalInstructions;
+    }
+
+    n = sorted_entries(totals, UINT16_MAX + 1, entries);
+    fprintf(out, "   hot functions (8086 clocks):\n");
+    fprintf(out, "      %-6s %10s %14s %14s %14s %14s\n", "entry", "calls", "self", "total", "self clocks", "total clocks");
+    for(uint32_t i = 0; i < n && i < PROFILE_REPORT_TOP; ++i) {
+        const ProfileFunction *function = &profile->functions[entries[i].key];
+        fprintf(out, "      0x%04x %10llu %14llu %14llu %14llu %14llu (%5.1f%%)\n", entries[i].key,
+                (unsigned long long) function->calls,
+                (unsigned long long) function->instructions, (unsigned long long) function->totalInstructions,
+                (unsigned long long) function->clocks, (unsigned long long) function->totalClocks,
+                100 * function->totalInstructions / total);
+    }
+
+    free(totals);
+    free(entries);
+}
+
+#endif // SIM86_PROFILE
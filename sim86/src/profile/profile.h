@@ -0,0 +1,85 @@
+#ifndef SIM86_PROFILE_H
+#define SIM86_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "opcode/opcode.h"
+#include "memory/memory.h"
+
+// Build with -DSIM86_PROFILE=0 to leave the profiler out, --profile is then rejected
+#ifndef SIM86_PROFILE
+#define SIM86_PROFILE 1
+#endif
+
+#define PROFILE_MAX_ENCODINGS 256 // Encoding table rows
+#define PROFILE_REPORT_TOP 10     // Entries per report section
+#define PROFILE_MAX_DEPTH 256     // Shadow stack frames, deeper calls are attributed to the deepest one
+
+#if SIM86_PROFILE
+
+typedef enum {
+    ProfilePhase_DECODE = 0, // Opcode fetch, from the opcode cache or the decoder
+    ProfilePhase_EXECUTE,
+    ProfilePhase_TRACE,      // Trace formatting
+    ProfilePhase_COUNT,
+} ProfilePhase;
+
+// Subroutine counters, by entry IP. Self counts leave out its callees, totals include them
+typedef struct {
+    uint64_t calls;
+    uint64_t instructions, clocks;
+    uint64_t totalInstructions, totalClocks;
+    uint32_t active; // Open frames, only the outermost adds to the totals when it recurses
+} ProfileFunction;
+
+// Shadow stack entry of a call, counting everything run since, callees included
+typedef struct {
+    uint16_t entry;
+    uint16_t returnSp; // SP before the return address was pushed. The frame is gone once SP is back up there
+    uint64_t instructions, clocks;
+} ProfileFrame;
+
+// Execution counters of a run. Only touched by the profiling run loop, so runs without it pay nothing
+typedef struct {
+    uint64_t instructions;
+    uint64_t byType[OpcodeType_COUNT];
+    uint64_t byEncoding[PROFILE_MAX_ENCODINGS]; // By encoding table row
+    uint64_t byIp[UINT16_MAX + 1];
+    uint64_t ticks[ProfilePhase_COUNT];         // rdtsc cycles (ns on other hosts)
+    uint64_t clocks;                            // Estimated 8086 clocks
+
+    ProfileFunction functions[UINT16_MAX + 1];
+    ProfileFrame frames[PROFILE_MAX_DEPTH];     // Shadow stack, the run entry point at the bottom
+    uint32_t depth;
+} Profile;
+
+Profile *Profile_create(void);
+
+void Profile_destroy(Profile *profile);
+
+// Timestamp counter, to take differences of
+uint64_t Profile_ticks(void);
+
+// Opens the bottom frame at the current IP, before every run
+void Profile_start(Profile *profile, const Memory *memory);
+
+// Counts an opcode run at ip, attributing it to the subroutine on top of the shadow stack
+void Profile_count(Profile *profile, const Opcode *opcode, uint16_t ip, uint32_t clocks);
+
+// A CALL to target ran, with SP at sp before it
+void Profile_call(Profile *profile, uint16_t target, uint16_t sp);
+
+// A RET ran, leaving SP at sp. Closes every frame it returned from, a single RET may unwind several
+void Profile_return(Profile *profile, uint16_t sp);
+
+// Closes the frames still open at the end of a run
+void Profile_finish(Profile *profile);
+
+// Prints the phase split and the hottest opcode types, encodings, addresses and subroutines.
+// Hot addresses are decompiled from memory
+void Profile_report(const Profile *profile, const Memory *memory, FILE *out);
+
+#endif // SIM86_PROFILE
+
+#endif //SIM86_PROFILE_H
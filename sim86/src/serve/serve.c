@@ -0,0 +1,669 @@
+#include "serve.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "memory/memory.h"
+#include "opcode_run/opcode_run.h"
+#include "opcode_clocks/opcode_clocks.h"
+
+// Sent as they are, no padding may leak
+_Static_assert(sizeof(ServeRequest) == 40, "ServeRequest must not be padded");
+_Static_assert(sizeof(ServeResponse) == 120, "ServeResponse must not be padded");
+
+typedef struct ServeConn {
+    int fd;
+    uint32_t refs;              // Its reader and every request not answered yet, guarded by the server lock
+    bool broken;                // A response could not be written, the others are dropped
+    pthread_mutex_t writeLock;  // Responses of different workers don't interleave
+    struct ServeConn *prev, *next;
+} ServeConn;
+
+typedef struct ServeJob {
+    struct ServeJob *next;
+    ServeConn *conn;
+    ServeRequest request;
+    uint8_t image[];
+} ServeJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       // A job was queued, or stopping
+    pthread_cond_t space;       // A job was taken, or stopping
+    pthread_cond_t idle;        // A reader ended
+    ServeJob *head, *tail;
+    uint32_t queued;
+    uint32_t readers;
+    ServeConn *conns;           // Open connections, to shut them down on stop
+    uint64_t maxInstructions;   // Of every request, 0 for no limit
+    bool stopping;
+} ServeServer;
+
+typedef struct {
+    ServeServer *server;
+    Sim86 *machines[Sim86Engine_JIT + 1]; // NULL for the jit where not supported
+    pthread_t thread;
+} ServeWorker;
+
+typedef struct {
+    ServeConn *conn;
+    ServeServer *server;
+} ServeReader;
+
+static volatile sig_atomic_t stopSignal;
+
+static void on_stop_signal(int sig) {
+    stopSignal = sig;
+}
+
+// Returns false on error or end of stream, even in the middle
+static bool read_all(const int fd, void *dst, size_t len) {
+    uint8_t *bytes = dst;
+    while(len) {
+        const ssize_t got = read(fd, bytes, len);
+        if(got < 0 && errno == EINTR) {
+            continue;
+        }
+        if(got <= 0) {
+            return false;
+        }
+        bytes += got;
+        len -= got;
+    }
+    return true;
+}
+
+static bool write_all(const int fd, const void *src, size_t len) {
+    const uint8_t *bytes = src;
+    while(len) {
+        const ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if(sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+/* -------------------- SERVER --------------------------- */
+
+// Drops a reference, closing the connection with the last one. Server lock held
+static void conn_release(ServeServer *server, ServeConn *conn) {
+    if(--conn->refs) {
+        return;
+    }
+
+    if(conn->prev) conn->prev->next = conn->next;
+    else server->conns = conn->next;
+    if(conn->next) conn->next->prev = conn->prev;
+
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->writeLock);
+    free(conn);
+}
+
+static void respond(ServeConn *conn, const ServeResponse *response, const char *trace) {
+    pthread_mutex_lock(&conn->writeLock);
+    if(!conn->broken) {
+        conn->broken = !write_all(conn->fd, response, sizeof(*response))
+                       || !write_all(conn->fd, trace, response->traceLen);
+    }
+    pthread_mutex_unlock(&conn->writeLock);
+}
+
+// Response of a request that could not be run
+static void respond_error(ServeConn *conn, const ServeRequest *request, const Sim86Err err) {
+    const ServeResponse response = {.magic = SERVE_MAGIC, .id = request->id, .err = err};
+    respond(conn, &response, NULL);
+}
+
+// Queues a job, waiting while the queue is full. Returns false if stopping
+static bool serve_enqueue(ServeServer *server, ServeJob *job) {
+    pthread_mutex_lock(&server->lock);
+    while(server->queued >= SERVE_QUEUE_MAX && !server->stopping) {
+        pthread_cond_wait(&server->space, &server->lock);
+    }
+    if(server->stopping) {
+        pthread_mutex_unlock(&server->lock);
+        return false;
+    }
+
+    job->next = NULL;
+    job->conn->refs++;
+    if(server->tail) server->tail->next = job;
+    else server->head = job;
+    server->tail = job;
+    server->queued++;
+    pthread_cond_signal(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+    return true;
+}
+
+// Reads the requests of a connection until it closes, queueing them without waiting for their answers
+static void *serve_reader(void *arg) {
+    ServeReader reader = *(ServeReader *) arg;
+    free(arg);
+    ServeConn *conn = reader.conn;
+    ServeServer *server = reader.server;
+
+    ServeRequest request;
+    while(read_all(conn->fd, &request, sizeof(request))) {
+        if(request.magic != SERVE_MAGIC) {
+            break; // Out of sync, nothing after it can be trusted
+        }
+        if(request.imageLen > SIM86_RAM_SIZE) {
+            respond_error(conn, &request, Sim86Err_TOO_BIG);
+            break; // Not read, so the stream can't go on
+        }
+
+        ServeJob *job = malloc(sizeof(*job) + request.imageLen);
+        if(job == NULL) {
+            respond_error(conn, &request, Sim86Err_NO_MEMORY);
+            break;
+        }
+        job->conn = conn;
+        job->request = request;
+        if(!read_all(conn->fd, job->image, request.imageLen) || !serve_enqueue(server, job)) {
+            free(job);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&server->lock);
+    conn_release(server, conn);
+    server->readers--;
+    pthread_cond_signal(&server->idle);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+// Runs a request on the worker machine of its engine. Returns the trace, or NULL if not asked for
+static char *serve_job(ServeWorker *worker, const ServeJob *job, ServeResponse *response) {
+    const ServeRequest *request = &job->request;
+    *response = (ServeResponse) {.magic = SERVE_MAGIC, .id = request->id};
+
+    if(request->engine > Sim86Engine_JIT) {
+        response->err = Sim86Err_INVALID;
+        return NULL;
+    }
+    Sim86 *sim = worker->machines[request->engine];
+    if(sim == NULL) {
+        sim = worker->machines[Sim86Engine_BLOCKS]; // As `sim86 run --engine=jit` where not supported
+    }
+
+    Sim86Err err = Sim86_set_cpu(sim, (Sim86Cpu) request->cpu);
+    if(!err) {
+        err = Sim86_load_program(sim, job->image, request->imageLen);
+    }
+
+    char *trace = NULL;
+    size_t traceLen = 0;
+    FILE *traceFile = NULL;
+    if(!err && request->trace && (traceFile = open_memstream(&trace, &traceLen)) == NULL) {
+        err = Sim86Err_NO_MEMORY;
+    }
+    if(err) {
+        response->err = err;
+        return NULL;
+    }
+
+    const uint64_t ceiling = worker->server->maxInstructions;
+    const Sim86Limits limits = {
+            .maxInstructions = ceiling && (!request->maxInstructions || request->maxInstructions > ceiling)
+                    ? ceiling : request->maxInstructions,
+            .maxClocks = request->maxClocks,
+            .untilIp = request->untilIp,
+    };
+    Sim86_set_trace_file(sim, traceFile);
+    response->stop = Sim86_run_limited(sim, &limits);
+    Sim86_set_trace_file(sim, NULL);
+
+    if(traceFile) {
+        // The text is only complete once closed
+        if(fclose(traceFile) || traceLen > UINT32_MAX) {
+            free(trace);
+            *response = (ServeResponse) {.magic = SERVE_MAGIC, .id = request->id, .err = Sim86Err_NO_MEMORY};
+            return NULL;
+        }
+        response->traceLen = (uint32_t) traceLen;
+    }
+
+    for(Sim86Register reg = 0; reg < Sim86Register_COUNT; ++reg) {
+        response->registers[reg] = Sim86_get_register(sim, reg);
+    }
+    response->flags = Sim86_get_flags(sim);
+    const char *fault = Sim86_fault(sim, &response->faultCs, &response->faultIp);
+    if(fault) {
+        snprintf(response->fault, sizeof(response->fault), "%s", fault);
+    }
+    response->instructions = Sim86_instructions(sim);
+    response->clocks = Sim86_clocks(sim);
+    response->checksum = Sim86_checksum(sim);
+    return trace;
+}
+
+static void *serve_worker(void *arg) {
+    ServeWorker *worker = arg;
+    ServeServer *server = worker->server;
+
+    while(true) {
+        pthread_mutex_lock(&server->lock);
+        while(server->head == NULL && !server->stopping) {
+            pthread_cond_wait(&server->ready, &server->lock);
+        }
+        if(server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
+        }
+
+        ServeJob *job = server->head;
+        server->head = job->next;
+        if(server->head == NULL) {
+            server->tail = NULL;
+        }
+        server->queued--;
+        pthread_cond_signal(&server->space);
+        pthread_mutex_unlock(&server->lock);
+
+        ServeResponse response;
+        char *trace = serve_job(worker, job, &response);
+        respond(job->conn, &response, trace);
+        free(trace);
+
+        pthread_mutex_lock(&server->lock);
+        conn_release(server, job->conn);
+        pthread_mutex_unlock(&server->lock);
+        free(job);
+    }
+}
+
+static void destroy_machines(ServeWorker *worker) {
+    for(Sim86Engine engine = Sim86Engine_OPCODES; engine <= Sim86Engine_JIT; ++engine) {
+        Sim86_destroy(worker->machines[engine]);
+    }
+}
+
+// Every machine of a worker, created before serving so requests never wait for them
+static bool create_machines(ServeWorker *worker) {
+    for(Sim86Engine engine = Sim86Engine_OPCODES; engine <= Sim86Engine_JIT; ++engine) {
+        const Sim86Err err = Sim86_create(&worker->machines[engine], engine);
+        if(err && !(err == Sim86Err_UNSUPPORTED && engine == Sim86Engine_JIT)) {
+            fprintf(stderr, "sim86: error: failed to create a machine: %s\n", Sim86Err_name(err));
+            destroy_machines(worker);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int listen_on(const char *socketPath) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if(strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "sim86: error: socket path '%s' is too long\n", socketPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    // A socket left behind by a server that didn't stop cleanly, never any other file
+    struct stat stats;
+    if(stat(socketPath, &stats) == 0 && S_ISSOCK(stats.st_mode)) {
+        unlink(socketPath);
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+        fprintf(stderr, "sim86: error: listen on '%s': %s\n", socketPath, strerror(errno));
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Starts a reader for an accepted connection. Server lock held
+static void serve_accept(ServeServer *server, const int fd) {
+    ServeConn *conn = calloc(1, sizeof(*conn));
+    ServeReader *reader = malloc(sizeof(*reader));
+    if(conn == NULL || reader == NULL) {
+        free(conn);
+        free(reader);
+        close(fd);
+        return;
+    }
+    conn->fd = fd;
+    conn->refs = 1;
+    pthread_mutex_init(&conn->writeLock, NULL);
+    *reader = (ServeReader) {.conn = conn, .server = server};
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    if(pthread_create(&thread, &attr, serve_reader, reader)) {
+        pthread_mutex_destroy(&conn->writeLock);
+        free(conn);
+        free(reader);
+        close(fd);
+    } else {
+        conn->next = server->conns;
+        if(server->conns) server->conns->prev = conn;
+        server->conns = conn;
+        server->readers++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+bool Serve_run(const char *socketPath, uint32_t threads, const uint64_t maxInstructions) {
+    if(threads == 0) {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores < 1 ? 1 : cores > SERVE_MAX_THREADS ? SERVE_MAX_THREADS : (uint32_t) cores;
+    }
+
+    ServeWorker *workers = calloc(threads, sizeof(*workers));
+    if(workers == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate workers\n");
+        return false;
+    }
+
+    ServeServer server = {.maxInstructions = maxInstructions};
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+    pthread_cond_init(&server.space, NULL);
+    pthread_cond_init(&server.idle, NULL);
+
+    uint32_t created = 0;
+    for(; created < threads; ++created) {
+        workers[created].server = &server;
+        if(!create_machines(&workers[created])) {
+            break;
+        }
+    }
+    const int listenFd = created == threads ? listen_on(socketPath) : -1;
+
+    // Stop signals are only taken while waiting for connections, every thread started from here blocks them
+    sigset_t stopSignals, waitMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &waitMask);
+    sigdelset(&waitMask, SIGINT);
+    sigdelset(&waitMask, SIGTERM);
+    struct sigaction action = {.sa_handler = on_stop_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    stopSignal = 0;
+
+    uint32_t started = 0;
+    for(; listenFd >= 0 && started < threads; ++started) {
+        if(pthread_create(&workers[started].thread, NULL, serve_worker, &workers[started])) {
+            fprintf(stderr, "sim86: warning: could only start %u threads\n", started);
+            break;
+        }
+    }
+
+    const bool ok = listenFd >= 0 && started > 0;
+    if(ok) {
+        fprintf(stderr, "sim86: serving on '%s' with %u threads\n", socketPath, started);
+    }
+
+    while(ok && !stopSignal) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(listenFd, &fds);
+        if(pselect(listenFd + 1, &fds, NULL, NULL, NULL, &waitMask) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "sim86: error: wait for connections: %s\n", strerror(errno));
+            break;
+        }
+
+        const int fd = accept(listenFd, NULL, NULL);
+        if(fd < 0) {
+            continue; // Gone before accepted, or out of descriptors until some close
+        }
+        pthread_mutex_lock(&server.lock);
+        serve_accept(&server, fd);
+        pthread_mutex_unlock(&server.lock);
+    }
+
+    if(listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath);
+    }
+
+    // Unblock the readers and the workers, requests not started yet are dropped
+    pthread_mutex_lock(&server.lock);
+    server.stopping = true;
+    for(ServeConn *conn = server.conns; conn; conn = conn->next) {
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&server.ready);
+    pthread_cond_broadcast(&server.space);
+    pthread_mutex_unlock(&server.lock);
+
+    for(uint32_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pthread_mutex_lock(&server.lock);
+    while(server.head) {
+        ServeJob *job = server.head;
+        server.head = job->next;
+        conn_release(&server, job->conn);
+        free(job);
+    }
+    while(server.readers) {
+        pthread_cond_wait(&server.idle, &server.lock);
+    }
+    pthread_mutex_unlock(&server.lock);
+
+    for(uint32_t i = 0; i < created; ++i) {
+        destroy_machines(&workers[i]);
+    }
+    free(workers);
+    pthread_cond_destroy(&server.idle);
+    pthread_cond_destroy(&server.space);
+    pthread_cond_destroy(&server.ready);
+    pthread_mutex_destroy(&server.lock);
+    pthread_sigmask(SIG_UNBLOCK, &stopSignals, NULL);
+    return ok;
+}
+
+/* -------------------- CLIENT --------------------------- */
+
+typedef struct {
+    const char *path;
+    uint8_t *image;
+    uint32_t imageLen;
+    bool loaded;
+    bool answered;
+    ServeResponse response;
+    char *trace;
+} ServeClientFile;
+
+typedef struct {
+    int fd;
+    const ServeRequest *base;
+    ServeClientFile *files;
+    int count;
+} ServeSender;
+
+int Serve_connect(const char *socketPath) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if(strlen(socketPath) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// Reads a whole program, which must fit in memory
+static bool read_program(ServeClientFile *file) {
+    FILE *in = fopen(file->path, "rb");
+    if(in == NULL) {
+        fprintf(stderr, "sim86: error: open '%s': %s\n", file->path, strerror(errno));
+        return false;
+    }
+
+    file->image = malloc(SIM86_RAM_SIZE + 1);
+    const size_t len = file->image ? fread(file->image, 1, SIM86_RAM_SIZE + 1, in) : 0;
+    const bool failed = file->image == NULL || ferror(in);
+    fclose(in);
+    if(failed) {
+        fprintf(stderr, "sim86: error: failed to read '%s'\n", file->path);
+        return false;
+    }
+    if(len > SIM86_RAM_SIZE) {
+        fprintf(stderr, "sim86: error: '%s' doesn't fit in memory at its address\n", file->path);
+        return false;
+    }
+    file->imageLen = (uint32_t) len;
+    return true;
+}
+
+// Sends every request back to back, the answers are read meanwhile
+static void *client_sender(void *arg) {
+    const ServeSender *sender = arg;
+
+    for(int i = 0; i < sender->count; ++i) {
+        const ServeClientFile *file = &sender->files[i];
+        if(!file->loaded) {
+            continue;
+        }
+
+        ServeRequest request = *sender->base;
+        request.magic = SERVE_MAGIC;
+        request.id = (uint32_t) i;
+        request.imageLen = file->imageLen;
+        if(!write_all(sender->fd, &request, sizeof(request)) || !write_all(sender->fd, file->image, file->imageLen)) {
+            break; // The server went away, so do the answers
+        }
+    }
+    return NULL;
+}
+
+static bool client_print(const ServeClientFile *file, const ServeRequest *base, const int count, FILE *out) {
+    const ServeResponse *response = &file->response;
+    if(count > 1) {
+        fprintf(out, "%s:\n", file->path);
+    }
+    if(response->err != Sim86Err_OK) {
+        fprintf(stderr, "sim86: error: '%s' was not run: %s\n", file->path, Sim86Err_name((Sim86Err) response->err));
+        return false;
+    }
+
+    if(file->trace) {
+        fwrite(file->trace, 1, response->traceLen, out);
+    }
+
+    const Flags flags = Flags_from_word(response->flags);
+    OpcodeTrace_final_state(response->registers, &flags, out);
+    if(!base->trace) {
+        fprintf(out, "   memory: %016llx\n", (unsigned long long) response->checksum);
+    }
+    if(base->cpu != Sim86Cpu_NONE) {
+        const CpuModel model = base->cpu == Sim86Cpu_8088 ? CpuModel_8088 : CpuModel_8086;
+        fprintf(out, "\nTotal clocks: %llu (%s)\n", (unsigned long long) response->clocks, CpuModel_name(model));
+    }
+
+    if(response->stop == Sim86Stop_FAULT) {
+        fprintf(stderr, "sim86: error: %s at %04x:%04x\n", response->fault, response->faultCs, response->faultIp);
+    } else if(response->stop != Sim86Stop_END) {
+        fprintf(stderr, "sim86: stopped at %04x:%04x: %s\n", response->registers[Sim86Register_CS],
+                response->registers[Sim86Register_IP], Sim86Stop_name((Sim86Stop) response->stop));
+    }
+    return true;
+}
+
+bool Serve_client(const int fd, const ServeRequest *base, const char **files, const int count, FILE *out) {
+    ServeClientFile *clientFiles = calloc(count, sizeof(*clientFiles));
+    if(clientFiles == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate requests\n");
+        return false;
+    }
+
+    bool ok = true;
+    int expected = 0;
+    for(int i = 0; i < count; ++i) {
+        clientFiles[i].path = files[i];
+        clientFiles[i].loaded = read_program(&clientFiles[i]);
+        expected += clientFiles[i].loaded;
+        ok = clientFiles[i].loaded && ok;
+    }
+
+    ServeSender sender = {.fd = fd, .base = base, .files = clientFiles, .count = count};
+    pthread_t senderThread;
+    const bool sending = expected && pthread_create(&senderThread, NULL, client_sender, &sender) == 0;
+    if(expected && !sending) {
+        fprintf(stderr, "sim86: error: failed to start sending\n");
+        ok = false;
+    }
+
+    // Answers come in any order, they are printed in the order of the files
+    int nextPrint = 0;
+    for(int received = 0; sending && received < expected; ++received) {
+        ServeResponse response;
+        if(!read_all(fd, &response, sizeof(response)) || response.magic != SERVE_MAGIC
+           || response.id >= (uint32_t) count || !clientFiles[response.id].loaded || clientFiles[response.id].answered) {
+            fprintf(stderr, "sim86: error: connection to the server lost\n");
+            ok = false;
+            break;
+        }
+
+        ServeClientFile *file = &clientFiles[response.id];
+        file->response = response;
+        if(response.traceLen) {
+            file->trace = malloc(response.traceLen);
+            if(file->trace == NULL || !read_all(fd, file->trace, response.traceLen)) {
+                fprintf(stderr, "sim86: error: failed to receive the trace of '%s'\n", file->path);
+                ok = false;
+                break;
+            }
+        }
+        file->answered = true;
+
+        for(; nextPrint < count && (clientFiles[nextPrint].answered || !clientFiles[nextPrint].loaded); ++nextPrint) {
+            ServeClientFile *printed = &clientFiles[nextPrint];
+            if(printed->answered) {
+                ok = client_print(printed, base, count, out) && ok;
+                free(printed->trace);
+                printed->trace = NULL;
+            }
+        }
+    }
+
+    if(sending) {
+        shutdown(fd, SHUT_RDWR); // Unblocks the sender if the server went away
+        pthread_join(senderThread, NULL);
+    }
+    for(int i = 0; i < count; ++i) {
+        free(clientFiles[i].image);
+        free(clientFiles[i].trace);
+    }
+    free(clientFiles);
+    return ok;
+}
@@ -0,0 +1,68 @@
+#ifndef SIM86_SERVE_H
+#define SIM86_SERVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "libsim86/libsim86.h"
+
+/*
+ * Simulation server over a local Unix socket. Every worker thread owns a machine per engine, created
+ * up front and reloaded in place for each request, so a request costs its run and not a process.
+ *
+ * Frames are fixed headers in host byte order (both ends are on the same host) followed by their
+ * payload. A connection may send any number of requests without waiting: they are run on the next
+ * free worker and answered as they finish, so responses may come back in another order. The id of
+ * a request is echoed in its response to match them.
+ */
+
+#define SERVE_MAGIC 0x36384d53          // `SM86`
+#define SERVE_MAX_THREADS 256
+#define SERVE_QUEUE_MAX 1024            // Requests read ahead of the workers, across connections
+#define SERVE_FAULT_LEN 48
+
+typedef struct {
+    uint32_t magic;
+    uint32_t id;                // Echoed in the response
+    uint32_t imageLen;          // Program bytes following the header, loaded at 0000:0000
+    uint32_t untilIp;           // SIM86_NO_IP for none
+    uint64_t maxInstructions;   // 0 for no limit
+    uint64_t maxClocks;         // 0 for no limit
+    uint8_t engine;             // Sim86Engine, the jit falls back to blocks where not supported
+    uint8_t cpu;                // Sim86Cpu, to estimate clocks (opcodes engine only)
+    uint8_t trace;              // Send back what `sim86 trace` prints for every opcode
+    uint8_t reserved[5];
+} ServeRequest;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t id;
+    uint64_t instructions;
+    uint64_t clocks;
+    uint64_t checksum;          // Of the whole memory, as `--final-state` prints it
+    uint32_t traceLen;          // Trace text following the header
+    uint8_t err;                // Sim86Err, the request was not run unless Sim86Err_OK
+    uint8_t stop;               // Sim86Stop
+    uint16_t flags;
+    uint16_t registers[Sim86Register_COUNT];
+    uint16_t faultCs, faultIp;
+    char fault[SERVE_FAULT_LEN]; // Why it faulted, empty if it didn't
+    uint16_t reserved;
+} ServeResponse;
+
+// Serves on socketPath, replacing a stale socket, with a worker per thread (0 for one per core). Requests
+// run at most maxInstructions (0 for no limit), whatever they ask for.
+// Returns on SIGINT or SIGTERM once the running requests end, removing the socket, or false if it could not start
+bool Serve_run(const char *socketPath, uint32_t threads, uint64_t maxInstructions);
+
+// Connects to a server, returns the socket or -1 (errno is set)
+int Serve_connect(const char *socketPath);
+
+// Sends every file as a request with the options of base, then prints the answers in file order: the
+// trace if asked, final registers (with the memory checksum unless traced) and total clocks if estimated,
+// as `sim86 run --final-state` or `sim86 trace` would. Faults and limits are reported on stderr.
+// Returns false if a file or the connection failed
+bool Serve_client(int fd, const ServeRequest *base, const char **files, int count, FILE *out);
+
+#endif //SIM86_SERVE_H
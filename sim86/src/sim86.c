@@ -2,138 +2,1480 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
 
 #include "memory/memory.h"
+#include "alu/alu.h"
 #include "opcode_encoding/opcode_encoding.h"
 #include "opcode_encoding_table/opcode_encoding_table.h"
 #include "opcode_decompile/opcode_decompile.h"
 #include "opcode_run/opcode_run.h"
+#include "opcode_fetch/opcode_fetch.h"
+#include "block_run/block_run.h"
+#include "jit/jit.h"
+#include "opcode_clocks/opcode_clocks.h"
+#include "trace_stream/trace_stream.h"
+#include "profile/profile.h"
+#include "disasm/disasm.h"
+#include "cfg/cfg.h"
+#include "serve/serve.h"
+
+#define BATCH_MAX_THREADS 256
+#define BENCH_DEFAULT_TRIALS 10
+#define BENCH_MAX_TRIALS 1000
+#define BENCH_DECOMPILE_MIN_NS 5000000 // Decompile sweeps per trial, code is usually short
+#define MAX_LOAD_IMAGES 16
+
+typedef enum {
+    Engine_OPCODES = 0, // Decode and run one opcode at a time
+    Engine_BLOCKS,      // Translated basic blocks
+    Engine_JIT,         // Translated basic blocks, hot ones compiled to native code
+} Engine;
+
+// Extra file placed in memory before running
+typedef struct {
+    const char *path; // Not terminated, points into the argument
+    int pathLen;
+    uint32_t addr;    // Linear
+} LoadImage;
+
+typedef struct {
+    const char *cmd;
+    const char *srcFile;
+    const char **srcFiles; // Every source file, for batch
+    int srcCount;
+    uint32_t threads;      // Batch worker threads, 0 for one per core
+    uint32_t trials;       // Bench trials per mode
+    const char *csvOut, *jsonOut; // Bench results, appended
+    bool stats;
+    bool labels;          // Decompile with branch target labels
+    bool profile;
+    bool finalState;
+    Engine engine;
+    uint32_t jitThreshold;
+    bool cycles;
+    CpuModel cpuModel;
+    const char *traceOut; // Binary trace stream path
+    const char *dumpDirty;
+    uint32_t dirtyPageSize;
+    const char *saveState, *loadState;
+    uint32_t repeat;      // Runs from the same initial state
+    LoadImage loads[MAX_LOAD_IMAGES];
+    int loadCount;
+    RunLimits limits;     // Of every run
+    const char *socketPath; // Serve and client
+    bool trace;           // Client asks for the trace
+} Options;
+
+typedef struct {
+    uint64_t instructions;
+    uint64_t clocks;
+    uint64_t restoreNs;
+    const BlockEngine *blocks;
+    RunStop stop;         // Of the last run
+} RunStats;
+
+// Exit status of run/trace by why it stopped, EXIT_FAILURE being left for errors
+static const int stopStatus[] = {
+        [RunStop_END] = EXIT_SUCCESS,
+        [RunStop_FAULT] = 2,
+        [RunStop_INSTRUCTIONS] = 3,
+        [RunStop_CYCLES] = 4,
+        [RunStop_UNTIL_IP] = 5,
+};
 
 static void print_usage(void) {
-    fprintf(stderr, "Usage: sim86 <cmd> <src_file>\n");
-    fprintf(stderr, "Available commands: decompile, run, trace\n");
+    fprintf(stderr, "Usage: sim86 <cmd> [options] <src_file>\n");
+    fprintf(stderr, "       sim86 <run|trace> [options] --load-state=<state_file>\n");
+    fprintf(stderr, "       sim86 decompile [--threads=<n> | --labels] <src_file>\n");
+    fprintf(stderr, "       sim86 batch [--threads=<n>] [options] <src_file>...\n");
+    fprintf(stderr, "       sim86 bench [--trials=<n>] [--csv=<file>] [--json=<file>] [--engine=<engine>] <src_file>...\n");
+    fprintf(stderr, "       sim86 serve --socket=<path> [--threads=<n>] [--max-instructions=<n>]\n");
+    fprintf(stderr, "       sim86 client --socket=<path> [--trace] [options] <src_file>...\n");
+    fprintf(stderr, "Available commands: decompile, run, trace, trace-dump, batch, bench, bench-decode, bench-decompile, serve, client\n");
+    fprintf(stderr, "Available options:\n");
+    fprintf(stderr, "   --stats             Print execution statistics after run/trace\n");
+    fprintf(stderr, "   --engine=<engine>   Execution engine for run/trace: opcodes (default), blocks, jit\n");
+    fprintf(stderr, "   --jit-threshold=<n> Block entries before it is compiled to native code (default %d)\n", JIT_DEFAULT_THRESHOLD);
+    fprintf(stderr, "   --profile           Count opcodes by type, encoding, address and subroutine and time each phase. Opcodes engine only\n");
+    fprintf(stderr, "   --final-state       Print final registers, flags and a memory checksum after run\n");
+    fprintf(stderr, "   --cycles[=<cpu>]    Estimate clocks per opcode on an 8086 (default) or 8088, opcodes engine only\n");
+    fprintf(stderr, "   --trace-out=<file>  Write trace as a binary stream, render it with trace-dump. Opcodes engine only\n");
+    fprintf(stderr, "   --dump-dirty=<file> Write the memory pages modified by run/trace to file\n");
+    fprintf(stderr, "   --dirty-page-size=<bytes> Dirty page granularity, power of 2 from 256 to 65536 (default 4096)\n");
+    fprintf(stderr, "   --save-state=<file> Save the machine state after run/trace\n");
+    fprintf(stderr, "   --load-state=<file> Start run/trace from a saved machine state instead of a source file\n");
+    fprintf(stderr, "   --repeat=<n>        Run n times, restoring the initial state from a snapshot in between. Run and batch only\n");
+    fprintf(stderr, "   --load=<file>@<segment>:<offset> Place file in memory before run/trace (hex address, repeatable)\n");
+    fprintf(stderr, "   --max-instructions=<n> Stop run/trace/batch after n instructions (exit status 3)\n");
+    fprintf(stderr, "   --max-cycles=<n>    Stop run/trace once n clocks are estimated, as --cycles (exit status 4). Opcodes engine only\n");
+    fprintf(stderr, "   --until-ip=<ip>     Stop run/trace/batch when IP reaches ip, in hex (exit status 5)\n");
+    fprintf(stderr, "   --labels            Decompile with a label on every branch target\n");
+    fprintf(stderr, "   --threads=<n>       Batch or serve worker threads (default one per core), or decompile threads (default 1)\n");
+    fprintf(stderr, "   --socket=<path>     Unix socket to serve on, or for the client to send to\n");
+    fprintf(stderr, "   --trace             Client gets the trace of every file back, as trace prints it\n");
+    fprintf(stderr, "   --trials=<n>        Bench trials per mode (default %d)\n", BENCH_DEFAULT_TRIALS);
+    fprintf(stderr, "   --csv=<file>        Append bench results as CSV rows\n");
+    fprintf(stderr, "   --json=<file>       Append bench results as JSON lines\n");
 }
 
-static void print_opcode_decoding_error(const OpcodeDecodeErr err) {
+// Prints why path could not be loaded, if it couldn't. Returns whether it was
+static bool check_load86(const MemoryLoadErr err, const char *path) {
     switch(err) {
-        case OpcodeDecodeErr_OK: break; // No error
-        case OpcodeDecodeErr_NOT_COMPAT: {
-            fprintf(stderr, "sim86: error: Opcode encoding used was not compatible with the actual code\n");
-        } break;
-        case OpcodeDecodeErr_END: {
-            fprintf(stderr, "sim86: error: Code ended in the middle of an opcode\n");
-        } break;
-        case OpcodeDecodeErr_INVALID: {
-            fprintf(stderr, "sim86: error: Invalid opcode code for encoding\n");
-        } break;
+        case MemoryLoadErr_OK: return true;
+        case MemoryLoadErr_OPEN: fprintf(stderr, "sim86: error: open '%s': %s\n", path, strerror(errno)); break;
+        case MemoryLoadErr_READ: fprintf(stderr, "sim86: error: failed to read '%s': %s\n", path, strerror(errno)); break;
+        case MemoryLoadErr_TOO_BIG: fprintf(stderr, "sim86: error: '%s' doesn't fit in memory at its address\n", path); break;
     }
+    return false;
 }
 
-static bool parse_opcode(Opcode *opcode, Memory *mem) {
-    if(Memory_code_ended(mem)) {
-        return false;
+// Prints why the machine halted
+static void print_fault86(const Memory *memory) {
+    fprintf(stderr, "sim86: error: %s at %04x:%04x\n", memory->fault, memory->faultCs, memory->faultIp);
+}
+
+// Reports a decode error at ip the same way a run would, and exits
+static void decompile_error86(Memory *memory, const uint16_t ip) {
+    memory->registers[Register_IP] = ip;
+    Opcode opcode;
+    Opcode_parse(&opcode, memory);
+    print_fault86(memory);
+    exit(EXIT_FAILURE);
+}
+
+// Returns the number of opcodes decompiled
+static uint64_t decompile_labeled86(Memory *memory, FILE *out) {
+    Disasm disasm = {0};
+    Cfg cfg;
+    if(!Disasm_decode(&disasm, memory, memory->registers[Register_IP]) || !Cfg_build(&cfg, &disasm)) {
+        fprintf(stderr, "sim86: error: failed to allocate disassembly\n");
+        exit(EXIT_FAILURE);
     }
 
-    const uint8_t *codePtr = Memory_code_ptr(mem);
-    const uint8_t *codeEnd = mem->codeEnd;
+    if(!Cfg_write(&cfg, out)) {
+        fprintf(stderr, "sim86: error: failed to write disassembly\n");
+        exit(EXIT_FAILURE);
+    }
 
-    const OpcodeEncoding *encoding = OpcodeEncoding_find(codePtr, codeEnd);
-    if(encoding == NULL) {
-        fprintf(stderr, "sim86: error: Unknown opcode '0x%02x'\n", *codePtr);
+    if(disasm.err) {
+        decompile_error86(memory, disasm.endIp);
+    }
+
+    const uint64_t opcodes = disasm.count;
+    Cfg_destroy(&cfg);
+    Disasm_destroy(&disasm);
+    return opcodes;
+}
+
+// Returns the number of opcodes decompiled. More than one thread splits the code in chunks, same output
+static uint64_t decompile86(Memory *memory, FILE *out, const uint32_t threads) {
+    if(threads > 1) {
+        DisasmStatus status;
+        if(!Disasm_write_parallel(memory, memory->registers[Register_IP], threads, out, &status)) {
+            fprintf(stderr, "sim86: error: failed to write disassembly\n");
+            exit(EXIT_FAILURE);
+        }
+        if(status.err) {
+            decompile_error86(memory, status.endIp);
+        }
+        return status.count;
+    }
+
+    Disasm disasm = {0};
+    if(!Disasm_decode(&disasm, memory, memory->registers[Register_IP])) {
+        fprintf(stderr, "sim86: error: failed to allocate disassembly\n");
         exit(EXIT_FAILURE);
     }
 
-    const OpcodeDecodeErr err = OpcodeEncoding_decode(encoding, opcode, codePtr, codeEnd);
-    if(err) {
-        print_opcode_decoding_error(err);
+    if(!Disasm_write(&disasm, out)) {
+        fprintf(stderr, "sim86: error: failed to write disassembly\n");
         exit(EXIT_FAILURE);
     }
 
+    if(disasm.err) {
+        // Everything before it is already out
+        decompile_error86(memory, disasm.endIp);
+    }
+
+    const uint64_t opcodes = disasm.count;
+    Disasm_destroy(&disasm);
+    return opcodes;
+}
+
+#define BENCH_DECODE_MIN_NS 500000000 // 0.5s
+
+#define BENCH_DECOMPILE_SWEEPS_NS 200000000 // 0.2s per path
+#define SYNTHETIC_CODE_SIZE 0x10000        // 64 KB
+
+// Fills a code segment with random opcodes of every known encoding. Always the same code
+static bool load_synthetic86(Memory *memory) {
+    uint8_t *code = malloc(SYNTHETIC_CODE_SIZE);
+    if(code == NULL) {
+        return false;
+    }
+
+    uint32_t seed = 0x8086;
+    size_t len = 0;
+    while(len + MAX_OPCODE_LEN <= SYNTHETIC_CODE_SIZE) {
+        for(int i = 0; i < MAX_OPCODE_LEN; ++i) {
+            seed ^= seed << 13; // xorshift32
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            code[len + i] = seed;
+        }
+
+        Opcode opcode;
+        if(Opcode_decode(&opcode, code + len, code + len + MAX_OPCODE_LEN) == OpcodeDecodeErr_OK) {
+            len += opcode.len;
+        }
+    }
+
+    uint8_t *codeSegment = Memory_segment_ptr(memory, Register_CS);
+    Memory_write_bytes(memory, codeSegment - memory->ram, code, len);
+    memory->codeEnd = codeSegment + len;
+    free(code);
     return true;
 }
 
-static void decompile86(Memory *memory, FILE *out) {
-    fprintf(out, "bits 16\n\n");
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    for(Opcode opcode; parse_opcode(&opcode, memory); memory->registers[Register_IP] += opcode.len) {
-        Opcode_decompile_to_file(&opcode, out);
-        fputc('\n', out);
+// Compares decompiling one opcode at a time through stdio against the bulk path, in MB/s of code
+static void bench_decompile86(Memory *memory, FILE *out) {
+    FILE *sink = fopen("/dev/null", "w");
+    if(sink == NULL) {
+        fprintf(stderr, "sim86: error: open '/dev/null': %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
+
+    const uint16_t startIp = memory->registers[Register_IP];
+    const double codeMB = (memory->codeEnd - Memory_code_ptr(memory)) / 1e6;
+    uint64_t opcodes = 0;
+
+    // One opcode at a time, as decompile used to
+    uint64_t sweeps = 0;
+    uint64_t start = now_ns(), elapsed;
+    do {
+        memory->registers[Register_IP] = startIp;
+        fputs(DISASM_HEADER, sink);
+        opcodes = 0;
+        for(Opcode opcode; Opcode_parse(&opcode, memory); memory->registers[Register_IP] += opcode.len) {
+            Opcode_decompile_to_file(&opcode, sink);
+            fputc('\n', sink);
+            opcodes++;
+        }
+        if(memory->halted) {
+            print_fault86(memory);
+            exit(EXIT_FAILURE);
+        }
+        sweeps++;
+        elapsed = now_ns() - start;
+    } while(elapsed < BENCH_DECOMPILE_SWEEPS_NS);
+    memory->registers[Register_IP] = startIp;
+    const double streamingMBs = codeMB * sweeps / (elapsed / 1e9);
+
+    // Decode everything, format into one buffer, single write
+    sweeps = 0;
+    start = now_ns();
+    do {
+        decompile86(memory, sink, 1);
+        sweeps++;
+        elapsed = now_ns() - start;
+    } while(elapsed < BENCH_DECOMPILE_SWEEPS_NS);
+    const double bulkMBs = codeMB * sweeps / (elapsed / 1e9);
+
+    fprintf(out, "decompile: %.1f KB, %llu opcodes, %.2f MB/s one at a time, %.2f MB/s bulk (%.2fx)\n",
+            codeMB * 1e3, (unsigned long long) opcodes, streamingMBs, bulkMBs, bulkMBs / streamingMBs);
+    fclose(sink);
 }
 
-static void run86(Memory *memory, FILE *trace) {
-    for(Opcode opcode; parse_opcode(&opcode, memory); ) {
+static void bench_decode86(Memory *memory, FILE *out) {
+    const uint16_t startIp = memory->registers[Register_IP];
+
+    uint64_t instructions = 0;
+    uint64_t sweeps = 0;
+    const uint64_t start = now_ns();
+    uint64_t elapsed;
+
+    // Repeat linear sweeps over the whole code segment until we have enough samples
+    do {
+        memory->registers[Register_IP] = startIp;
+        for(Opcode opcode; Opcode_parse(&opcode, memory); memory->registers[Register_IP] += opcode.len) {
+            instructions++;
+        }
+        if(memory->halted) {
+            print_fault86(memory);
+            exit(EXIT_FAILURE);
+        }
+        sweeps++;
+        elapsed = now_ns() - start;
+    } while(elapsed < BENCH_DECODE_MIN_NS && instructions > 0);
+
+    memory->registers[Register_IP] = startIp;
+
+    fprintf(out, "decode: %llu instructions (%llu sweeps) in %.3f ms, %.2f ns/instruction\n",
+            (unsigned long long) instructions, (unsigned long long) sweeps,
+            elapsed / 1e6, instructions ? (double) elapsed / instructions : 0.0);
+}
+
+#undef BENCH_DECODE_MIN_NS
+
+static void print_stats(const Memory *memory, const RunStats *stats, FILE *out) {
+    fprintf(out, "\nStats:\n");
+    fprintf(out, "   instructions: %llu\n", (unsigned long long) stats->instructions);
+
+    uint32_t dirtyBytes = 0, dirtyRanges = 0;
+    MemoryRange range;
+    for(uint32_t cursor = 0; Memory_next_dirty(memory, &cursor, &range); ) {
+        dirtyBytes += range.end - range.start;
+        dirtyRanges++;
+    }
+    fprintf(out, "   dirty memory: %u bytes in %u ranges\n", dirtyBytes, dirtyRanges);
+
+    const OpcodeCache *cache = memory->opcodeCache;
+    if(cache) {
+        fprintf(out, "   opcode cache: %llu hits, %llu misses (%.2f%% hit rate), %llu invalidations\n",
+                (unsigned long long) cache->hits, (unsigned long long) cache->misses,
+                100 * OpcodeCache_hit_rate(cache), (unsigned long long) cache->invalidations);
+    }
+
+    const MemorySnapshot *snapshot = memory->snapshot;
+    if(snapshot && snapshot->restores) {
+        fprintf(out, "   snapshot: %llu restores (%.2f us each), %llu pages saved, %llu pages restored\n",
+                (unsigned long long) snapshot->restores, stats->restoreNs / 1e3 / snapshot->restores,
+                (unsigned long long) snapshot->pagesSaved, (unsigned long long) snapshot->pagesRestored);
+    }
+
+    const BlockEngine *blocks = stats->blocks;
+    if(blocks) {
+        fprintf(out, "   blocks: %llu translated, %llu entered, %llu flushes\n",
+                (unsigned long long) blocks->blocksTranslated, (unsigned long long) blocks->blocksEntered,
+                (unsigned long long) blocks->flushes);
+        if(blocks->targetHits || blocks->targetMisses) {
+            fprintf(out, "   indirect exits: %llu predicted, %llu missed\n",
+                    (unsigned long long) blocks->targetHits, (unsigned long long) blocks->targetMisses);
+        }
+        if(blocks->jit) {
+            fprintf(out, "   jit: %llu compiled, %llu failed, %llu native runs, %zu bytes of code\n",
+                    (unsigned long long) blocks->jit->compiled, (unsigned long long) blocks->jit->failed,
+                    (unsigned long long) blocks->nativeRuns, blocks->jit->used);
+        }
+    }
+}
+
+static uint64_t run_opcodes(Memory *memory, const RunLimits *limits, FILE *trace, TraceWriter *traceStream, RunStop *stop) {
+    uint64_t instructions = 0;
+
+    Opcode scratch;
+    while(!(*stop = RunLimits_check(limits, memory, instructions, 0))) {
+        const Opcode *opcode = Opcode_fetch(&scratch, memory);
+        if(opcode == NULL) {
+            continue; // Not decodable, it halted
+        }
+        if(trace) {
+            Opcode_decompile_to_file(opcode, trace);
+            fputs(" ;", trace);
+        }
+
+        if(traceStream) {
+            TraceWriter_begin(traceStream, opcode, memory);
+            Opcode_run(opcode, memory, NULL);
+            TraceWriter_end(traceStream, memory);
+        } else {
+            Opcode_run(opcode, memory, trace);
+        }
+        instructions++;
+
+        if(trace) {
+            fputc('\n', trace);
+        }
+    }
+
+    return instructions;
+}
+
+// Same as run_opcodes, estimating the clocks of each opcode. The clock limit counts from the clocks of this run
+static uint64_t run_opcodes_clocked(Memory *memory, const CpuModel model, const RunLimits *limits, FILE *trace,
+                                    uint64_t *totalClocks, RunStop *stop) {
+    const uint64_t startClocks = *totalClocks;
+    uint64_t instructions = 0;
+
+    Opcode scratch;
+    while(!(*stop = RunLimits_check(limits, memory, instructions, *totalClocks - startClocks))) {
+        const Opcode *opcode = Opcode_fetch(&scratch, memory);
+        if(opcode == NULL) {
+            continue; // Not decodable, it halted
+        }
+
+        // Operand addresses are only known before running it
+        OpcodeClocks clocks = OpcodeClocks_estimate(opcode, memory, model);
+
+        OpcodeTraceState traceState;
+        if(trace) {
+            Opcode_decompile_to_file(opcode, trace);
+            fputs(" ;", trace);
+            OpcodeTrace_begin(&traceState, memory);
+        }
+
+        OpcodeClocks_run(&clocks, opcode, memory, model);
+        instructions++;
+        *totalClocks += OpcodeClocks_total(&clocks);
+
+        if(trace) {
+            OpcodeClocks_trace(&clocks, *totalClocks, trace);
+            fputs(" |", trace);
+            OpcodeTrace_end(&traceState, memory, trace);
+            fputc('\n', trace);
+        }
+    }
+
+    return instructions;
+}
+
+#if SIM86_PROFILE
+// Same as run_opcodes, counting every opcode and timing its decode, execution and trace formatting.
+// Calls and returns are followed on a shadow stack, which attributes counts and 8086 clocks to subroutines
+static uint64_t run_opcodes_profiled(Memory *memory, const RunLimits *limits, FILE *trace, Profile *profile, RunStop *stop) {
+    uint64_t *ticks = profile->ticks;
+    uint64_t instructions = 0;
+
+    Profile_start(profile, memory);
+    Opcode scratch;
+    uint64_t start = Profile_ticks();
+    while(!(*stop = RunLimits_check(limits, memory, instructions, 0))) {
+        const Opcode *opcode = Opcode_fetch(&scratch, memory);
+        if(opcode == NULL) {
+            continue; // Not decodable, it halted
+        }
+        const uint16_t ip = memory->registers[Register_IP];
+        const uint16_t sp = memory->registers[Register_SP];
+        const uint64_t fetched = Profile_ticks();
+        OpcodeClocks clocks = OpcodeClocks_estimate(opcode, memory, CpuModel_8086);
+        const uint64_t estimated = Profile_ticks();
+
+        OpcodeTraceState traceState;
         if(trace) {
-            Opcode_decompile_to_file(&opcode, trace);
+            Opcode_decompile_to_file(opcode, trace);
             fputs(" ;", trace);
+            OpcodeTrace_begin(&traceState, memory);
         }
+        const uint64_t traced = trace ? Profile_ticks() : estimated;
 
-        Opcode_run(&opcode, memory, trace);
+        OpcodeClocks_run(&clocks, opcode, memory, CpuModel_8086);
+        instructions++;
+        const uint64_t executed = Profile_ticks();
 
         if(trace) {
+            OpcodeTrace_end(&traceState, memory, trace);
             fputc('\n', trace);
         }
+        const uint64_t end = trace ? Profile_ticks() : executed;
+
+        ticks[ProfilePhase_DECODE] += fetched - start;
+        ticks[ProfilePhase_EXECUTE] += executed - traced;
+        ticks[ProfilePhase_TRACE] += (traced - estimated) + (end - executed);
+
+        // Left out of the timed phases, as the clocks estimate
+        Profile_count(profile, opcode, ip, OpcodeClocks_total(&clocks));
+        if(opcode->type == OpcodeType_CALL) {
+            Profile_call(profile, memory->registers[Register_IP], sp);
+        } else if(opcode->type == OpcodeType_RET) {
+            Profile_return(profile, memory->registers[Register_SP]);
+        }
+
+        start = Profile_ticks();
+    }
+    Profile_finish(profile);
+
+    return instructions;
+}
+#endif
+
+static void print_final_state(Memory *memory, FILE *out) {
+    Flags_sync(memory);
+    OpcodeTrace_final_state(memory->registers, &memory->flags, out);
+}
+
+// Returns the number of opcodes run, and why the last run stopped in stop
+static uint64_t run86(Memory *memory, const Options *options, FILE *trace, TraceWriter *traceStream, RunStop *stop) {
+    RunStats stats = {0};
+    BlockEngine *blocks = NULL;
+    Disasm disasm = {0};
+    Cfg cfg = {0};
+
+    if(options->engine != Engine_OPCODES) {
+        blocks = BlockEngine_create(memory);
+        if(blocks == NULL) {
+            fprintf(stderr, "sim86: error: failed to create block engine\n");
+            exit(EXIT_FAILURE);
+        }
+        if(options->engine == Engine_JIT && !BlockEngine_enable_jit(blocks, options->jitThreshold)) {
+            fprintf(stderr, "sim86: warning: jit not supported on this host, running blocks\n");
+        }
+        stats.blocks = blocks;
+
+        // Block boundaries come from the static control flow graph, until code is written
+        if(!Disasm_decode(&disasm, memory, memory->registers[Register_IP]) || !Cfg_build(&cfg, &disasm)) {
+            fprintf(stderr, "sim86: error: failed to allocate control flow graph\n");
+            exit(EXIT_FAILURE);
+        }
+        BlockEngine_use_cfg(blocks, &cfg);
+    }
+
+#if SIM86_PROFILE
+    Profile *profile = NULL;
+    if(options->profile && (profile = Profile_create()) == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate profile\n");
+        exit(EXIT_FAILURE);
+    }
+#endif
+
+    const uint32_t runs = options->repeat ? options->repeat : 1;
+    if(runs > 1 && !Memory_snapshot(memory)) {
+        fprintf(stderr, "sim86: error: failed to allocate snapshot\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(uint32_t run = 0; run < runs; ++run) {
+        if(run) {
+            const uint64_t start = now_ns();
+            Memory_restore(memory);
+            stats.restoreNs += now_ns() - start;
+        }
+
+        const RunLimits *limits = &options->limits;
+        switch(options->engine) {
+            case Engine_OPCODES: {
+#if SIM86_PROFILE
+                if(profile) {
+                    stats.instructions += run_opcodes_profiled(memory, limits, trace, profile, &stats.stop);
+                    break;
+                }
+#endif
+                stats.instructions += options->cycles
+                        ? run_opcodes_clocked(memory, options->cpuModel, limits, trace, &stats.clocks, &stats.stop)
+                        : run_opcodes(memory, limits, trace, traceStream, &stats.stop);
+            } break;
+            case Engine_BLOCKS:
+            case Engine_JIT: {
+                stats.instructions += BlockEngine_run(blocks, limits, trace, &stats.stop);
+            } break;
+        }
     }
 
     if(trace) {
         // Full register trace
-        const uint16_t *regs = memory->registers;
-        OpcodeRegAccess regAccess = {.reg=0, .size=RegSize_WORD, .offset=RegOffset_NONE};
+        print_final_state(memory, trace);
+    } else if(options->finalState) {
+        print_final_state(memory, stdout);
+        fprintf(stdout, "   memory: %016llx\n", (unsigned long long) Memory_checksum(memory));
+    }
 
-        fprintf(trace, "\nFinal registers:\n");
-        for(Register reg = 0; reg < Register_COUNT; ++reg) {
-            const uint16_t val = regs[reg];
-            if(val) {
-                regAccess.reg = reg;
-                fprintf(trace, "      %s: 0x%04x (%d)\n", OpcodeRegAccess_decompile(&regAccess), val, val);
-            }
+    if(options->cycles) {
+        fprintf(trace ? trace : stdout, "\nTotal clocks: %llu (%s)\n",
+                (unsigned long long) stats.clocks, CpuModel_name(options->cpuModel));
+    }
+
+    if(options->stats) {
+        print_stats(memory, &stats, trace ? trace : stdout);
+    }
+
+#if SIM86_PROFILE
+    if(profile) {
+        Profile_report(profile, memory, trace ? trace : stdout);
+        Profile_destroy(profile);
+    }
+#endif
+
+    if(runs > 1) {
+        Memory_drop_snapshot(memory);
+    }
+    BlockEngine_destroy(blocks);
+    Cfg_destroy(&cfg);
+    Disasm_destroy(&disasm);
+    *stop = stats.stop;
+    return stats.instructions;
+}
+
+static bool save_state86(Memory *memory, const char *path) {
+    FILE *out = fopen(path, "wb");
+    if(out == NULL) {
+        fprintf(stderr, "sim86: error: open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const bool ok = Memory_save_state(memory, out);
+    if(fclose(out) || !ok) {
+        fprintf(stderr, "sim86: error: failed to write '%s'\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Writes every dirty range as: start (u32 LE), length (u32 LE), data
+static bool dump_dirty86(const Memory *memory, const char *path) {
+    FILE *out = fopen(path, "wb");
+    if(out == NULL) {
+        fprintf(stderr, "sim86: error: open '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    MemoryRange range;
+    for(uint32_t cursor = 0; ok && Memory_next_dirty(memory, &cursor, &range); ) {
+        const uint32_t len = range.end - range.start;
+        const uint8_t header[8] = {
+            range.start, range.start >> 8, range.start >> 16, range.start >> 24,
+            len, len >> 8, len >> 16, len >> 24,
+        };
+        ok = fwrite(header, sizeof(header), 1, out) == 1
+             && fwrite(memory->ram + range.start, 1, len, out) == len;
+    }
+
+    if(fclose(out) || !ok) {
+        fprintf(stderr, "sim86: error: failed to write '%s'\n", path);
+        return false;
+    }
+    return true;
+}
+
+static int trace_dump86(const char *traceFile, FILE *out) {
+    FILE *file = fopen(traceFile, "rb");
+    if(file == NULL) {
+        fprintf(stderr, "sim86: error: open '%s': %s\n", traceFile, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    const bool ok = TraceStream_dump(file, out);
+    fclose(file);
+
+    if(!ok) {
+        fprintf(stderr, "sim86: error: '%s' is not a valid trace stream\n", traceFile);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* -------------------- BATCH --------------------------- */
+
+typedef struct {
+    const char *srcFile;
+    uint64_t instructions;
+    uint64_t checksum;
+    RunStop stop;
+    bool ok;
+} BatchJob;
+
+typedef struct {
+    const Options *options;
+    BatchJob *jobs;
+    int jobCount;
+    int next; // Next job to take, shared by the workers
+    pthread_mutex_t lock;
+} BatchQueue;
+
+// Runs a binary on its own machine
+static void batch_job86(BatchJob *job, const Options *options) {
+    Memory memory = Memory_create();
+    memory.opcodeCache = OpcodeCache_create();
+    if(memory.ram == NULL || memory.opcodeCache == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate memory for '%s'\n", job->srcFile);
+        OpcodeCache_destroy(memory.opcodeCache);
+        Memory_destroy(&memory);
+        return;
+    }
+
+    if(check_load86(Memory_load_code_image(&memory, job->srcFile), job->srcFile)) {
+        job->instructions = run86(&memory, options, NULL, NULL, &job->stop);
+        if(job->stop == RunStop_FAULT) {
+            print_fault86(&memory);
+        }
+        job->checksum = Memory_checksum(&memory);
+        job->ok = true;
+    }
+
+    OpcodeCache_destroy(memory.opcodeCache);
+    Memory_destroy(&memory);
+}
+
+static void *batch_worker86(void *arg) {
+    BatchQueue *queue = arg;
+
+    while(true) {
+        pthread_mutex_lock(&queue->lock);
+        const int i = queue->next < queue->jobCount ? queue->next++ : -1;
+        pthread_mutex_unlock(&queue->lock);
+
+        if(i < 0) {
+            return NULL;
         }
+        batch_job86(&queue->jobs[i], queue->options);
+    }
+}
 
-        char flagsBuf[FLAG_COUNT + 1];
-        Flags_serialize(&memory->flags, flagsBuf);
-        if(*flagsBuf) {
-            fprintf(trace, "   flags: %s\n", flagsBuf);
+// Runs every job with a pool of threads. Returns the elapsed ns, 0 on failure
+static uint64_t batch_run86(const Options *options, BatchJob *jobs, const int jobCount, uint32_t threads) {
+    BatchQueue queue = {
+            .options = options,
+            .jobs = jobs,
+            .jobCount = jobCount,
+            .next = 0,
+    };
+    pthread_mutex_init(&queue.lock, NULL);
+
+    pthread_t workers[BATCH_MAX_THREADS];
+    const uint64_t start = now_ns();
+
+    uint32_t started = 0;
+    for(; started < threads; ++started) {
+        if(pthread_create(&workers[started], NULL, batch_worker86, &queue)) {
+            fprintf(stderr, "sim86: warning: could only start %u threads\n", started);
+            break;
         }
     }
+    if(started == 0) {
+        batch_worker86(&queue); // Run them here
+    }
+    for(uint32_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    const uint64_t elapsed = now_ns() - start;
+    pthread_mutex_destroy(&queue.lock);
+
+    for(int i = 0; i < jobCount; ++i) {
+        if(!jobs[i].ok) {
+            return 0;
+        }
+    }
+    return elapsed ? elapsed : 1;
 }
 
-int main(int argc, const char *argv[]) {
+static void batch_report86(FILE *out, const uint32_t threads, const uint64_t instructions,
+                           const uint64_t elapsed, const uint64_t baseline) {
+    const double ips = instructions * 1e9 / elapsed;
+    fprintf(out, "   %3u thread%s: %.2f ms, %.2f Minstr/s", threads, threads == 1 ? " " : "s", elapsed / 1e6, ips / 1e6);
+    if(baseline) {
+        const double speedup = (double) baseline / elapsed;
+        fprintf(out, ", %.2fx speedup, %.0f%% per core", speedup, 100 * speedup / threads);
+    }
+    fputc('\n', out);
+}
+
+/*
+ * Runs every source file on its own machine, first on a single thread and then across
+ * the worker pool, and reports the throughput of both. Results must match between them.
+ */
+static bool batch86(const Options *options, FILE *out) {
+    uint32_t threads = options->threads;
+    if(threads == 0) {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores < 1 ? 1 : cores > BATCH_MAX_THREADS ? BATCH_MAX_THREADS : (uint32_t) cores;
+    }
+
+    const int jobCount = options->srcCount;
+    BatchJob *serial = calloc(jobCount, sizeof(*serial));
+    BatchJob *parallel = calloc(jobCount, sizeof(*parallel));
+    if(serial == NULL || parallel == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate batch jobs\n");
+        free(serial);
+        free(parallel);
+        return false;
+    }
+    for(int i = 0; i < jobCount; ++i) {
+        serial[i].srcFile = parallel[i].srcFile = options->srcFiles[i];
+    }
+
+    // The dispatch table is built lazily, do it before workers race for it
+    OpcodeEncodingTable_init();
+
+    const uint64_t serialNs = batch_run86(options, serial, jobCount, 1);
+    const uint64_t parallelNs = serialNs ? batch_run86(options, parallel, jobCount, threads) : 0;
+    bool ok = parallelNs != 0;
+
+    uint64_t instructions = 0;
+    for(int i = 0; ok && i < jobCount; ++i) {
+        if(serial[i].instructions != parallel[i].instructions || serial[i].checksum != parallel[i].checksum
+           || serial[i].stop != parallel[i].stop) {
+            fprintf(stderr, "sim86: error: '%s' gave different results when run in parallel\n", serial[i].srcFile);
+            ok = false;
+            break;
+        }
+        fprintf(out, "%s: %llu instructions, memory %016llx", serial[i].srcFile,
+                (unsigned long long) serial[i].instructions, (unsigned long long) serial[i].checksum);
+        if(serial[i].stop != RunStop_END) {
+            fprintf(out, ", stopped: %s", RunStop_name(serial[i].stop));
+        }
+        fputc('\n', out);
+        instructions += serial[i].instructions;
+    }
+
+    if(ok) {
+        fprintf(out, "\nBatch: %d jobs, %llu instructions\n", jobCount, (unsigned long long) instructions);
+        batch_report86(out, 1, instructions, serialNs, 0);
+        batch_report86(out, threads, instructions, parallelNs, serialNs);
+    }
+
+    free(serial);
+    free(parallel);
+    return ok;
+}
+
+/* -------------------- CLIENT --------------------------- */
+
+// Runs every source file on a `sim86 serve` server, all requests sent before the first answer is read
+static bool client86(const Options *options, FILE *out) {
+    const RunLimits *limits = &options->limits;
+    const ServeRequest base = {
+            .engine = (uint8_t) options->engine, // Same values as Sim86Engine
+            .cpu = !options->cycles ? Sim86Cpu_NONE : options->cpuModel == CpuModel_8088 ? Sim86Cpu_8088 : Sim86Cpu_8086,
+            .trace = options->trace,
+            .maxInstructions = limits->maxInstructions != UINT64_MAX ? limits->maxInstructions : 0,
+            .maxClocks = limits->maxClocks != UINT64_MAX ? limits->maxClocks : 0,
+            .untilIp = limits->untilIp, // RUN_NO_IP is SIM86_NO_IP
+    };
+
+    const int socket = Serve_connect(options->socketPath);
+    if(socket < 0) {
+        fprintf(stderr, "sim86: error: connect to '%s': %s\n", options->socketPath, strerror(errno));
+        return false;
+    }
+
+    const bool ok = Serve_client(socket, &base, options->srcFiles, options->srcCount, out);
+    close(socket);
+    return ok;
+}
+
+/* -------------------- BENCH --------------------------- */
+
+typedef enum {
+    BenchMode_DECOMPILE = 0,
+    BenchMode_RUN,
+    BenchMode_TRACE,
+    BenchMode_COUNT,
+} BenchMode;
+
+static const char *benchModeNames[BenchMode_COUNT] = {
+        [BenchMode_DECOMPILE] = "decompile",
+        [BenchMode_RUN] = "run",
+        [BenchMode_TRACE] = "trace",
+};
+
+static const char *engineNames[] = {
+        [Engine_OPCODES] = "opcodes",
+        [Engine_BLOCKS] = "blocks",
+        [Engine_JIT] = "jit",
+};
+
+typedef struct {
+    char program[64];
+    BenchMode mode;
+    uint64_t instructions;  // Per trial
+    uint32_t trials;
+    double nsPerInstruction;
+    double stddevNs;        // Of nsPerInstruction across trials
+    double instructionsPerSecond;
+} BenchResult;
+
+// Newton's method, so a single square root doesn't need libm
+static double bench_sqrt(const double x) {
+    if(x <= 0) {
+        return 0;
+    }
+    double root = x > 1 ? x : 1;
+    for(int i = 0; i < 64; ++i) {
+        root = (root + x / root) / 2;
+    }
+    return root;
+}
+
+// Program name of a source file path: its base name up to the first dot
+static void bench_program_name(const char *path, char *name, const size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    const size_t len = strcspn(base, ".");
+    snprintf(name, size, "%.*s", (int) (len < size ? len : size - 1), base);
+}
+
+// Runs a single trial from the loaded program. Returns the opcodes decompiled or run
+static uint64_t bench_trial86(Memory *memory, const Options *options, const BenchMode mode, FILE *sink) {
+    uint64_t instructions = 0;
+    switch(mode) {
+        case BenchMode_DECOMPILE: {
+            const uint16_t startIp = memory->registers[Register_IP];
+            const uint64_t start = now_ns();
+            do {
+                memory->registers[Register_IP] = startIp;
+                instructions += decompile86(memory, sink, 1);
+            } while(now_ns() - start < BENCH_DECOMPILE_MIN_NS && instructions > 0);
+            memory->registers[Register_IP] = startIp;
+        } break;
+        case BenchMode_RUN:
+        case BenchMode_TRACE: {
+            Memory_restore(memory);
+            RunStop stop;
+            instructions = run86(memory, options, mode == BenchMode_TRACE ? sink : NULL, NULL, &stop);
+        } break;
+        case BenchMode_COUNT: break;
+    }
+    return instructions;
+}
+
+static bool bench_file86(const char *srcFile, const Options *options, FILE *sink, BenchResult results[BenchMode_COUNT]) {
+    Memory memory = Memory_create();
+    memory.opcodeCache = OpcodeCache_create();
+    bool ok = memory.ram && memory.opcodeCache;
+    if(!ok) {
+        fprintf(stderr, "sim86: error: failed to allocate memory for '%s'\n", srcFile);
+    }
+
+    ok = ok && check_load86(Memory_load_code_image(&memory, srcFile), srcFile);
+
+    // Every run trial starts from the loaded program
+    if(ok && !Memory_snapshot(&memory)) {
+        fprintf(stderr, "sim86: error: failed to allocate snapshot\n");
+        ok = false;
+    }
+
+    const uint32_t trials = options->trials ? options->trials : BENCH_DEFAULT_TRIALS;
+    for(BenchMode mode = 0; ok && mode < BenchMode_COUNT; ++mode) {
+        BenchResult *result = &results[mode];
+        bench_program_name(srcFile, result->program, sizeof(result->program));
+        result->mode = mode;
+        result->trials = trials;
+
+        bench_trial86(&memory, options, mode, sink); // Warm up
+
+        double samples[BENCH_MAX_TRIALS];
+        uint64_t totalInstructions = 0, totalNs = 0;
+        for(uint32_t trial = 0; trial < trials; ++trial) {
+            const uint64_t start = now_ns();
+            const uint64_t instructions = bench_trial86(&memory, options, mode, sink);
+            const uint64_t elapsed = now_ns() - start;
+
+            samples[trial] = instructions ? (double) elapsed / instructions : 0;
+            totalInstructions += instructions;
+            totalNs += elapsed;
+        }
+
+        double mean = 0, variance = 0;
+        for(uint32_t trial = 0; trial < trials; ++trial) {
+            mean += samples[trial] / trials;
+        }
+        for(uint32_t trial = 0; trial < trials; ++trial) {
+            variance += (samples[trial] - mean) * (samples[trial] - mean) / (trials - 1);
+        }
+
+        result->instructions = totalInstructions / trials;
+        result->nsPerInstruction = mean;
+        result->stddevNs = bench_sqrt(variance);
+        result->instructionsPerSecond = totalNs ? totalInstructions * 1e9 / totalNs : 0;
+    }
+
+    OpcodeCache_destroy(memory.opcodeCache);
+    Memory_destroy(&memory);
+    return ok;
+}
+
+// Appends to path, writing header first if the file is new. Returns NULL on error
+static FILE *bench_open_results(const char *path, const char *header) {
+    FILE *out = fopen(path, "a");
+    if(out == NULL) {
+        fprintf(stderr, "sim86: error: open '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if(header && ftell(out) == 0) {
+        fputs(header, out);
+    }
+    return out;
+}
+
+/*
+ * Decompiles, runs and traces every source file in repeated trials, reporting the
+ * throughput of each mode. Results are appended to CSV/JSON files with a timestamp,
+ * so they can be compared across builds. Trace output goes to /dev/null.
+ */
+static bool bench86(const Options *options, FILE *out) {
+    FILE *sink = fopen("/dev/null", "w");
+    if(sink == NULL) {
+        fprintf(stderr, "sim86: error: open '/dev/null': %s\n", strerror(errno));
+        return false;
+    }
+
+    FILE *csv = NULL, *json = NULL;
+    bool ok = true;
+    if(options->csvOut) {
+        csv = bench_open_results(options->csvOut,
+                "timestamp,program,mode,engine,instructions,trials,ns_per_instruction,stddev_ns,instructions_per_second\n");
+        ok = csv != NULL;
+    }
+    if(ok && options->jsonOut) {
+        json = bench_open_results(options->jsonOut, NULL);
+        ok = json != NULL;
+    }
+
+    // Trials run in this thread only, but build the table before timing anything
+    OpcodeEncodingTable_init();
+
+    const char *engine = engineNames[options->engine];
+    const long long timestamp = time(NULL);
+
+    if(ok) {
+        fprintf(out, "%-24s %-10s %-8s %12s %12s %10s %12s\n",
+                "program", "mode", "engine", "instructions", "ns/instr", "stddev", "Minstr/s");
+    }
+
+    for(int i = 0; ok && i < options->srcCount; ++i) {
+        BenchResult results[BenchMode_COUNT] = {0};
+        ok = bench_file86(options->srcFiles[i], options, sink, results);
+
+        for(BenchMode mode = 0; ok && mode < BenchMode_COUNT; ++mode) {
+            const BenchResult *r = &results[mode];
+            fprintf(out, "%-24s %-10s %-8s %12llu %12.3f %10.3f %12.2f\n", r->program, benchModeNames[mode], engine,
+                    (unsigned long long) r->instructions, r->nsPerInstruction, r->stddevNs,
+                    r->instructionsPerSecond / 1e6);
+
+            if(csv) {
+                fprintf(csv, "%lld,%s,%s,%s,%llu,%u,%.4f,%.4f,%.0f\n", timestamp, r->program,
+                        benchModeNames[mode], engine, (unsigned long long) r->instructions, r->trials,
+                        r->nsPerInstruction, r->stddevNs, r->instructionsPerSecond);
+            }
+            if(json) {
+                fprintf(json, "{\"timestamp\": %lld, \"program\": \"%s\", \"mode\": \"%s\", \"engine\": \"%s\", "
+                              "\"instructions\": %llu, \"trials\": %u, \"ns_per_instruction\": %.4f, "
+                              "\"stddev_ns\": %.4f, \"instructions_per_second\": %.0f}\n",
+                        timestamp, r->program, benchModeNames[mode], engine, (unsigned long long) r->instructions,
+                        r->trials, r->nsPerInstruction, r->stddevNs, r->instructionsPerSecond);
+            }
+        }
+    }
+
+    if(csv && fclose(csv)) {
+        fprintf(stderr, "sim86: error: failed to write '%s'\n", options->csvOut);
+        ok = false;
+    }
+    if(json && fclose(json)) {
+        fprintf(stderr, "sim86: error: failed to write '%s'\n", options->jsonOut);
+        ok = false;
+    }
+    fclose(sink);
+    return ok;
+}
+
+// Positive count in decimal
+static bool parse_limit86(const char *value, uint64_t *limit) {
+    char *end;
+    const unsigned long long max = strtoull(value, &end, 10);
+    if(*end || end == value || max == 0 || max == ULLONG_MAX) {
+        fprintf(stderr, "sim86: error: invalid limit '%s'\n", value);
+        return false;
+    }
+    *limit = max;
+    return true;
+}
+
+static bool parse_args(Options *options, const int argc, const char *argv[]) {
     if(argc < 2) {
         fprintf(stderr, "sim86: error: Missing command and source file path\n");
-        print_usage();
-        return EXIT_FAILURE;
+        return false;
+    }
+    options->cmd = argv[1];
+
+    for(int i = 2; i < argc; ++i) {
+        const char *arg = argv[i];
+
+        if(strncmp(arg, "--", 2) != 0) {
+            if(options->srcFile && strcmp(options->cmd, "batch") != 0 && strcmp(options->cmd, "bench") != 0
+               && strcmp(options->cmd, "client") != 0) {
+                fprintf(stderr, "sim86: error: unexpected argument '%s'\n", arg);
+                return false;
+            }
+            if(options->srcFile == NULL) {
+                options->srcFile = arg;
+                options->srcFiles = &argv[i];
+            }
+            options->srcFiles[options->srcCount++] = arg; // Compacts them over the consumed options
+        } else if(!strncmp(arg, "--trials=", 9)) {
+            char *end;
+            const unsigned long trials = strtoul(arg + 9, &end, 10);
+            if(*end || end == arg + 9 || trials < 2 || trials > BENCH_MAX_TRIALS) {
+                fprintf(stderr, "sim86: error: invalid trial count '%s', must be from 2 to %d\n", arg + 9, BENCH_MAX_TRIALS);
+                return false;
+            }
+            options->trials = trials;
+        } else if(!strncmp(arg, "--csv=", 6) && arg[6]) {
+            options->csvOut = arg + 6;
+        } else if(!strncmp(arg, "--json=", 7) && arg[7]) {
+            options->jsonOut = arg + 7;
+        } else if(!strncmp(arg, "--threads=", 10)) {
+            char *end;
+            const unsigned long threads = strtoul(arg + 10, &end, 10);
+            if(*end || end == arg + 10 || threads == 0 || threads > BATCH_MAX_THREADS) {
+                fprintf(stderr, "sim86: error: invalid thread count '%s'\n", arg + 10);
+                return false;
+            }
+            options->threads = threads;
+        } else if(!strncmp(arg, "--load=", 7)) {
+            // --load=<file>@<segment>:<offset>, segment and offset in hex
+            const char *at = strrchr(arg + 7, '@');
+            char *colon = NULL, *end = NULL;
+            const unsigned long segment = at ? strtoul(at + 1, &colon, 16) : 0;
+            const unsigned long offset = colon && *colon == ':' ? strtoul(colon + 1, &end, 16) : 0;
+            if(at == NULL || at == arg + 7 || colon == at + 1 || *colon != ':' || end == colon + 1 || *end
+               || segment > UINT16_MAX || offset > UINT16_MAX) {
+                fprintf(stderr, "sim86: error: invalid load '%s', must be <file>@<segment>:<offset> in hex\n", arg + 7);
+                return false;
+            }
+            if(options->loadCount == MAX_LOAD_IMAGES) {
+                fprintf(stderr, "sim86: error: at most %d --load images\n", MAX_LOAD_IMAGES);
+                return false;
+            }
+            options->loads[options->loadCount++] = (LoadImage) {
+                .path = arg + 7,
+                .pathLen = (int) (at - (arg + 7)),
+                .addr = (segment << 4) + offset,
+            };
+        } else if(!strncmp(arg, "--max-instructions=", 19)) {
+            if(!parse_limit86(arg + 19, &options->limits.maxInstructions)) {
+                return false;
+            }
+        } else if(!strncmp(arg, "--max-cycles=", 13)) {
+            if(!parse_limit86(arg + 13, &options->limits.maxClocks)) {
+                return false;
+            }
+        } else if(!strncmp(arg, "--until-ip=", 11)) {
+            char *end;
+            const unsigned long ip = strtoul(arg + 11, &end, 16);
+            if(*end || end == arg + 11 || ip > UINT16_MAX) {
+                fprintf(stderr, "sim86: error: invalid ip '%s', must be from 0 to ffff in hex\n", arg + 11);
+                return false;
+            }
+            options->limits.untilIp = ip;
+        } else if(!strncmp(arg, "--socket=", 9) && arg[9]) {
+            options->socketPath = arg + 9;
+        } else if(!strcmp(arg, "--trace")) {
+            options->trace = true;
+        } else if(!strcmp(arg, "--labels")) {
+            options->labels = true;
+        } else if(!strcmp(arg, "--stats")) {
+            options->stats = true;
+        } else if(!strcmp(arg, "--engine=opcodes")) {
+            options->engine = Engine_OPCODES;
+        } else if(!strcmp(arg, "--engine=blocks")) {
+            options->engine = Engine_BLOCKS;
+        } else if(!strcmp(arg, "--engine=jit")) {
+            options->engine = Engine_JIT;
+        } else if(!strncmp(arg, "--jit-threshold=", 16)) {
+            char *end;
+            const unsigned long threshold = strtoul(arg + 16, &end, 10);
+            if(*end || end == arg + 16 || threshold == 0 || threshold > UINT32_MAX) {
+                fprintf(stderr, "sim86: error: invalid jit threshold '%s'\n", arg + 16);
+                return false;
+            }
+            options->jitThreshold = threshold;
+        } else if(!strcmp(arg, "--profile")) {
+#if SIM86_PROFILE
+            options->profile = true;
+#else
+            fprintf(stderr, "sim86: error: --profile is not supported, built with SIM86_PROFILE=0\n");
+            return false;
+#endif
+        } else if(!strcmp(arg, "--final-state")) {
+            options->finalState = true;
+        } else if(!strcmp(arg, "--cycles") || !strcmp(arg, "--cycles=8086")) {
+            options->cycles = true;
+            options->cpuModel = CpuModel_8086;
+        } else if(!strcmp(arg, "--cycles=8088")) {
+            options->cycles = true;
+            options->cpuModel = CpuModel_8088;
+        } else if(!strncmp(arg, "--trace-out=", 12) && arg[12]) {
+            options->traceOut = arg + 12;
+        } else if(!strncmp(arg, "--save-state=", 13) && arg[13]) {
+            options->saveState = arg + 13;
+        } else if(!strncmp(arg, "--load-state=", 13) && arg[13]) {
+            options->loadState = arg + 13;
+        } else if(!strncmp(arg, "--repeat=", 9)) {
+            char *end;
+            const unsigned long repeat = strtoul(arg + 9, &end, 10);
+            if(*end || end == arg + 9 || repeat == 0 || repeat > UINT32_MAX) {
+                fprintf(stderr, "sim86: error: invalid repeat count '%s'\n", arg + 9);
+                return false;
+            }
+            options->repeat = repeat;
+        } else if(!strncmp(arg, "--dump-dirty=", 13) && arg[13]) {
+            options->dumpDirty = arg + 13;
+        } else if(!strncmp(arg, "--dirty-page-size=", 18)) {
+            char *end;
+            options->dirtyPageSize = strtoul(arg + 18, &end, 10);
+            if(*end || end == arg + 18) {
+                fprintf(stderr, "sim86: error: invalid dirty page size '%s'\n", arg + 18);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "sim86: error: unknown option '%s'\n", arg);
+            return false;
+        }
     }
-    if(argc < 3) {
+
+    const bool runCmd = !strcmp(options->cmd, "run") || !strcmp(options->cmd, "trace");
+    if(options->loadState && (!runCmd || options->srcFile)) {
+        fprintf(stderr, "sim86: error: --load-state replaces the source file, and only works with run/trace\n");
+        return false;
+    }
+
+    const bool serveCmd = !strcmp(options->cmd, "serve");
+    const bool clientCmd = !strcmp(options->cmd, "client");
+    if(serveCmd) {
+        // Programs come from the clients
+        if(options->srcFile || options->socketPath == NULL || options->stats || options->finalState
+           || options->cycles || options->trace || options->engine != Engine_OPCODES || options->repeat
+           || options->limits.untilIp != RUN_NO_IP || options->limits.maxClocks != UINT64_MAX) {
+            fprintf(stderr, "sim86: error: serve takes --socket, --threads and --max-instructions only, the clients choose the rest\n");
+            return false;
+        }
+        return true;
+    }
+
+    if((options->socketPath != NULL) != clientCmd || (options->trace && !clientCmd)) {
+        fprintf(stderr, "sim86: error: --socket only works with serve and client (where it is needed), --trace with client\n");
+        return false;
+    }
+
+    if(clientCmd && (options->finalState || options->stats || options->traceOut || options->dumpDirty
+                     || options->saveState || options->repeat || options->profile || options->loadCount)) {
+        fprintf(stderr, "sim86: error: client only supports --socket, --trace, --engine, --cycles, --max-instructions, --max-cycles and --until-ip\n");
+        return false;
+    }
+
+    if(options->srcFile == NULL && options->loadState == NULL && strcmp(options->cmd, "bench-decompile") != 0) {
         fprintf(stderr, "sim86: error: Missing source file path\n");
+        return false;
+    }
+
+    const bool batchCmd = !strcmp(options->cmd, "batch");
+    const RunLimits *limits = &options->limits;
+    const bool limited = limits->maxInstructions != UINT64_MAX || limits->maxClocks != UINT64_MAX
+                         || limits->untilIp != RUN_NO_IP;
+    if(limited && !runCmd && !batchCmd && !clientCmd) {
+        fprintf(stderr, "sim86: error: --max-instructions, --max-cycles and --until-ip only work with run, trace, batch and client\n");
+        return false;
+    }
+
+    if(limits->maxClocks != UINT64_MAX) {
+        if(batchCmd || options->engine != Engine_OPCODES || options->profile || options->repeat > 1) {
+            fprintf(stderr, "sim86: error: --max-cycles only works with run/trace/client on the opcodes engine, without --profile or --repeat\n");
+            return false;
+        }
+        options->cycles = true; // Clocks of the 8086 unless --cycles=8088
+    }
+
+    if(options->repeat > 1 && ((strcmp(options->cmd, "run") != 0 && !batchCmd) || options->cycles)) {
+        fprintf(stderr, "sim86: error: --repeat only works with run and batch, without --cycles\n");
+        return false;
+    }
+
+    if(options->loadCount && !runCmd) {
+        fprintf(stderr, "sim86: error: --load only works with run/trace\n");
+        return false;
+    }
+
+    if(options->labels && (strcmp(options->cmd, "decompile") != 0 || options->threads)) {
+        fprintf(stderr, "sim86: error: --labels only works with decompile, without --threads\n");
+        return false;
+    }
+
+    if(options->threads && !batchCmd && strcmp(options->cmd, "decompile") != 0) {
+        fprintf(stderr, "sim86: error: --threads only works with batch and decompile\n");
+        return false;
+    }
+
+    const bool benchCmd = !strcmp(options->cmd, "bench");
+    if(benchCmd && (options->finalState || options->stats || options->traceOut || options->dumpDirty
+                    || options->saveState || options->cycles || options->repeat || options->threads)) {
+        fprintf(stderr, "sim86: error: bench only supports --engine, --jit-threshold, --trials, --csv and --json\n");
+        return false;
+    }
+
+    if(batchCmd && (options->finalState || options->stats || options->traceOut || options->dumpDirty
+                    || options->saveState || options->cycles)) {
+        fprintf(stderr, "sim86: error: batch only supports --engine, --jit-threshold, --repeat, --threads, --max-instructions and --until-ip\n");
+        return false;
+    }
+
+    if(options->profile && (!runCmd || options->engine != Engine_OPCODES || options->cycles || options->traceOut)) {
+        fprintf(stderr, "sim86: error: --profile only works with run/trace on the opcodes engine, without --cycles or --trace-out\n");
+        return false;
+    }
+
+    if(options->cycles && options->engine != Engine_OPCODES) {
+        fprintf(stderr, "sim86: error: --cycles is only supported by the opcodes engine\n");
+        return false;
+    }
+
+    if(options->traceOut && (strcmp(options->cmd, "trace") != 0 || options->engine != Engine_OPCODES || options->cycles)) {
+        fprintf(stderr, "sim86: error: --trace-out is only supported by trace on the opcodes engine, without --cycles\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    Options options = {.jitThreshold = JIT_DEFAULT_THRESHOLD, .limits = RunLimits_NONE};
+    if(!parse_args(&options, argc, argv)) {
         print_usage();
         return EXIT_FAILURE;
     }
 
-    const char *cmd = argv[1];
-    const char *srcFile = argv[2];
+    const char *cmd = options.cmd;
+    const char *srcFile = options.srcFile;
+
+    if(!strcmp(cmd, "trace-dump")) {
+        return trace_dump86(srcFile, stdout);
+    }
+
+    if(!strcmp(cmd, "batch")) {
+        return batch86(&options, stdout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(!strcmp(cmd, "bench")) {
+        return bench86(&options, stdout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(!strcmp(cmd, "serve")) {
+        const uint64_t maxInstructions = options.limits.maxInstructions != UINT64_MAX ? options.limits.maxInstructions : 0;
+        return Serve_run(options.socketPath, options.threads, maxInstructions) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(!strcmp(cmd, "client")) {
+        return client86(&options, stdout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     Memory memory = Memory_create();
+    if(memory.ram == NULL) {
+        fprintf(stderr, "sim86: error: failed to allocate memory\n");
+        return EXIT_FAILURE;
+    }
 
-    FILE *file = fopen(srcFile, "rb");
-    if(file == NULL) {
-        fprintf(stderr, "sim86: error: open '%s': %s\n", srcFile, strerror(errno));
+    if(options.loadState) {
+        FILE *file = fopen(options.loadState, "rb");
+        if(file == NULL) {
+            fprintf(stderr, "sim86: error: open '%s': %s\n", options.loadState, strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        const bool loaded = Memory_load_state(&memory, file);
+        fclose(file);
+        if(!loaded) {
+            fprintf(stderr, "sim86: error: '%s' is not a valid state file\n", options.loadState);
+            return EXIT_FAILURE;
+        }
+    } else if(srcFile == NULL) {
+        if(!load_synthetic86(&memory)) {
+            fprintf(stderr, "sim86: error: failed to generate synthetic code\n");
+            return EXIT_FAILURE;
+        }
+    } else if(!check_load86(Memory_load_code_image(&memory, srcFile), srcFile)) {
         return EXIT_FAILURE;
     }
 
-    if(!Memory_load_code(&memory, file)) {
-        fprintf(stderr, "sim86: error: failed to read '%s' source file\n", srcFile);
+    for(int i = 0; i < options.loadCount; ++i) {
+        const LoadImage *image = &options.loads[i];
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%.*s", image->pathLen, image->path);
+
+        uint32_t len;
+        if(!check_load86(Memory_load_image(&memory, path, image->addr, &len), path)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(options.dirtyPageSize && !Memory_set_dirty_page_size(&memory, options.dirtyPageSize)) {
+        fprintf(stderr, "sim86: error: dirty page size must be a power of 2 from %d to %d\n",
+                1 << DIRTY_PAGE_MIN_SHIFT, 1 << DIRTY_PAGE_MAX_SHIFT);
         return EXIT_FAILURE;
     }
 
-    fclose(file);
+    int ret = EXIT_SUCCESS;
 
-    if(!strcmp(cmd, "decompile"))   decompile86(&memory, stdout);
-    else if(!strcmp(cmd, "run"))    run86(&memory, NULL);
-    else if(!strcmp(cmd, "trace"))  run86(&memory, stdout);
-    else {
+    if(!strcmp(cmd, "decompile")) {
+        if(options.labels) {
+            decompile_labeled86(&memory, stdout);
+        } else {
+            decompile86(&memory, stdout, options.threads);
+        }
+
+    } else if(!strcmp(cmd, "run") || !strcmp(cmd, "trace")) {
+        memory.opcodeCache = OpcodeCache_create();
+        if(memory.opcodeCache == NULL) {
+            fprintf(stderr, "sim86: error: failed to allocate opcode cache\n");
+            return EXIT_FAILURE;
+        }
+
+        RunStop stop = RunStop_END;
+        if(options.traceOut) {
+            FILE *traceFile = fopen(options.traceOut, "wb");
+            if(traceFile == NULL) {
+                fprintf(stderr, "sim86: error: open '%s': %s\n", options.traceOut, strerror(errno));
+                return EXIT_FAILURE;
+            }
+            TraceWriter *traceStream = TraceWriter_create(traceFile, &memory);
+            if(traceStream == NULL) {
+                fprintf(stderr, "sim86: error: failed to write '%s' trace\n", options.traceOut);
+                return EXIT_FAILURE;
+            }
+
+            run86(&memory, &options, NULL, traceStream, &stop);
+
+            if(!TraceWriter_destroy(traceStream) || fclose(traceFile)) {
+                fprintf(stderr, "sim86: error: failed to write '%s' trace\n", options.traceOut);
+                ret = EXIT_FAILURE;
+            }
+        } else {
+            run86(&memory, &options, !strcmp(cmd, "trace") ? stdout : NULL, NULL, &stop);
+        }
+
+        if(stop == RunStop_FAULT) {
+            print_fault86(&memory);
+        } else if(stop != RunStop_END) {
+            fprintf(stderr, "sim86: stopped at %04x:%04x: %s\n",
+                    memory.registers[Register_CS], memory.registers[Register_IP], RunStop_name(stop));
+        }
+
+        OpcodeCache_destroy(memory.opcodeCache);
+        memory.opcodeCache = NULL;
+
+        if(options.dumpDirty && !dump_dirty86(&memory, options.dumpDirty)) {
+            ret = EXIT_FAILURE;
+        }
+
+        if(options.saveState && !save_state86(&memory, options.saveState)) {
+            ret = EXIT_FAILURE;
+        }
+
+        if(ret == EXIT_SUCCESS) {
+            ret = stopStatus[stop];
+        }
+
+    } else if(!strcmp(cmd, "bench-decode")) {
+        bench_decode86(&memory, stdout);
+
+    } else if(!strcmp(cmd, "bench-decompile")) {
+        bench_decompile86(&memory, stdout);
+
+    } else {
         fprintf(stderr, "sim86: error: unknown command '%s'\n", cmd);
-        return EXIT_FAILURE;
+        ret = EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    Memory_destroy(&memory);
+
+    return ret;
 }
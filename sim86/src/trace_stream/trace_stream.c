@@ -0,0 +1,188 @@
+#include "trace_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alu/alu.h"
+#include "opcode_encoding/opcode_encoding.h"
+#include "opcode_encoding_table/opcode_encoding_table.h"
+#include "opcode_decompile/opcode_decompile.h"
+#include "opcode_run/opcode_run.h"
+#include "opcode_fetch/opcode_fetch.h"
+
+/* ------------------------ WRITER ------------------------- */
+
+static void flush_records(TraceWriter *writer) {
+    if(writer->count && fwrite(writer->records, sizeof(*writer->records), writer->count, writer->out) != writer->count) {
+        writer->failed = true;
+    }
+    writer->count = 0;
+}
+
+// Repeated string opcodes record their first write
+static bool writes_memory(const Opcode *opcode) {
+    return opcode->dst.type == OpcodeArgType_MEMORY && opcode->type != OpcodeType_CMP && opcode->type != OpcodeType_CMPS
+           && opcode->type != OpcodeType_PUSH;
+}
+
+// PUSH reads its memory operand, and stores the word below SP as PUSHF and CALL do. Far calls record
+// the last of their two words, the return IP
+static bool pushes(const Opcode *opcode) {
+    return opcode->type == OpcodeType_PUSH || opcode->type == OpcodeType_PUSHF || opcode->type == OpcodeType_CALL;
+}
+
+TraceWriter *TraceWriter_create(FILE *out, Memory *memory) {
+    TraceWriter *writer = calloc(1, sizeof(*writer));
+    TraceRecord *records = malloc(TRACE_STREAM_BUFFER_RECORDS * sizeof(*records));
+    if(writer == NULL || records == NULL) {
+        free(writer);
+        free(records);
+        return NULL;
+    }
+
+    writer->out = out;
+    writer->records = records;
+
+    TraceHeader header = {0};
+    memcpy(header.magic, TRACE_STREAM_MAGIC, sizeof(header.magic));
+    header.version = TRACE_STREAM_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    memcpy(header.registers, memory->registers, sizeof(header.registers));
+    Flags_sync(memory);
+    header.flags = Flags_pack(&memory->flags);
+
+    if(fwrite(&header, sizeof(header), 1, out) != 1) {
+        free(records);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+bool TraceWriter_destroy(TraceWriter *writer) {
+    if(writer == NULL) {
+        return true;
+    }
+
+    flush_records(writer);
+    const bool ok = !writer->failed && fflush(writer->out) == 0;
+
+    free(writer->records);
+    free(writer);
+    return ok;
+}
+
+void TraceWriter_begin(TraceWriter *writer, const Opcode *opcode, Memory *memory) {
+    if(writer->count == TRACE_STREAM_BUFFER_RECORDS) {
+        flush_records(writer);
+    }
+
+    TraceRecord *record = &writer->records[writer->count];
+    memset(record, 0, sizeof(*record)); // Deterministic padding
+
+    const uint16_t ip = memory->registers[Register_IP];
+    record->ip = ip;
+    record->codeLen = opcode->len;
+    memcpy(record->code, Memory_addr_ptr(memory, Register_CS, ip), opcode->len);
+
+    memcpy(writer->regsBefore, memory->registers, sizeof(writer->regsBefore));
+    Flags_sync(memory);
+    record->flagsBefore = Flags_pack(&memory->flags);
+
+    if(pushes(opcode)) {
+        writer->memSegment = Register_SS;
+        writer->memOffset = memory->registers[Register_SP] - (opcode->far ? 4 : 2);
+        record->memSize = RegSize_WORD;
+        record->memAddr = Memory_linear_addr(memory, writer->memSegment, writer->memOffset);
+    } else if(writes_memory(opcode)) {
+        // Operand address has to be taken before registers change
+        const OpcodeMemAccess *mem = &opcode->dst.mem;
+        writer->memSegment = OpcodeMemAccess_segment(mem);
+        writer->memOffset = OpcodeMemAccess_offset(mem, memory);
+        record->memSize = mem->size;
+        record->memAddr = Memory_linear_addr(memory, writer->memSegment, writer->memOffset);
+    }
+}
+
+void TraceWriter_end(TraceWriter *writer, Memory *memory) {
+    TraceRecord *record = &writer->records[writer->count++];
+
+    const uint16_t *regs = memory->registers;
+    for(Register reg = 0; reg < Register_COUNT; ++reg) {
+        if(regs[reg] != writer->regsBefore[reg]) {
+            record->changedRegs |= 1 << reg;
+            record->registers[reg] = regs[reg];
+        }
+    }
+
+    Flags_sync(memory);
+    record->flagsAfter = Flags_pack(&memory->flags);
+
+    if(record->memSize) {
+        // Words at the end of the segment wrap around it
+        record->memData = Memory_read(memory, writer->memSegment, writer->memOffset, record->memSize);
+    }
+}
+
+/* ------------------------ READER ------------------------- */
+
+static bool dump_record(const TraceRecord *record, uint16_t *registers, Flags *flags, FILE *out) {
+    Opcode opcode;
+    const uint8_t *codeEnd = record->code + record->codeLen;
+    if(record->codeLen > MAX_OPCODE_LEN || Opcode_decode(&opcode, record->code, codeEnd) != OpcodeDecodeErr_OK) {
+        return false;
+    }
+
+    Opcode_decompile_to_file(&opcode, out);
+    fputs(" ;", out);
+
+    uint16_t after[Register_COUNT];
+    for(Register reg = 0; reg < Register_COUNT; ++reg) {
+        after[reg] = (record->changedRegs >> reg) & 1 ? record->registers[reg] : registers[reg];
+    }
+    const Flags flagsBefore = Flags_unpack(record->flagsBefore);
+    const Flags flagsAfter = Flags_unpack(record->flagsAfter);
+
+    OpcodeTrace_changes(registers, &flagsBefore, after, &flagsAfter, out);
+    fputc('\n', out);
+
+    memcpy(registers, after, sizeof(after));
+    *flags = flagsAfter;
+    return true;
+}
+
+bool TraceStream_dump(FILE *in, FILE *out) {
+    TraceHeader header;
+    if(fread(&header, sizeof(header), 1, in) != 1
+       || memcmp(header.magic, TRACE_STREAM_MAGIC, sizeof(header.magic)) != 0
+       || header.version != TRACE_STREAM_VERSION
+       || header.recordSize != sizeof(TraceRecord)) {
+        return false;
+    }
+
+    TraceRecord *records = malloc(TRACE_STREAM_BUFFER_RECORDS * sizeof(*records));
+    if(records == NULL) {
+        return false;
+    }
+
+    uint16_t registers[Register_COUNT];
+    memcpy(registers, header.registers, sizeof(registers));
+    Flags flags = Flags_unpack(header.flags);
+
+    bool ok = true;
+    size_t count;
+    while(ok && (count = fread(records, sizeof(*records), TRACE_STREAM_BUFFER_RECORDS, in)) > 0) {
+        for(size_t i = 0; ok && i < count; ++i) {
+            ok = dump_record(&records[i], registers, &flags, out);
+        }
+    }
+    free(records);
+
+    if(!ok || ferror(in)) {
+        return false;
+    }
+
+    OpcodeTrace_final_state(registers, &flags, out);
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef SIM86_TRACE_STREAM_H
+#define SIM86_TRACE_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "opcode/opcode.h"
+#include "memory/memory.h"
+
+/*
+ * Binary trace stream. A header with the initial registers and flags, followed
+ * by one fixed size record per opcode run. Values are stored in host byte order.
+ * TraceStream_dump renders it into the same text `sim86 trace` prints.
+ */
+
+#define TRACE_STREAM_MAGIC "SIM86TRC"
+#define TRACE_STREAM_VERSION 4 // Records hold prefixed opcodes since 2, repeat prefixes since 3, stack opcodes since 4
+#define TRACE_STREAM_BUFFER_RECORDS 16384 // Records buffered between writes
+
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint16_t recordSize;
+    uint16_t registers[Register_COUNT];
+    uint16_t flags;                     // Flags_pack
+} TraceHeader;
+
+typedef struct {
+    uint16_t ip;                        // IP of the opcode
+    uint8_t codeLen;
+    uint8_t memSize;                    // Bytes written to memory, 0 if none
+    uint8_t code[MAX_OPCODE_LEN];       // Opcode bytes, to decompile it
+    uint16_t changedRegs;               // Bit per Register
+    uint16_t flagsBefore, flagsAfter;   // Flags_pack
+    uint16_t registers[Register_COUNT]; // New values, only those in changedRegs are set
+    uint16_t memData;
+    uint32_t memAddr;                   // Linear address of the memory write
+} TraceRecord;
+
+typedef struct {
+    FILE *out;
+    TraceRecord *records;               // Flushed with a single fwrite once full
+    size_t count;
+    uint16_t regsBefore[Register_COUNT];
+    Register memSegment;                // Memory written by the current opcode
+    uint16_t memOffset;
+    bool failed;
+} TraceWriter;
+
+// Writes the stream header with the current memory state. Returns NULL if out of memory or on write error
+TraceWriter *TraceWriter_create(FILE *out, Memory *memory);
+
+// Flushes the buffered records. Returns false if any write failed
+bool TraceWriter_destroy(TraceWriter *writer);
+
+// Starts the record of an opcode, before running it
+void TraceWriter_begin(TraceWriter *writer, const Opcode *opcode, Memory *memory);
+
+// Completes the record of the opcode, after running it
+void TraceWriter_end(TraceWriter *writer, Memory *memory);
+
+// Prints the stream in the text trace format. Returns false if it is not a valid stream
+bool TraceStream_dump(FILE *in, FILE *out);
+
+#endif //SIM86_TRACE_STREAM_H
@@ -0,0 +1,38 @@
+; Jump and call clocks: relative, through a register or memory, and far
+
+bits 16
+
+mov sp, 0x2000
+mov bx, 0x1000
+jmp near rel_done
+rel_done:
+mov ax, reg_done
+jmp ax
+reg_done:
+mov word [bx], mem_done
+jmp word [bx]
+mem_done:
+jmp 0:far_done
+far_done:
+mov word [bx], far_mem_done
+mov word [bx+2], 0
+jmp far [bx]
+far_mem_done:
+mov ax, near_func
+mov word [bx+4], ax
+call ax
+call word [bx+4]
+call 0:far_func
+mov word [bx], far_func
+call far [bx]
+dec sp                      ; Odd SP: stack words take an extra bus cycle on the 8086 too
+call 0:far_func
+jmp done
+
+near_func:
+ret
+
+far_func:
+retf
+
+done:
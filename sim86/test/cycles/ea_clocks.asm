@@ -0,0 +1,52 @@
+bits 16
+
+mov bx, 1000
+mov bp, 2000
+mov si, 3000
+mov di, 4000
+
+mov cx, bx
+mov dx, 12
+
+mov dx, [1000]
+mov ax, [1000]
+mov [1001], ax
+mov cx, [bx]
+mov cx, [bp]
+mov [si], cx
+mov [di], cx
+
+mov cx, [bx + 1000]
+mov cx, [bp + 1000]
+mov [si + 1000], cx
+mov [di + 1000], cx
+
+add cx, dx
+add [di + 1000], cx
+add dx, 50
+
+mov dx, [bp + di]
+mov dx, [bx + si]
+mov dx, [bp + si]
+mov dx, [bx + di]
+mov dx, [bp + di + 1001]
+mov dx, [bx + si + 1001]
+mov dx, [bp + si + 1001]
+mov dx, [bx + di + 1001]
+
+mov byte [bx + 1], 3
+mov word [bx + 1], 3
+add word [bx + 1], 3
+cmp word [bx + 1], 3
+cmp [bx + 1], dx
+and dl, [bx + 1]
+
+mov cx, 3
+loop_start:
+	sub cx, 1
+	jnz loop_start
+mov cx, 2
+loop_loop:
+	loop loop_loop
+jcxz done
+done:
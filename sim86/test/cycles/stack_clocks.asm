@@ -0,0 +1,36 @@
+; Stack opcode clocks, with SP even and then odd
+
+bits 16
+
+mov sp, 0x2000
+mov bx, 0x1000
+push ax
+push es
+push word [bx]
+push word [bx+1]
+pop word [bx+3]
+pop ds
+pop cx
+pushf
+popf
+call even
+mov ax, 1
+push ax
+call args
+
+dec sp                      ; Every stack word now takes an extra bus cycle on the 8086 too
+push ax
+pop ax
+call odd
+jcxz done
+
+even:
+ret
+
+args:
+ret 2
+
+odd:
+ret
+
+done:
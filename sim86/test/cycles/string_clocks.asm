@@ -0,0 +1,25 @@
+; String opcode clocks, single and repeated, at even and odd addresses
+
+bits 16
+
+mov si, 0x1000
+mov di, 0x2000
+movsb
+movsw
+lodsw
+stosb
+scasw
+cmpsb
+
+mov cx, 4
+rep movsw                   ; 9 + 17/rep
+mov si, 0x1001
+mov cx, 4
+rep movsw                   ; Odd source
+mov cx, 0
+rep stosw                   ; No element
+mov cx, 8
+mov al, 1
+repe scasb                  ; Stops at the first element
+mov cx, 3
+es rep lodsb
@@ -0,0 +1,69 @@
+bool do_test_cycles_model(const char *asm_path, const char *cycles_arg, const char *txt_suffix) {
+    bool ret = true;
+
+    NomStringBuilder txt_path = {0};
+    nom_sb_append_str(&txt_path, asm_path);
+    txt_path.len -= 4;
+    nom_sb_append_str(&txt_path, txt_suffix);
+    nom_sb_append_null(&txt_path);
+
+    NomCmd cmd = {0};
+
+    cmd.out_path = "test_cycles_trace.txt";
+    if(!nom_cmd_run(&cmd, "./sim86", "trace", cycles_arg, "test_cycles.out")) {
+        printf("Error while running `%s`\n", asm_path);
+        nom_return_defer(false);
+    }
+
+    if(!nom_cmd_run(&cmd, "diff", txt_path.items, "test_cycles_trace.txt")) nom_return_defer(false);
+
+defer:
+    if(!ret) {
+        printf("File `%s` clocks trace doesn't match `%s`\n", asm_path, txt_path.items);
+    }
+    nom_sb_free(&txt_path);
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+bool do_test_cycles(const char *asm_path) {
+    NomCmd cmd = {0};
+    const bool assembled = nom_cmd_run(&cmd, "nasm", asm_path, "-o", "test_cycles.out");
+    nom_cmd_free(&cmd);
+    if(!assembled) return false;
+
+    bool success = do_test_cycles_model(asm_path, "--cycles=8086", ".txt");
+    success = do_test_cycles_model(asm_path, "--cycles=8088", "_8088.txt") && success;
+    return success;
+}
+
+bool walkable_do_test_cycles(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    if(!(type == NOM_FILE_REG && ftw->path_len >= 4 && strcmp(path + ftw->path_len - 4, ".asm") == 0)) {
+        return true;
+    }
+
+    return do_test_cycles(path);
+}
+
+int test_cycles(int argc, const char **argv) {
+    printf("\n");
+    bool success = true;
+
+    if(argc > 0) {
+        for(int i = 0; i < argc; i++) {
+            success = do_test_cycles(argv[i]) && success;
+        }
+    } else {
+        // If no files provided, run for all asm files in test directory
+        success = nom_files_read_dir("test/cycles", walkable_do_test_cycles);
+    }
+
+    nom_delete("test_cycles_trace.txt");
+    nom_delete("test_cycles.out");
+
+    if(success) {
+        printf("All files clocks matched\n\n");
+    }
+
+    return success ? 0 : 1;
+}
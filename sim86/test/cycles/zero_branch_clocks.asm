@@ -0,0 +1,11 @@
+; Branches taken to the next opcode still cost the taken clocks
+
+bits 16
+
+mov cx, 2
+cmp cx, 2
+je $+2                      ; Taken
+jne $+2                     ; Not taken
+loop $+2                    ; Taken, CX = 1
+loop $+2                    ; Not taken, CX = 0
+jcxz $+2                    ; Taken
@@ -0,0 +1,16 @@
+; Near, indirect and far jumps, calls and returns
+
+bits 16
+
+jmp $+5
+jmp near $+300
+jmp ax
+jmp word [bx]
+jmp 4660:22136
+jmp far [bx]
+call word [bx]
+call dx
+call 1:2
+call far [bp+si+4]
+retf
+retf 4
@@ -0,0 +1,10 @@
+; Near jumps to targets in short range must keep their 3 byte form, labeled too
+
+bits 16
+
+jmp near forward
+back:
+mov ax, bx
+forward:
+mov ax, bx
+jmp near back
@@ -0,0 +1,18 @@
+; Stack opcodes, calls and returns
+
+bits 16
+
+push ax
+push sp
+push word [bp+di+300]
+push ds
+push cs
+pop dx
+pop word [bx]
+pop es
+pushf
+popf
+call $+3
+call $-200
+ret
+ret 8
@@ -0,0 +1,24 @@
+; String opcodes and their prefixes
+
+bits 16
+
+movsb
+movsw
+cmpsb
+scasw
+lodsb
+stosw
+rep movsw
+rep stosb
+repe cmpsw
+repne scasb
+rep lodsw
+es lodsb
+cs movsw
+cld
+std
+clc
+stc
+cmc
+cli
+sti
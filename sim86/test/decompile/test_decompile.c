@@ -12,6 +12,20 @@ bool do_test_decompile(const char *asm_path) {
 
     if(!nom_cmd_run(&cmd, "diff", "test_asm_diff_nasm.out", "test_asm_diff_sim86.out")) nom_return_defer(false);
 
+    // Parallel decompilation must print the exact same listing
+    cmd.out_path = "test_asm_diff_sim86_threads.asm";
+    if(!nom_cmd_run(&cmd, "./sim86", "decompile", "--threads=4", "test_asm_diff_nasm.out")) nom_return_defer(false);
+
+    if(!nom_cmd_run(&cmd, "diff", "test_asm_diff_sim86.asm", "test_asm_diff_sim86_threads.asm")) nom_return_defer(false);
+
+    // Branches to labels must assemble back to the same code
+    cmd.out_path = "test_asm_diff_sim86_labels.asm";
+    if(!nom_cmd_run(&cmd, "./sim86", "decompile", "--labels", "test_asm_diff_nasm.out")) nom_return_defer(false);
+
+    if(!nom_cmd_run(&cmd, "nasm", "test_asm_diff_sim86_labels.asm", "-o", "test_asm_diff_sim86.out")) nom_return_defer(false);
+
+    if(!nom_cmd_run(&cmd, "diff", "test_asm_diff_nasm.out", "test_asm_diff_sim86.out")) nom_return_defer(false);
+
 defer:
     if(!ret) {
         printf("File `%s` could not be decompiled correctly\n", asm_path);
@@ -42,6 +56,8 @@ int test_decompile(int argc, const char **argv) {
     }
 
     nom_delete("test_asm_diff_sim86.asm");
+    nom_delete("test_asm_diff_sim86_threads.asm");
+    nom_delete("test_asm_diff_sim86_labels.asm");
     nom_delete("test_asm_diff_nasm.out");
     nom_delete("test_asm_diff_sim86.out");
 
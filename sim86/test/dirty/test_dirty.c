@@ -0,0 +1,45 @@
+// Dirty test: the framebuffer draw_rectangle writes must be dumped as the same ranges and bytes on every engine
+bool do_test_dirty(const char *page_size_arg, const char *dirty_path) {
+    bool ret = true;
+
+    const Sim86EngineRun run = {
+        .out_path = "test_dirty_run.txt",
+        .result_path = "test_dirty.dirty",
+        .golden_path = dirty_path,
+        .binary = true,
+    };
+    // The page size goes last, none for the default
+    if(!sim86_engines(&run, "run", "--dump-dirty=test_dirty.dirty", "test_dirty.out", page_size_arg)) {
+        nom_return_defer(false);
+    }
+
+defer:
+    if(!ret) {
+        printf("Dirty pages with `%s` don't match `%s`\n", page_size_arg ? page_size_arg : "default pages", dirty_path);
+    }
+    return ret;
+}
+
+int test_dirty(int argc, const char **argv) {
+    printf("\n");
+
+    NomCmd cmd = {0};
+    bool success = nom_cmd_run(&cmd, "nasm", "test/run/draw_rectangle.asm", "-o", "test_dirty.out");
+    nom_cmd_free(&cmd);
+
+    if(success) {
+        // Code shares the first default page with the image, smaller pages leave it out
+        success = do_test_dirty(NULL, "test/dirty/draw_rectangle.dirty");
+        success = do_test_dirty("--dirty-page-size=256", "test/dirty/draw_rectangle_256.dirty") && success;
+    }
+
+    nom_delete("test_dirty_run.txt");
+    nom_delete("test_dirty.dirty");
+    nom_delete("test_dirty.out");
+
+    if(success) {
+        printf("All dirty pages matched\n\n");
+    }
+
+    return success ? 0 : 1;
+}
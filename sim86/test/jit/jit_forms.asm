@@ -0,0 +1,106 @@
+bits 16
+
+; Hot loops over every operand form the jit emits natively, plus
+; opcodes that go through their handlers (byte alu, adc, sbb)
+
+mov bp, 2000
+mov bx, 3000
+mov di, 0
+mov cx, 40
+
+forms_loop:
+	mov ax, cx
+	add ax, 0x7ff0
+	sub ax, bx
+	cmp ax, word [bp + di]
+	mov word [bp + di], ax
+	add word [bx + di + 4], ax
+	sub word [bp + 2], cx
+	and ax, 0x0ff0
+	or word [bx], ax
+	xor dx, word [bx + di]
+	mov byte [bp + di + 1], cl
+	add dl, cl
+	sub dh, 3
+	xor byte [bx + 1], dl
+	adc ax, dx
+	sbb word [bp], 7
+	add di, 2
+	loop forms_loop
+
+mov cx, 0
+mov si, 0
+jumps_loop:
+	add si, 0x1357
+	cmp si, 0x8000
+	jl less
+	add cx, 1
+less:
+	cmp si, 0x4000
+	jle less_equal
+	add cx, 2
+less_equal:
+	cmp si, 0x2000
+	jb below
+	add cx, 3
+below:
+	cmp si, 0x1000
+	jbe below_equal
+	add cx, 4
+below_equal:
+	and si, si
+	jp parity
+	add cx, 5
+parity:
+	add si, 0x7000
+	jo overflow
+	add cx, 6
+overflow:
+	or si, si
+	js sign
+	add cx, 7
+sign:
+	cmp si, 0x1234
+	je equal
+	jnl not_less
+	add cx, 8
+not_less:
+	jnle not_less_equal
+	add cx, 9
+not_less_equal:
+	jnb not_below
+	add cx, 10
+not_below:
+	jnbe not_below_equal
+	add cx, 11
+not_below_equal:
+	jnp not_parity
+	add cx, 12
+not_parity:
+	jno not_overflow
+	add cx, 13
+not_overflow:
+	jns not_sign
+	add cx, 14
+not_sign:
+	jne equal
+	add cx, 15
+equal:
+	sub bp, 1
+	jnz jumps_loop
+
+mov cx, 30
+loopz_loop:
+	cmp cx, 0
+	loopz loopz_loop
+mov cx, 30
+mov dx, 0
+loopnz_loop:
+	add dx, 1
+	cmp dx, 20
+	loopnz loopnz_loop
+jcxz done
+mov cx, 0
+jcxz done
+mov dx, 0xffff
+done:
@@ -0,0 +1,64 @@
+// Differential test: the jit engine must leave the same final state as the interpreter
+bool do_test_jit(const char *asm_path) {
+    bool ret = true;
+
+    NomCmd cmd = {0};
+
+    if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", "test_jit.out")) nom_return_defer(false);
+
+    // Faults exit with status 2, on both engines and with the same message
+    const int status = sim86_status("test_jit_opcodes.txt", "run", "--final-state", "test_jit.out");
+    if(status != 0 && status != 2) {
+        printf("Error while running `%s`\n", asm_path);
+        nom_return_defer(false);
+    }
+
+    const int nativeStatus = sim86_status("test_jit_native.txt", "run", "--final-state", "--engine=jit",
+                                          "--jit-threshold=1", "test_jit.out");
+    if(nativeStatus != status) {
+        printf("Error while running `%s` with the jit engine\n", asm_path);
+        nom_return_defer(false);
+    }
+
+    if(!nom_cmd_run(&cmd, "diff", "test_jit_opcodes.txt", "test_jit_native.txt")) nom_return_defer(false);
+
+defer:
+    if(!ret) {
+        printf("File `%s` jit final state doesn't match the interpreter\n", asm_path);
+    }
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+bool walkable_do_test_jit(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    if(!(type == NOM_FILE_REG && ftw->path_len >= 4 && strcmp(path + ftw->path_len - 4, ".asm") == 0)) {
+        return true;
+    }
+
+    return do_test_jit(path);
+}
+
+int test_jit(int argc, const char **argv) {
+    printf("\n");
+    bool success = true;
+
+    if(argc > 0) {
+        for(int i = 0; i < argc; i++) {
+            success = do_test_jit(argv[i]) && success;
+        }
+    } else {
+        // If no files provided, run for all asm files in run and jit test directories
+        success = nom_files_read_dir("test/run", walkable_do_test_jit);
+        success = nom_files_read_dir("test/jit", walkable_do_test_jit) && success;
+    }
+
+    nom_delete("test_jit_opcodes.txt");
+    nom_delete("test_jit_native.txt");
+    nom_delete("test_jit.out");
+
+    if(success) {
+        printf("All files matched the interpreter with the jit engine\n\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+// Runs a program through the public API only, and checks every way of running it ends in the same state
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libsim86.h"
+
+typedef struct {
+    Sim86Stop stop;
+    uint64_t instructions;
+    uint16_t registers[Sim86Register_COUNT];
+    uint16_t flags;
+    uint64_t checksum;
+} State;
+
+static State state(Sim86 *sim, const Sim86Stop stop) {
+    State s = {.stop = stop, .instructions = Sim86_instructions(sim), .checksum = Sim86_checksum(sim)};
+    for(Sim86Register reg = 0; reg < Sim86Register_COUNT; ++reg) {
+        s.registers[reg] = Sim86_get_register(sim, reg);
+    }
+    s.flags = Sim86_get_flags(sim);
+    return s;
+}
+
+static bool same(const State *a, const State *b, const char *what) {
+    if(a->stop == b->stop && a->instructions == b->instructions && a->flags == b->flags
+       && a->checksum == b->checksum && memcmp(a->registers, b->registers, sizeof(a->registers)) == 0) {
+        return true;
+    }
+    printf("%s: ended with %" PRIu64 " instructions, ip %04x, checksum %016" PRIx64 " instead of %" PRIu64
+           ", ip %04x, checksum %016" PRIx64 "\n", what, b->instructions, b->registers[Sim86Register_IP],
+           b->checksum, a->instructions, a->registers[Sim86Register_IP], a->checksum);
+    return false;
+}
+
+static void count_trace(void *user, const Sim86TraceEvent *event) {
+    ++*(uint64_t *) user;
+}
+
+static bool check_engine(const char *path, const Sim86Engine engine, const State *expected) {
+    static const char *names[] = {"opcodes", "blocks", "jit"};
+
+    Sim86 *sim;
+    Sim86Err err = Sim86_create(&sim, engine);
+    if(err == Sim86Err_UNSUPPORTED) {
+        return true; // jit on a foreign host
+    }
+    if(err) {
+        printf("%s: can't create: %s\n", names[engine], Sim86Err_name(err));
+        return false;
+    }
+
+    bool ok = true;
+    char what[64];
+    if((err = Sim86_load_program_file(sim, path)) || (err = Sim86_snapshot(sim))) {
+        printf("%s: can't load `%s`: %s\n", names[engine], path, Sim86Err_name(err));
+        Sim86_destroy(sim);
+        return false;
+    }
+
+    // Twice from the same snapshot
+    for(int run = 0; run < 2; ++run) {
+        const State s = state(sim, Sim86_run(sim, 0));
+        snprintf(what, sizeof(what), "%s run %d", names[engine], run);
+        ok = same(expected, &s, what) && ok;
+        Sim86_restore(sim);
+    }
+
+    // One opcode at a time
+    Sim86Stop stop;
+    while((stop = Sim86_step(sim)) == Sim86Stop_INSTRUCTIONS) {}
+    const State stepped = state(sim, stop);
+    snprintf(what, sizeof(what), "%s steps", names[engine]);
+    ok = same(expected, &stepped, what) && ok;
+    Sim86_restore(sim);
+
+    // Traced, every opcode once
+    uint64_t traced = 0;
+    Sim86_set_trace(sim, count_trace, &traced);
+    Sim86_run(sim, 0);
+    Sim86_set_trace(sim, NULL, NULL);
+    if(traced != expected->instructions) {
+        printf("%s: traced %" PRIu64 " opcodes of %" PRIu64 "\n", names[engine], traced, expected->instructions);
+        ok = false;
+    }
+
+    // Loading again must forget everything
+    Sim86_load_program_file(sim, path);
+    const State reloaded = state(sim, Sim86_run(sim, 0));
+    snprintf(what, sizeof(what), "%s reload", names[engine]);
+    ok = same(expected, &reloaded, what) && ok;
+
+    Sim86_destroy(sim);
+    return ok;
+}
+
+int main(int argc, const char **argv) {
+    if(argc != 2) {
+        fprintf(stderr, "usage: %s <src_file>\n", argv[0]);
+        return 1;
+    }
+    if(Sim86_api_version() != SIM86_API_VERSION) {
+        printf("Built against api %d, linked with %d\n", SIM86_API_VERSION, Sim86_api_version());
+        return 1;
+    }
+
+    // The opcodes engine is the reference
+    Sim86 *sim;
+    Sim86Err err = Sim86_create(&sim, Sim86Engine_OPCODES);
+    if(!err) err = Sim86_load_program_file(sim, argv[1]);
+    if(err) {
+        printf("Can't load `%s`: %s\n", argv[1], Sim86Err_name(err));
+        return 1;
+    }
+    const State expected = state(sim, Sim86_run(sim, 0));
+    Sim86_destroy(sim);
+    if(expected.stop != Sim86Stop_END && expected.stop != Sim86Stop_FAULT) {
+        printf("Stopped before the end: %s\n", Sim86Stop_name(expected.stop));
+        return 1;
+    }
+
+    bool ok = true;
+    for(Sim86Engine engine = Sim86Engine_OPCODES; engine <= Sim86Engine_JIT; ++engine) {
+        ok = check_engine(argv[1], engine, &expected) && ok;
+    }
+    return ok ? 0 : 1;
+}
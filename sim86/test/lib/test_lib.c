@@ -0,0 +1,53 @@
+// Library test: lib_api, linked with libsim86.a only, must end every engine in the same state
+bool do_test_lib(const char *asm_path) {
+    bool ret = true;
+
+    NomCmd cmd = {0};
+
+    if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", "test_lib.out")) nom_return_defer(false);
+    if(!nom_cmd_run(&cmd, "./test_lib_api", "test_lib.out")) nom_return_defer(false);
+
+defer:
+    if(!ret) {
+        printf("File `%s` doesn't run the same through libsim86\n", asm_path);
+    }
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+bool walkable_do_test_lib(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    if(!(type == NOM_FILE_REG && ftw->path_len >= 4 && strcmp(path + ftw->path_len - 4, ".asm") == 0)) {
+        return true;
+    }
+
+    return do_test_lib(path);
+}
+
+int test_lib(int argc, const char **argv) {
+    printf("\n");
+
+    NomCmd cmd = {0};
+    bool success = nom_cmd_run(&cmd, "clang", "-Wall", "-Wextra", "-Wno-unused-parameter", "-iquote", "src/libsim86",
+                               "test/lib/lib_api.c", "libsim86.a", "-pthread", "-o", "test_lib_api");
+    nom_cmd_free(&cmd);
+
+    if(success) {
+        if(argc > 0) {
+            for(int i = 0; i < argc; i++) {
+                success = do_test_lib(argv[i]) && success;
+            }
+        } else {
+            // If no files provided, run for all asm files in the run test directory
+            success = nom_files_read_dir("test/run", walkable_do_test_lib);
+        }
+    }
+
+    nom_delete("test_lib_api");
+    nom_delete("test_lib.out");
+
+    if(success) {
+        printf("All files ran the same through libsim86\n\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+; Faults dividing by zero after a few opcodes
+
+bits 16
+
+mov ax, 7
+mov dx, 0
+mov cx, 0
+div cx
+mov bx, 1
@@ -0,0 +1,11 @@
+; Sums 20 down to 1, for every run limit to stop in the middle of the loop block or at its exit
+
+bits 16
+
+mov cx, 20
+mov ax, 0
+top:
+add ax, cx
+dec cx
+jnz top
+mov bx, ax
@@ -0,0 +1,73 @@
+// Limits test: every limit must stop every engine at the same opcode, with the same message and exit status
+typedef struct {
+    const char *name;       // Output must match test/limits/<name>.txt
+    const char *asm_path;
+    const char *limit;      // NULL for none
+    int status;             // Expected exit status
+    bool opcodes_only;
+} LimitsCase;
+
+static const LimitsCase limits_cases[] = {
+    {"loop", "test/limits/loop.asm", NULL, 0, false},
+    {"loop_max_instructions", "test/limits/loop.asm", "--max-instructions=25", 3, false},
+    {"loop_until_ip_in_block", "test/limits/loop.asm", "--until-ip=8", 5, false},
+    {"loop_until_ip_at_exit", "test/limits/loop.asm", "--until-ip=b", 5, false},
+    {"loop_max_cycles", "test/limits/loop.asm", "--max-cycles=100", 4, true},
+    {"div_zero", "test/limits/div_zero.asm", NULL, 2, false},
+};
+
+bool do_test_limits(const LimitsCase *test) {
+    bool ret = true;
+
+    NomStringBuilder txt_path = {0};
+    nom_sb_append_str(&txt_path, "test/limits/");
+    nom_sb_append_str(&txt_path, test->name);
+    nom_sb_append_str(&txt_path, ".txt");
+    nom_sb_append_null(&txt_path);
+
+    NomCmd cmd = {0};
+
+    if(!nom_cmd_run(&cmd, "nasm", test->asm_path, "-o", "test_limits.out")) nom_return_defer(false);
+
+    const Sim86EngineRun run = {
+        .out_path = "test_limits_run.txt",
+        .golden_path = txt_path.items,
+        .status = test->status,
+        .opcodes_only = test->opcodes_only,
+    };
+    // The limit goes last, none ends the arguments
+    if(!sim86_engines(&run, "run", "--final-state", "test_limits.out", test->limit)) nom_return_defer(false);
+
+defer:
+    if(!ret) {
+        printf("Case `%s` doesn't stop as `%s`\n", test->name, txt_path.items);
+    }
+    nom_sb_free(&txt_path);
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+int test_limits(int argc, const char **argv) {
+    printf("\n");
+    bool success = true;
+
+    // Cases may be picked by name
+    for(size_t i = 0; i < sizeof(limits_cases) / sizeof(limits_cases[0]); ++i) {
+        bool picked = argc == 0;
+        for(int j = 0; j < argc && !picked; j++) {
+            picked = strcmp(argv[j], limits_cases[i].name) == 0;
+        }
+        if(picked) {
+            success = do_test_limits(&limits_cases[i]) && success;
+        }
+    }
+
+    nom_delete("test_limits_run.txt");
+    nom_delete("test_limits.out");
+
+    if(success) {
+        printf("All limits stopped correctly\n\n");
+    }
+
+    return success ? 0 : 1;
+}
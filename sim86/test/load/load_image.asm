@@ -0,0 +1,27 @@
+; Reads back the image the test preloads twice, 0x1107b bytes each: at 2000:0000, page aligned so mostly
+; mapped, and at 3801:0003, copied. Both go past 64KB, into the pages after their first segment
+
+bits 16
+
+mov ax, 0x2000
+mov ds, ax
+mov ax, [0]
+mov bx, [0xfffe]
+mov word [2], 0x1234        ; Copy on write, the file must not change
+mov cx, 0x3000
+mov es, cx
+mov cx, [es:0]
+mov dl, [es:0x107a]         ; Last byte, in the copied tail
+
+mov si, 0x3801
+mov ds, si
+mov si, [3]
+mov di, 0x4801
+mov es, di
+mov di, [es:3]
+mov bp, 0x4801
+mov ds, bp
+mov dh, [0x107d]            ; Last byte
+mov bp, 0
+mov ds, bp
+mov es, bp
@@ -0,0 +1,56 @@
+// Load test: images placed with --load, mapped or copied, must read back the same on every engine
+#define TEST_LOAD_IMAGE_SIZE 0x1107b // Past 64KB, ending mid page
+
+// Every byte depends on its offset, so misplaced pages change what is read back
+bool write_test_load_image(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        return false;
+    }
+    for(int i = 0; i < TEST_LOAD_IMAGE_SIZE; ++i) {
+        fputc(((i ^ (i >> 8)) + 31 * (i >> 16)) & 0xFF, file);
+    }
+    return fclose(file) == 0;
+}
+
+bool do_test_load(void) {
+    bool ret = true;
+
+    NomCmd cmd = {0};
+
+    if(!write_test_load_image("test_load.img")) {
+        printf("Can't write `test_load.img`\n");
+        nom_return_defer(false);
+    }
+    if(!nom_cmd_run(&cmd, "nasm", "test/load/load_image.asm", "-o", "test_load.out")) nom_return_defer(false);
+
+    // The program writes to the mapped image: a later run reading a changed file would not match either
+    const Sim86EngineRun run = {.out_path = "test_load_run.txt", .golden_path = "test/load/load_image.txt"};
+    if(!sim86_engines(&run, "run", "--final-state", "--load=test_load.img@2000:0000", "--load=test_load.img@3801:0003",
+                      "test_load.out")) {
+        nom_return_defer(false);
+    }
+
+defer:
+    if(!ret) {
+        printf("Loaded images don't read back as `test/load/load_image.txt`\n");
+    }
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+int test_load(int argc, const char **argv) {
+    printf("\n");
+
+    const bool success = do_test_load();
+
+    nom_delete("test_load_run.txt");
+    nom_delete("test_load.img");
+    nom_delete("test_load.out");
+
+    if(success) {
+        printf("All images loaded correctly\n\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+; Carry chains: 32 bit arithmetic on word pairs, and byte immediates
+
+bits 16
+
+mov ax, 0xffff
+mov dx, 0x0001
+add ax, 1
+adc dx, 0               ; dx:ax = 0x00020000
+
+mov bx, 0x8000
+mov cx, 0x7fff
+add bx, 0x8000          ; Carry and overflow
+adc cx, 0               ; Overflow from the carry alone
+
+sub ax, 1
+sbb dx, 0               ; dx:ax = 0x0001ffff
+sub ax, 0xffff
+sbb dx, 2               ; Borrow through
+
+mov si, 1000
+mov word [si], 0xfff0
+mov word [si+2], 0x7fff
+add word [si], 0x20
+adc word [si+2], 0
+mov bp, [si+2]
+
+mov al, 0xf0
+add al, 0x20
+adc ah, 0xff            ; Byte immediate, sign extended in the encoding
+sbb al, 0x91
+sbb byte [si], 1
+mov di, [si]
@@ -0,0 +1,23 @@
+; Writes to CS move execution to other code, as far jumps do. The skipped bytes would change registers
+
+bits 16
+
+mov sp, 0x2000
+mov ax, 1
+push ax
+db 0x0f                     ; pop cs: CS = 1, the next opcode is 16 bytes further
+times 16 db 0x43            ; inc bx
+
+mov cx, 2
+jmp short over
+back:
+mov si, 3                   ; Reached with CS = 0 again
+jmp short done
+times 7 db 0x47             ; inc di
+over:
+xor dx, dx
+db 0x8e, 0xca               ; mov cs, dx: back is 16 bytes behind
+inc bp
+inc bp
+done:
+mov di, 4
@@ -0,0 +1,62 @@
+; Near, indirect and far jumps and calls. Far ones alias the code through CS = 1
+
+bits 16
+
+mov sp, 0x2000
+jmp short skip_short
+mov ax, 0xdead
+skip_short:
+jmp near skip_near
+mov ax, 0xdead
+skip_near:
+
+; Switch dispatch through a jump table, every case taken once
+mov word [0x1000], case0
+mov word [0x1002], case1
+mov word [0x1004], case2
+mov si, 4
+dispatch:
+jmp [si+0x1000]
+case0:
+add ax, 1
+jmp next
+case1:
+add ax, 16
+jmp next
+case2:
+add ax, 256
+next:
+sub si, 2
+jns dispatch
+
+mov dx, near_func
+call dx
+mov [0x1006], dx
+call word [0x1006]
+
+call 1:far_func-16
+mov word [0x1008], far_args-16
+mov word [0x100a], 1
+push ax
+call far [0x1008]
+jmp 1:tail-16
+
+near_func:
+inc cx
+ret
+
+far_func:
+inc bp
+retf
+
+far_args:                   ; Frees its argument
+mov bx, sp
+retf 2
+
+tail:
+mov word [0x100c], done
+mov word [0x100e], 0
+jmp far [0x100c]
+mov ax, 0xdead
+
+done:
@@ -0,0 +1,33 @@
+; INC and DEC keep the carry, NEG sets it unless the operand is 0
+
+bits 16
+
+mov ax, 0xffff
+add ax, 1               ; Carry set
+inc ax
+dec ax
+dec ax                  ; Carry still set
+
+mov bx, 0x7fff
+inc bx                  ; Overflow
+dec bx                  ; Overflow back
+mov cl, 0x0f
+inc cl                  ; Aux carry
+mov dl, 0xff
+inc dl                  ; Byte wraps to 0
+
+mov si, 1000
+mov word [si], 1
+dec word [si]
+inc byte [si+1]
+dec byte [si+2]
+mov bp, [si+1]
+
+neg bx
+neg cx
+mov dx, 0x8000
+neg dx                  ; Overflow, stays 0x8000
+xor di, di
+neg di                  ; No carry
+neg byte [si]
+mov sp, [si]
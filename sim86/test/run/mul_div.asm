@@ -0,0 +1,48 @@
+; Multiply and divide the accumulator, signed and unsigned
+
+bits 16
+
+mov al, 200
+mov bl, 3
+mul bl                  ; ax = 600, high half set
+mov ax, 1000
+mov cx, 1000
+mul cx                  ; dx:ax = 1000000
+mov ax, 7
+mov cx, 6
+mul cx                  ; High half clear
+
+mov al, -4
+mov bl, 5
+imul bl                 ; ax = -20, fits in al
+mov ax, -300
+mov cx, 200
+imul cx                 ; dx:ax = -60000
+
+mov ax, 1000
+mov bl, 7
+div bl                  ; al = 142, ah = 6
+mov dx, 0x000f
+mov ax, 0x4240
+mov cx, 1000
+div cx                  ; 1000000 / 1000
+
+mov ax, -100
+mov bl, 7
+idiv bl                 ; al = -14, ah = -2
+mov dx, -1
+mov ax, -1000
+mov cx, 7
+idiv cx                 ; ax = -142, dx = -6
+
+mov si, 1000
+mov word [si], 10
+mov ax, 55
+mul byte [si]
+xor dx, dx
+div word [si]
+
+mov ax, -1000
+mov bl, 7
+idiv bl                 ; -142 doesn't fit in al: divide error halts
+mov ax, 1               ; Never runs
@@ -0,0 +1,25 @@
+; Segment registers, override prefixes and wraparound
+
+bits 16
+
+mov ax, 0x1000
+mov es, ax
+mov bx, 0x100
+mov word [es:bx], 0x1234    ; 0x10100
+mov cx, [bx]                ; DS is still 0
+mov ax, 0x1010
+mov ds, ax
+mov dx, [0]                 ; Same byte through DS
+
+mov ax, 0xffff
+mov ss, ax
+mov bp, 0x400
+mov word [bp], 0xabcd       ; SS based, wraps past 1 MB to 0x3f0
+mov word [ds:bp], 0x4242
+mov ax, [0x400]
+
+mov si, 0xffff
+mov word [es:si], 0x5678    ; High byte wraps to the start of the segment
+mov di, [es:si]
+mov cx, [es:0]
+mov bl, [es:si]
@@ -0,0 +1,45 @@
+; Shift and rotate by 1 and by CL, on registers and memory
+
+bits 16
+
+mov ax, 0x8001
+shl ax, 1
+shl ax, 1
+mov cl, 4
+shl ax, cl
+
+mov bx, 0x8421
+shr bx, 1
+mov cl, 3
+shr bx, cl
+mov dx, 0x8000
+sar dx, 1
+mov cl, 20
+sar dx, cl              ; Count past the operand size, not masked
+
+mov si, 0x1234
+rol si, 1
+mov cl, 12
+rol si, cl
+ror si, 1
+mov cl, 16
+ror si, cl              ; Full turn, carry from the top bit
+
+mov di, 0x4000
+cmp di, 0x5000         ; Borrow sets carry
+rcl di, 1
+rcl di, 1
+mov cl, 17
+rcl di, cl              ; Full turn through carry
+rcr di, 1
+
+mov bp, 1000
+mov word [bp], 0x00f0
+shl word [bp], 1
+mov cl, 2
+shr byte [bp], cl
+rol byte [bp+1], 1
+rcr word [bp], cl
+mov cx, [bp]
+mov cl, 0
+shl cx, cl              ; Zero count, flags untouched
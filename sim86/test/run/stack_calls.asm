@@ -0,0 +1,61 @@
+; Stack opcodes, near calls and returns
+
+bits 16
+
+mov sp, 0x2000
+mov bx, 0x1000
+mov word [bx], 0x1234
+mov ax, 0x5678
+push ax
+push word [bx]
+push sp                     ; Stores SP after the decrement
+pop cx
+pop dx
+pop word [bx+2]
+
+mov ax, 0x3000
+mov es, ax
+push es
+pop ds
+push cs
+pop ds
+
+stc
+std
+pushf
+pop ax                      ; FLAGS word, unused bits set
+clc
+cld
+push ax
+popf
+
+mov ax, 5
+call sum
+mov [bx+4], ax
+mov ax, 7
+push ax
+mov ax, 9
+push ax
+call add_args
+mov [bx+6], ax
+xor cx, cx
+jcxz done
+
+sum:                        ; ax = ax + (ax - 1) + ... + 1, recursively
+cmp ax, 0
+je sum_done
+push ax
+dec ax
+call sum
+pop cx
+add ax, cx
+sum_done:
+ret
+
+add_args:                   ; ax = sum of both stacked words, freed on return
+mov bp, sp
+mov ax, [bp+2]
+add ax, [bp+4]
+ret 4
+
+done:
@@ -0,0 +1,56 @@
+; String opcodes, single and repeated, forward and backward
+
+bits 16
+
+mov ax, 0x0201
+mov di, 0x1000
+mov cx, 8
+rep stosw                   ; Fills 0x1000-0x100f
+mov al, 0x55
+mov cx, 3
+rep stosb
+
+mov si, 0x1000
+mov di, 0x1100
+mov cx, 0x10
+rep movsb                   ; Disjoint copy
+mov bx, [0x110e]
+
+mov si, 0x1100
+mov di, 0x1101
+mov cx, 5
+rep movsb                   ; Overlapping ahead of the source repeats its first byte
+mov dx, [0x1104]
+
+std
+mov si, 0x1103
+mov di, 0x1203
+mov cx, 2
+rep movsw                   ; Backwards
+cld
+mov bp, [0x1202]
+
+mov si, 0x1000
+lodsw
+lodsb
+mov di, 0x1000
+mov al, 0x55
+mov cx, 0x20
+repne scasb                 ; Stops past the first 0x55
+mov si, 0x1000
+mov di, 0x1100
+mov cx, 0x10
+repe cmpsb                  ; Stops past the first difference
+
+mov bx, 0x1000
+mov es, bx
+mov di, 0xffff
+mov ax, 0xabcd
+stosw                       ; High byte wraps to the start of the segment
+mov dx, [es:0]
+mov di, 0xfffe
+mov cx, 3
+rep stosb                   ; Steps past the end of the segment too
+mov cx, [es:0]
+mov si, 0xfffe
+es lodsw
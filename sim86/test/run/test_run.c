@@ -1,3 +1,10 @@
+// Traces test_run.out with arg (NULL for none) into out_path. Faults exit with status 2 too, goldens tell
+// whether they should
+bool trace_test_run(const char *out_path, const char *arg) {
+    const int status = sim86_status_err(out_path, "/dev/null", "trace", "test_run.out", arg);
+    return status == 0 || status == 2;
+}
+
 bool do_test_run(const char *asm_path) {
     bool ret = true;
 
@@ -11,14 +18,35 @@ bool do_test_run(const char *asm_path) {
 
     if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", "test_run.out")) nom_return_defer(false);
 
-    cmd.out_path = "test_run_trace.txt";
-    if(!nom_cmd_run(&cmd, "./sim86", "trace", "test_run.out")) {
+    if(!trace_test_run("test_run_trace.txt", NULL)) {
         printf("Error while running `%s`\n", asm_path);
         nom_return_defer(false);
     }
 
     if(!nom_cmd_run(&cmd, "diff", txt_path.items, "test_run_trace.txt")) nom_return_defer(false);
 
+    // Blocks engine must trace the same
+    if(!trace_test_run("test_run_trace.txt", "--engine=blocks")) {
+        printf("Error while running `%s` with the blocks engine\n", asm_path);
+        nom_return_defer(false);
+    }
+
+    if(!nom_cmd_run(&cmd, "diff", txt_path.items, "test_run_trace.txt")) nom_return_defer(false);
+
+    // Binary trace stream must render the same text
+    if(!trace_test_run("/dev/null", "--trace-out=test_run_trace.bin")) {
+        printf("Error while running `%s` with a binary trace\n", asm_path);
+        nom_return_defer(false);
+    }
+
+    cmd.out_path = "test_run_trace.txt";
+    if(!nom_cmd_run(&cmd, "./sim86", "trace-dump", "test_run_trace.bin")) {
+        printf("Error while dumping `%s` binary trace\n", asm_path);
+        nom_return_defer(false);
+    }
+
+    if(!nom_cmd_run(&cmd, "diff", txt_path.items, "test_run_trace.txt")) nom_return_defer(false);
+
 defer:
     if(!ret) {
         printf("File `%s` run trace doesn't match `%s`\n", asm_path, txt_path.items);
@@ -50,6 +78,7 @@ int test_run(int argc, const char **argv) {
     }
 
     nom_delete("test_run_trace.txt");
+    nom_delete("test_run_trace.bin");
     nom_delete("test_run.out");
 
     if(success) {
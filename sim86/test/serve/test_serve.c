@@ -0,0 +1,102 @@
+// Serve test: traces sent through `sim86 client` must match the run goldens, on every engine
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_SERVE_SOCKET "test_serve.sock"
+
+bool do_test_serve(const char *asm_path) {
+    bool ret = true;
+
+    NomStringBuilder txt_path = {0};
+    nom_sb_append_str(&txt_path, asm_path);
+    txt_path.len -= 4;
+    nom_sb_append_str(&txt_path, ".txt");
+    nom_sb_append_null(&txt_path);
+
+    NomCmd cmd = {0};
+
+    if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", "test_serve.out")) nom_return_defer(false);
+
+    const Sim86EngineRun run = {
+        .out_path = "test_serve_trace.txt",
+        .err_path = "/dev/null",
+        .golden_path = txt_path.items,
+    };
+    if(!sim86_engines(&run, "client", "--socket=" TEST_SERVE_SOCKET, "--trace", "test_serve.out")) {
+        nom_return_defer(false);
+    }
+
+defer:
+    if(!ret) {
+        printf("File `%s` served trace doesn't match `%s`\n", asm_path, txt_path.items);
+    }
+    nom_sb_free(&txt_path);
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+bool walkable_do_test_serve(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    if(!(type == NOM_FILE_REG && ftw->path_len >= 4 && strcmp(path + ftw->path_len - 4, ".asm") == 0)) {
+        return true;
+    }
+
+    return do_test_serve(path);
+}
+
+int test_serve(int argc, const char **argv) {
+    printf("\n");
+
+    const pid_t server = fork();
+    if(server < 0) {
+        printf("Can't start the server\n");
+        return 1;
+    }
+    if(server == 0) {
+        execl("./sim86", "./sim86", "serve", "--socket=" TEST_SERVE_SOCKET, "--threads=2", (char *) NULL);
+        _exit(127);
+    }
+
+    // Wait for the socket, 5 seconds at most
+    bool success = false;
+    for(int tries = 0; tries < 500 && !success; ++tries) {
+        success = access(TEST_SERVE_SOCKET, F_OK) == 0;
+        if(!success) usleep(10000);
+    }
+    if(!success) {
+        printf("Server didn't open `%s`\n", TEST_SERVE_SOCKET);
+    }
+
+    if(success) {
+        if(argc > 0) {
+            for(int i = 0; i < argc; i++) {
+                success = do_test_serve(argv[i]) && success;
+            }
+        } else {
+            // If no files provided, run for all asm files in the run test directory
+            success = nom_files_read_dir("test/run", walkable_do_test_serve);
+        }
+    }
+
+    // Must stop on SIGTERM and take its socket away
+    int status;
+    kill(server, SIGTERM);
+    if(waitpid(server, &status, 0) != server || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Server didn't stop cleanly\n");
+        success = false;
+    }
+    if(access(TEST_SERVE_SOCKET, F_OK) == 0) {
+        printf("Server left `%s` behind\n", TEST_SERVE_SOCKET);
+        nom_delete(TEST_SERVE_SOCKET);
+        success = false;
+    }
+
+    nom_delete("test_serve_trace.txt");
+    nom_delete("test_serve.out");
+
+    if(success) {
+        printf("All files were served correctly\n\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+// Shared by the suites that check how sim86 exits, which nom_cmd_run doesn't tell, or run it on every engine
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Runs ./sim86 with args, a NULL terminated list starting with its command, writing its stdout to out_path
+// and its stderr to err_path, or to out_path too if NULL. Returns its exit status, or -1 if it could not run
+// or was killed
+int sim86_status_args(const char *out_path, const char *err_path, const char *const args[]) {
+    const pid_t pid = fork();
+    if(pid < 0) {
+        return -1;
+    }
+    if(pid == 0) {
+        const int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        const int errFd = err_path ? open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : fd;
+        if(fd < 0 || errFd < 0) _exit(127);
+        dup2(fd, STDOUT_FILENO);
+        dup2(errFd, STDERR_FILENO);
+        close(fd);
+        if(errFd != fd) close(errFd);
+        execv("./sim86", (char *const *) args);
+        _exit(127);
+    }
+
+    int status;
+    if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+#define sim86_status(out_path, ...) sim86_status_args(out_path, NULL, (const char *[]) {"./sim86", __VA_ARGS__, NULL})
+
+// Same, with stderr apart
+#define sim86_status_err(out_path, err_path, ...) \
+    sim86_status_args(out_path, err_path, (const char *[]) {"./sim86", __VA_ARGS__, NULL})
+
+// Every engine, as the argument that picks it
+static const char *const sim86_engines[] = {"--engine=opcodes", "--engine=blocks", "--engine=jit"};
+
+typedef struct {
+    const char *out_path;       // Gets stdout, and stderr unless err_path is set
+    const char *err_path;
+    const char *result_path;    // Compared to golden_path, out_path if NULL
+    const char *golden_path;
+    bool binary;                // Compare with cmp instead of diff
+    int status;                 // Expected exit status
+    bool opcodes_only;
+} Sim86EngineRun;
+
+// Runs ./sim86 with args, a NULL terminated list starting with its command, on every engine (the opcodes
+// engine alone if opcodes_only). Each run must exit with the expected status and leave the golden result.
+// Prints the engine that didn't
+bool sim86_engines_args(const Sim86EngineRun *run, const char *const args[]) {
+    const char *argv[64] = {"./sim86", args[0]};
+    size_t argc = 3;
+    for(size_t i = 1; args[i] && argc < sizeof(argv) / sizeof(argv[0]) - 1; ++i) {
+        argv[argc++] = args[i];
+    }
+
+    const size_t engines = run->opcodes_only ? 1 : sizeof(sim86_engines) / sizeof(sim86_engines[0]);
+    for(size_t i = 0; i < engines; ++i) {
+        argv[2] = sim86_engines[i];
+
+        const int status = sim86_status_args(run->out_path, run->err_path, argv);
+        if(status != run->status) {
+            printf("Exited with %d instead of %d with %s\n", status, run->status, sim86_engines[i]);
+            return false;
+        }
+
+        NomCmd cmd = {0};
+        const bool same = nom_cmd_run(&cmd, run->binary ? "cmp" : "diff", run->golden_path,
+                                      run->result_path ? run->result_path : run->out_path);
+        nom_cmd_free(&cmd);
+        if(!same) {
+            printf("With %s\n", sim86_engines[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#define sim86_engines(run, ...) sim86_engines_args(run, (const char *[]) {__VA_ARGS__, NULL})
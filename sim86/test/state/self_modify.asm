@@ -0,0 +1,15 @@
+; Patches its own code and data as it runs, so a run that doesn't start from the loaded state goes another way
+
+bits 16
+
+mov cx, 3
+top:
+patch:
+mov bx, 1                   ; Immediate becomes 7 after the first pass
+add [0x1000], bx
+mov word [patch + 1], 7
+cmp word [0x1000], 8
+jne skip
+mov dx, 0xbeef              ; Only reached on the second pass of a fresh start
+skip:
+loop top
@@ -0,0 +1,103 @@
+// State test: repeated runs, and runs continued from a saved state, must end as a single run on every engine
+bool do_test_state(const char *asm_path) {
+    bool ret = true;
+
+    NomCmd cmd = {0};
+
+    if(!nom_cmd_run(&cmd, "nasm", asm_path, "-o", "test_state.out")) nom_return_defer(false);
+
+    // Reference single run, which ends or faults, and state after 8 instructions, unless it stopped before
+    const int status = sim86_status("test_state_single.txt", "run", "--final-state", "test_state.out");
+    if(status != 0 && status != 2) {
+        printf("Single run exited with %d\n", status);
+        nom_return_defer(false);
+    }
+    const int saveStatus = sim86_status("test_state_run.txt", "run", "--max-instructions=8",
+                                        "--save-state=test_state_single.state", "test_state.out");
+    if(saveStatus != 3 && saveStatus != status) {
+        printf("Saving run exited with %d\n", saveStatus);
+        nom_return_defer(false);
+    }
+
+    // Snapshot restored between runs, written code included
+    const Sim86EngineRun repeat = {
+        .out_path = "test_state_run.txt",
+        .golden_path = "test_state_single.txt",
+        .status = status,
+    };
+    if(!sim86_engines(&repeat, "run", "--final-state", "--repeat=3", "test_state.out")) {
+        printf("Repeated\n");
+        nom_return_defer(false);
+    }
+
+    // Stopped part way, every engine must save the same state, and continue from it as a single run
+    const Sim86EngineRun save = {
+        .out_path = "test_state_run.txt",
+        .result_path = "test_state.state",
+        .golden_path = "test_state_single.state",
+        .binary = true,
+        .status = saveStatus,
+    };
+    if(!sim86_engines(&save, "run", "--max-instructions=8", "--save-state=test_state.state", "test_state.out")) {
+        printf("Saved\n");
+        nom_return_defer(false);
+    }
+    const Sim86EngineRun load = {
+        .out_path = "test_state_run.txt",
+        .golden_path = "test_state_single.txt",
+        .status = status,
+    };
+    if(!sim86_engines(&load, "run", "--final-state", "--load-state=test_state.state")) {
+        printf("Continued from a saved state\n");
+        nom_return_defer(false);
+    }
+
+    // Cut in its first page, it must be refused
+    if(truncate("test_state.state", 100) != 0
+       || sim86_status("test_state_run.txt", "run", "--load-state=test_state.state") != 1) {
+        printf("Truncated state wasn't refused\n");
+        nom_return_defer(false);
+    }
+
+defer:
+    if(!ret) {
+        printf("File `%s` doesn't end in the same state\n", asm_path);
+    }
+    nom_cmd_free(&cmd);
+    return ret;
+}
+
+bool walkable_do_test_state(const char *path, NomFileType type, NomFileStats *ftw, va_list args) {
+    if(!(type == NOM_FILE_REG && ftw->path_len >= 4 && strcmp(path + ftw->path_len - 4, ".asm") == 0)) {
+        return true;
+    }
+
+    return do_test_state(path);
+}
+
+int test_state(int argc, const char **argv) {
+    printf("\n");
+    bool success = true;
+
+    if(argc > 0) {
+        for(int i = 0; i < argc; i++) {
+            success = do_test_state(argv[i]) && success;
+        }
+    } else {
+        // If no files provided, run for the self modifying code here and every run test
+        success = nom_files_read_dir("test/state", walkable_do_test_state);
+        success = nom_files_read_dir("test/run", walkable_do_test_state) && success;
+    }
+
+    nom_delete("test_state_single.txt");
+    nom_delete("test_state_run.txt");
+    nom_delete("test_state_single.state");
+    nom_delete("test_state.state");
+    nom_delete("test_state.out");
+
+    if(success) {
+        printf("All files ended in the same state\n\n");
+    }
+
+    return success ? 0 : 1;
+}